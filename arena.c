@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "tools.h"
+#include "arena.h"
+
+static char *l_base = NULL;
+static size_t l_size = 0;
+static size_t l_used = 0;
+static int l_huge = 0;
+static pthread_mutex_t l_mArena = PTHREAD_MUTEX_INITIALIZER;
+
+int arenaInit(size_t size, int hugePages)
+{
+#ifdef _WIN32
+   l_base = _aligned_malloc(size, ARENA_ALIGN);
+#else
+   void *p = MAP_FAILED;
+
+   if (hugePages)
+   {
+      size = (size + ARENA_HUGE_PAGE - 1) & ~(size_t)(ARENA_HUGE_PAGE - 1);
+#ifdef MAP_HUGETLB
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      l_huge = (MAP_FAILED != p);
+#endif
+   }
+   if (MAP_FAILED == p)
+   {
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (MAP_FAILED == p)
+      {
+         return -1;
+      }
+#ifdef MADV_HUGEPAGE
+      /*No reserved huge pages, ask for transparent ones:*/
+      if ( hugePages && (0 == madvise(p, size, MADV_HUGEPAGE)) )
+      {
+         l_huge = 1;
+      }
+#endif
+   }
+   l_base = p;
+#endif
+   if (NULL == l_base)
+   {
+      return -1;
+   }
+   l_size = size;
+   l_used = 0;
+   return 0;
+}/*arenaInit*/
+
+int arenaIsHuge(void)
+{
+   return l_huge;
+}/*arenaIsHuge*/
+
+void *arenaAlloc(size_t size)
+{
+   void *ret = NULL;
+   size = ARENA_ROUND(size);
+   pthread_mutex_lock(&l_mArena);
+   if (l_size - l_used >= size)
+   {
+      ret = l_base + l_used;
+      l_used += size;
+   }
+   pthread_mutex_unlock(&l_mArena);
+   return ret;
+}/*arenaAlloc*/
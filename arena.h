@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H 1
+
+/*
+  The arena of long living buffers (blocks of workers and of the
+  pipeline). It is allocated once, so that large blocks do not live on
+  stacks, and every buffer is aligned to a cache line, so that buffers of
+  different threads never share one. Optionally the arena is backed by
+  huge pages: MAP_HUGETLB if the system has reserved huge pages,
+  otherwise transparent huge pages are requested by madvise(). Buffers
+  are never freed individually.
+*/
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARENA_ALIGN 64
+#define ARENA_HUGE_PAGE (2 << 20)
+
+/*The space taken by a buffer of size bytes:*/
+#define ARENA_ROUND(size) ( ((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1) )
+
+/*Reserves size bytes. Returns 0 on success:*/
+int arenaInit(size_t size, int hugePages);
+
+/*Returns !0 if the arena is backed by huge pages:*/
+int arenaIsHuge(void);
+
+/*Returns an aligned buffer or NULL if the arena is exhausted. Thread
+  safe:*/
+void *arenaAlloc(size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
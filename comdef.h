@@ -1,10 +1,11 @@
-
 #ifndef COMDEF_H
 
 #define COMDEF_H
 
 #ifdef _WIN32
 
+#include <intrin.h>
+
 #define COM_INLINE _inline
 #define  CUSTOM_ALLOCA _alloca
 #define int16_t __int16
@@ -13,12 +14,39 @@
 #define PRId16 "hd"
 #define PRId32 "d"
 #define PRId64 "ld"
+#define snprintf _snprintf
+#define vsnprintf _vsnprintf
+
+#define COM_THREAD_LOCAL __declspec(thread)
+
+/*64 bit offsets:*/
+#define COM_FSEEK _fseeki64
+#define COM_FTELL _ftelli64
+
+/*x86 is strongly ordered, a compiler barrier is enough for load/store:*/
+#define COM_ATOMIC_LOAD(p) (_ReadWriteBarrier(), *(p))
+#define COM_ATOMIC_STORE(p, v) do{ _ReadWriteBarrier(); *(p) = (v); _ReadWriteBarrier(); }while(0)
+/*Both return the old value:*/
+#define COM_ATOMIC_ADD(p, v) _InterlockedExchangeAdd((volatile long*)(p), (long)(v))
+#define COM_ATOMIC_ADD64(p, v) _InterlockedExchangeAdd64((volatile __int64*)(p), (__int64)(v))
 
 #else
 
 #define COM_INLINE inline
 #define  CUSTOM_ALLOCA alloca
 
+#define COM_THREAD_LOCAL __thread
+
+/*64 bit offsets, off_t is 64 bit with _FILE_OFFSET_BITS=64 (see Makefile):*/
+#define COM_FSEEK fseeko
+#define COM_FTELL ftello
+
+#define COM_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define COM_ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+/*Both return the old value:*/
+#define COM_ATOMIC_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#define COM_ATOMIC_ADD64(p, v) __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+
 #endif
 
 #define COM_INT int
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "tools.h"
+#include "deadline.h"
+
+/*A weight of a new speed sample:*/
+#define DEADLINE_EWMA 0.2
+/*The plan must fit into this part of the time left:*/
+#define DEADLINE_MARGIN 0.9
+
+int g_deadlineOn = 0;
+
+/*From the best to the fastest:*/
+static const int l_qualities[] = {DEADLINE_BEST_QUALITY, 5, 7, 9};
+/*Typical speeds relative to the first level, used until a level is
+  measured:*/
+static const double l_ratios[] = {1.0, 1.3, 1.8, 2.5};
+#define DEADLINE_LEVELS ( (int)(sizeof(l_qualities) / sizeof(l_qualities[0])) )
+
+static pthread_mutex_t l_mDeadline = PTHREAD_MUTEX_INITIALIZER;
+/*all protected by l_mDeadline:*/
+static time_t l_deadline = 0;
+static int l_nWorkers = 1;
+static int64_t l_queued = 0;
+static int64_t l_done = 0;
+static double l_speed[DEADLINE_LEVELS];/*bytes per second of a worker*/
+static int l_measured[DEADLINE_LEVELS];
+static int l_level = 0;/*the last chosen one*/
+
+void deadlineStart(time_t deadline, int nWorkers)
+{
+   l_deadline = deadline;
+   l_nWorkers = (nWorkers > 0)? nWorkers: 1;
+   memset(l_speed, 0, sizeof(l_speed));
+   memset(l_measured, 0, sizeof(l_measured));
+   g_deadlineOn = 1;
+}/*deadlineStart*/
+
+void deadlineQueued(int64_t bytes)
+{
+   pthread_mutex_lock(&l_mDeadline);
+   l_queued += bytes;
+   pthread_mutex_unlock(&l_mDeadline);
+}/*deadlineQueued*/
+
+/*The speed of the level, measured or estimated from the closest measured
+  one. 0 if nothing is measured yet. Must be called with l_mDeadline
+  locked:*/
+static double levelSpeed(int level)
+{
+   int i, best = -1;
+   if (l_measured[level])
+   {
+      return l_speed[level];
+   }
+   for (i = 0; i < DEADLINE_LEVELS; ++i)
+   {
+      if ( l_measured[i] && ( (best < 0) || (abs(i - level) < abs(best - level)) ) )
+      {
+         best = i;
+      }
+   }
+   return (best < 0)? 0.0: l_speed[best] * l_ratios[level] / l_ratios[best];
+}/*levelSpeed*/
+
+int deadlineQuality(void)
+{
+   double left = difftime(l_deadline, time(NULL)) * DEADLINE_MARGIN;
+   double need = 0.0;
+   int level;
+
+   pthread_mutex_lock(&l_mDeadline);
+   if (left <= 0.0)
+   {
+      level = DEADLINE_LEVELS - 1;
+      if (level != l_level)
+      {
+         logMsg(LOG_INFO, "Deadline: quality %d, the deadline has passed\n", l_qualities[level]);
+      }
+   }
+   else
+   {
+      for (level = 0; ; ++level)
+      {
+         double speed = levelSpeed(level);
+         /*the first file is encoded at the best level to measure it:*/
+         if (0.0 == speed)
+         {
+            break;
+         }
+         need = (double)(l_queued - l_done) / (speed * l_nWorkers);
+         if ( (need <= left) || (DEADLINE_LEVELS - 1 == level) )
+         {
+            break;
+         }
+      }
+      if (level != l_level)
+      {
+         logMsg(LOG_INFO, "Deadline: quality %d, %.1f s of encoding for %.1f s left\n",
+                l_qualities[level], need, left / DEADLINE_MARGIN);
+      }
+   }
+   l_level = level;
+   pthread_mutex_unlock(&l_mDeadline);
+   return l_qualities[level];
+}/*deadlineQuality*/
+
+void deadlineEncoded(int quality, int64_t bytes, int64_t us)
+{
+   int level;
+   for (level = 0; (level < DEADLINE_LEVELS - 1) && (l_qualities[level] != quality); ++level)
+   {
+      ;
+   }
+   pthread_mutex_lock(&l_mDeadline);
+   l_done += bytes;
+   if (us > 0)
+   {
+      double speed = (double)bytes * 1000000.0 / (double)us;
+      l_speed[level] = l_measured[level]?
+                       l_speed[level] + DEADLINE_EWMA * (speed - l_speed[level]): speed;
+      l_measured[level] = 1;
+   }
+   pthread_mutex_unlock(&l_mDeadline);
+}/*deadlineEncoded*/
+
+void deadlineForget(int64_t bytes)
+{
+   pthread_mutex_lock(&l_mDeadline);
+   l_done += bytes;
+   pthread_mutex_unlock(&l_mDeadline);
+}/*deadlineForget*/
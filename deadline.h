@@ -0,0 +1,51 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H 1
+
+/*
+  Deadline aware quality selection, see --deadline.
+
+  The remaining work is the PCM bytes of the queued files which are not
+  encoded yet. Encoders report how fast each quality level encodes (an
+  exponentially weighted moving average of bytes per second of a
+  worker). Before a file is encoded, the highest quality whose speed
+  lets all the workers finish the remaining work in time is chosen. A
+  level which was not tried yet is estimated from a measured one by
+  typical ratios of LAME speeds, so the batch steps down to faster levels
+  only when needed and steps back up when it is ahead.
+
+  Only the encoding is measured, reading and writing are not.
+*/
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!0 after deadlineStart():*/
+extern int g_deadlineOn;
+
+/*The quality used without a deadline and the best one chosen with it:*/
+#define DEADLINE_BEST_QUALITY 3
+
+void deadlineStart(time_t deadline, int nWorkers);
+
+/*A file of the size is queued:*/
+void deadlineQueued(int64_t bytes);
+
+/*The LAME quality (lame_set_quality()) of the next file:*/
+int deadlineQuality(void);
+
+/*A block of PCM bytes was encoded at the quality in us microseconds:*/
+void deadlineEncoded(int quality, int64_t bytes, int64_t us);
+
+/*A finished file had bytes which were not encoded (the header, a
+  failure...):*/
+void deadlineForget(int64_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
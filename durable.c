@@ -0,0 +1,319 @@
+#ifdef __linux__
+/*syncfs():*/
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "tools.h"
+#include "durable.h"
+
+typedef struct entry_struct
+{
+   struct entry_struct *next;
+   char *source;
+   int fd;
+   int rc;
+   int wholeFs;/*synced by syncfs()*/
+   int dirSynced;/*this one synced its directory, with dirRc*/
+   int dirRc;
+   int64_t dev;
+   char output[1];
+}entry_t;
+
+static pthread_mutex_t l_mDurable = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t l_cDurable = PTHREAD_COND_INITIALIZER;
+/*the queue of the next batch:*/
+static entry_t *l_head = NULL;
+static entry_t **l_tail = &l_head;
+static int l_n = 0;
+static int64_t l_first = 0;/*us, when the first one was queued*/
+static int l_stop = 0;
+static int l_windowMs = 0;
+static durableDone_t l_done = NULL;
+static pthread_t l_syncer;
+static int l_running = 0;
+
+#ifdef _WIN32
+
+static int openOutput(char *name)
+{
+   return _open(name, _O_WRONLY | _O_BINARY);
+}/*openOutput*/
+
+static int syncOutput(int fd)
+{
+   return _commit(fd);
+}/*syncOutput*/
+
+/*New names are durable with the file:*/
+static int syncDir(char *output)
+{
+   return 0;
+}/*syncDir*/
+
+#define closeOutput _close
+
+#else /*_WIN32*/
+
+static int openOutput(char *name)
+{
+   return open(name, O_RDONLY);
+}/*openOutput*/
+
+static int syncOutput(int fd)
+{
+   return fdatasync(fd);
+}/*syncOutput*/
+
+/*The name of a new file is durable when its directory is synced:*/
+static int syncDir(char *output)
+{
+   char dir[MAX_PATH_LENGTH];
+   char *slash;
+   int fd, rc;
+
+   strncpy(dir, output, MAX_PATH_LENGTH - 1);
+   dir[MAX_PATH_LENGTH - 1] = '\0';
+   slash = strrchr(dir, '/');
+   if (NULL == slash)
+   {
+      strcpy(dir, ".");
+   }
+   else
+   {
+      slash[(slash == dir)? 1: 0] = '\0';
+   }
+   if ( (fd = open(dir, O_RDONLY)) < 0 )
+   {
+      return -1;
+   }
+   rc = fsync(fd);
+   close(fd);
+   return rc;
+}/*syncDir*/
+
+#define closeOutput close
+
+#endif /*_WIN32*/
+
+/*The length of the directory part of the name:*/
+static size_t dirLength(char *name)
+{
+   char *slash = strrchr(name, '/');
+#ifdef _WIN32
+   char *bslash = strrchr(name, '\\');
+   if ( (NULL == slash) || ( (NULL != bslash) && (bslash > slash) ) )
+   {
+      slash = bslash;
+   }
+#endif
+   return (NULL == slash)? 0: (size_t)(slash - name);
+}/*dirLength*/
+
+static void syncBatch(entry_t **e, int n)
+{
+   int i, j;
+
+   for (i = 0; i < n; ++i)
+   {
+      struct stat st;
+      e[i]->fd = openOutput(e[i]->output);
+      e[i]->rc = (e[i]->fd < 0)? -1: 0;
+      e[i]->dev = ( (e[i]->fd >= 0) && (0 == fstat(e[i]->fd, &st)) )? (int64_t)st.st_dev: -1;
+   }
+#ifdef __linux__
+   /*one syncfs() for a device with many files, it covers the names too:*/
+   for (i = 0; i < n; ++i)
+   {
+      int count = 0;
+      if ( (0 != e[i]->rc) || (0 != e[i]->wholeFs) || (e[i]->dev < 0) )
+      {
+         continue;
+      }
+      for (j = i; j < n; ++j)
+      {
+         count += (0 == e[j]->rc) && (e[j]->dev == e[i]->dev);
+      }
+      if (count >= DURABLE_SYNCFS_MIN)
+      {
+         int rc = syncfs(e[i]->fd);
+         logMsg(LOG_DEBUG, "syncfs() for %d files\n", count);
+         for (j = i; j < n; ++j)
+         {
+            if ( (0 == e[j]->rc) && (e[j]->dev == e[i]->dev) )
+            {
+               e[j]->wholeFs = 1;
+               e[j]->rc = rc;
+            }
+         }
+      }
+   }
+#endif
+   for (i = 0; i < n; ++i)
+   {
+      if ( (0 == e[i]->rc) && (0 == e[i]->wholeFs) )
+      {
+         e[i]->rc = syncOutput(e[i]->fd);
+      }
+   }
+   /*each directory once:*/
+   for (i = 0; i < n; ++i)
+   {
+      size_t l = dirLength(e[i]->output);
+      if ( (0 != e[i]->rc) || (0 != e[i]->wholeFs) )
+      {
+         continue;
+      }
+      for (j = 0; j < i; ++j)
+      {
+         if ( (0 != e[j]->dirSynced) && (dirLength(e[j]->output) == l) &&
+              (0 == memcmp(e[j]->output, e[i]->output, l)) )
+         {
+            break;
+         }
+      }
+      if (j < i)
+      {
+         e[i]->rc = e[j]->dirRc;
+      }
+      else
+      {
+         e[i]->dirSynced = 1;
+         e[i]->rc = e[i]->dirRc = syncDir(e[i]->output);
+      }
+   }
+   for (i = 0; i < n; ++i)
+   {
+      if (e[i]->fd >= 0)
+      {
+         closeOutput(e[i]->fd);
+      }
+   }
+}/*syncBatch*/
+
+static void *syncer(void *unused)
+{
+   entry_t *batch[DURABLE_BATCH];
+
+   pthread_mutex_lock(&l_mDurable);
+   for(;;)
+   {
+      entry_t *e;
+      int i, n;
+
+      while ( (0 == l_n) && (0 == l_stop) )
+      {
+         pthread_cond_wait(&l_cDurable, &l_mDurable);
+      }
+      if (0 == l_n)
+      {
+         break;
+      }
+      /*more files for the batch until the window is over:*/
+      while ( (0 == l_stop) && (l_n < DURABLE_BATCH) )
+      {
+         struct timespec ts;
+         int64_t left = (int64_t)l_windowMs * 1000 - (getTimeUs() - l_first);
+         if (left <= 0)
+         {
+            break;
+         }
+         clock_gettime(CLOCK_REALTIME, &ts);
+         left += (int64_t)ts.tv_nsec / 1000;
+         ts.tv_sec += (time_t)(left / 1000000);
+         ts.tv_nsec = (long)(left % 1000000) * 1000;
+         pthread_cond_timedwait(&l_cDurable, &l_mDurable, &ts);
+      }
+      for (n = 0; (n < DURABLE_BATCH) && (NULL != l_head); ++n)
+      {
+         batch[n] = l_head;
+         l_head = l_head->next;
+      }
+      if (NULL == l_head)
+      {
+         l_tail = &l_head;
+      }
+      l_n -= n;
+      l_first = getTimeUs();
+      pthread_mutex_unlock(&l_mDurable);
+
+      syncBatch(batch, n);
+      for (i = 0; i < n; ++i)
+      {
+         e = batch[i];
+         l_done(e->source, e->output, (0 == e->rc)? 0: -1);
+         free(e);
+      }
+      pthread_mutex_lock(&l_mDurable);
+   }
+   pthread_mutex_unlock(&l_mDurable);
+   return NULL;
+}/*syncer*/
+
+int durableStart(int windowMs, durableDone_t done)
+{
+   l_windowMs = windowMs;
+   l_done = done;
+   l_stop = 0;
+   if (0 != pthread_create(&l_syncer, NULL, syncer, NULL))
+   {
+      return -1;
+   }
+   l_running = 1;
+   return 0;
+}/*durableStart*/
+
+void durableAdd(char *source, char *output)
+{
+   size_t lo = strlen(output), ls = strlen(source) + 1;
+   entry_t *e = malloc(sizeof(entry_t) + lo + ls);
+
+   if (NULL == e)
+   {
+      halt(15, "malloc fails\n");
+   }
+   memset(e, 0, sizeof(entry_t));
+   memcpy(e->output, output, lo + 1);
+   e->source = e->output + lo + 1;
+   memcpy(e->source, source, ls);
+   pthread_mutex_lock(&l_mDurable);
+   *l_tail = e;
+   l_tail = &e->next;
+   if (0 == l_n++)
+   {
+      l_first = getTimeUs();
+      pthread_cond_signal(&l_cDurable);
+   }
+   else if (DURABLE_BATCH == l_n)
+   {
+      pthread_cond_signal(&l_cDurable);
+   }
+   pthread_mutex_unlock(&l_mDurable);
+}/*durableAdd*/
+
+void durableStop(void)
+{
+   if (0 == l_running)
+   {
+      return;
+   }
+   pthread_mutex_lock(&l_mDurable);
+   l_stop = 1;
+   pthread_cond_signal(&l_cDurable);
+   pthread_mutex_unlock(&l_mDurable);
+   pthread_join(l_syncer, NULL);
+   l_running = 0;
+}/*durableStop*/
@@ -0,0 +1,43 @@
+#ifndef DURABLE_H
+#define DURABLE_H 1
+
+/*
+  Batched durability of the outputs, see --durable.
+
+  A finished output is not synced by its worker: it is queued for the
+  syncer thread, which waits up to the window for more files and makes
+  the whole batch durable at once. A device with at least
+  DURABLE_SYNCFS_MIN files of the batch is synced by one syncfs() (Linux),
+  otherwise each file gets fdatasync() and each directory of the batch
+  one fsync() for the new names. Only then the callback reports the
+  files of the batch, so a file is never reported done (journaled, its
+  source removed) before its output is on the disk.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*files of one batch at most (each one is open while it is synced):*/
+#define DURABLE_BATCH 256
+/*files of a batch on one device to sync the whole filesystem:*/
+#define DURABLE_SYNCFS_MIN 16
+
+/*Called by the syncer thread for each file of a synced batch, in the
+  order they were added, rc is 0 if the output is durable:*/
+typedef void (*durableDone_t)(char *source, char *output, int rc);
+
+/*Starts the syncer. Returns 0 on success:*/
+int durableStart(int windowMs, durableDone_t done);
+
+/*Queues the output of the source (both names are copied):*/
+void durableAdd(char *source, char *output);
+
+/*Syncs and reports the rest, stops the syncer:*/
+void durableStop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
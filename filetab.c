@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "tools.h"
+#include "filetab.h"
+
+/*bytes of names in a chunk, for names of 64 bytes in average:*/
+#define FILETAB_NAMES (FILETAB_CHUNK * 64)
+#define FILETAB_CHUNKS (1 << (32 - FILETAB_CHUNK_BITS))
+
+typedef struct
+{
+   fileEntry_t entries[FILETAB_CHUNK];
+   int used;/*entries*/
+   int live;/*entries which are not released*/
+   int filling;/*!0 while it is the current chunk of its root*/
+   size_t namesUsed;
+   char names[FILETAB_NAMES];
+}chunk_t;
+
+static pthread_mutex_t l_mTab = PTHREAD_MUTEX_INITIALIZER;
+/*Indices are "chunk:slot". The array is never moved, so readers of
+  entries do not need the lock: an index is published by the queues
+  after its entry is written. Protected by l_mTab:*/
+static chunk_t *l_chunks[FILETAB_CHUNKS];
+/*chunks taken so far:*/
+static uint32_t l_nChunks = 0;
+/*The chunk being filled by each root, FILETAB_CHUNKS if none. A chunk
+  holds the files of one root, so the live entries of a slow root don't
+  pin chunks filled by the others:*/
+static uint32_t *l_current = NULL;
+static uint32_t l_nDirs = 0;
+
+uint32_t fileTabAdd(uint32_t dir, char *name, int64_t size, float cost)
+{
+   size_t l = strlen(name) + 1;
+   chunk_t *c = NULL;
+   fileEntry_t *e;
+   uint32_t i, n;
+
+   if (l > FILETAB_NAMES)
+   {
+      return FILETAB_NONE;
+   }
+   pthread_mutex_lock(&l_mTab);
+   if (dir >= l_nDirs)
+   {
+      uint32_t *current = realloc(l_current, (dir + 1) * sizeof(uint32_t));
+      if (NULL == current)
+      {
+         pthread_mutex_unlock(&l_mTab);
+         return FILETAB_NONE;
+      }
+      for (; l_nDirs <= dir; ++l_nDirs)
+      {
+         current[l_nDirs] = FILETAB_CHUNKS;
+      }
+      l_current = current;
+   }
+   n = l_current[dir];
+   if (FILETAB_CHUNKS != n)
+   {
+      c = l_chunks[n];
+      if ( (FILETAB_CHUNK == c->used) || (c->namesUsed + l > FILETAB_NAMES) )
+      {
+         /*it is full, it will be freed by the last release:*/
+         c->filling = 0;
+         if (0 == c->live)
+         {
+            free(c);
+            l_chunks[n] = NULL;
+         }
+         c = NULL;
+         l_current[dir] = FILETAB_CHUNKS;
+      }
+   }
+   if (NULL == c)
+   {
+      if ( (FILETAB_CHUNKS == l_nChunks) || (NULL == (c = malloc(sizeof(chunk_t)))) )
+      {
+         pthread_mutex_unlock(&l_mTab);
+         return FILETAB_NONE;
+      }
+      c->used = 0;
+      c->live = 0;
+      c->filling = 1;
+      c->namesUsed = 0;
+      n = l_current[dir] = l_nChunks++;
+      l_chunks[n] = c;
+   }
+   i = (n << FILETAB_CHUNK_BITS) | (uint32_t)c->used;
+   if (FILETAB_NONE == i)
+   {
+      pthread_mutex_unlock(&l_mTab);
+      return FILETAB_NONE;
+   }
+   e = c->entries + c->used++;
+   ++c->live;
+   e->dir = dir;
+   e->name = (uint32_t)c->namesUsed;
+   e->size = size;
+   e->cost = cost;
+   e->next = FILETAB_NONE;
+   memcpy(c->names + c->namesUsed, name, l);
+   c->namesUsed += l;
+   pthread_mutex_unlock(&l_mTab);
+   return i;
+}/*fileTabAdd*/
+
+fileEntry_t *fileTabEntry(uint32_t i)
+{
+   return l_chunks[i >> FILETAB_CHUNK_BITS]->entries + (i & (FILETAB_CHUNK - 1));
+}/*fileTabEntry*/
+
+char *fileTabName(uint32_t i)
+{
+   chunk_t *c = l_chunks[i >> FILETAB_CHUNK_BITS];
+   return c->names + c->entries[i & (FILETAB_CHUNK - 1)].name;
+}/*fileTabName*/
+
+void fileTabRelease(uint32_t i)
+{
+   uint32_t n = i >> FILETAB_CHUNK_BITS;
+   pthread_mutex_lock(&l_mTab);
+   if ( (0 == --l_chunks[n]->live) && (0 == l_chunks[n]->filling) )
+   {
+      free(l_chunks[n]);
+      l_chunks[n] = NULL;
+   }
+   pthread_mutex_unlock(&l_mTab);
+}/*fileTabRelease*/
+
+void fileTabFree(void)
+{
+   uint32_t n;
+   pthread_mutex_lock(&l_mTab);
+   for (n = 0; n < l_nChunks; ++n)
+   {
+      free(l_chunks[n]);
+      l_chunks[n] = NULL;
+   }
+   l_nChunks = 0;
+   free(l_current);
+   l_current = NULL;
+   l_nDirs = 0;
+   pthread_mutex_unlock(&l_mTab);
+}/*fileTabFree*/
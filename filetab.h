@@ -0,0 +1,57 @@
+#ifndef FILETAB_H
+#define FILETAB_H 1
+
+/*
+  The table of discovered files. Instead of a malloc'ed name per file,
+  entries (the root, the name, the size and the cost of the fair
+  queuing) and their names are packed into chunks of FILETAB_CHUNK
+  entries, and queues carry 32 bit indices of entries.
+
+  Each root fills its own chunk (by any thread adding its files), and a
+  chunk is freed as a whole when all its entries are released (the file
+  is taken from the queue), so the memory follows the length of the
+  queue of each root. The rest is freed at the end by fileTabFree().
+
+  Indices are not reused: up to 2^32 - 1 files per run.
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*entries in a chunk, a power of 2:*/
+#define FILETAB_CHUNK_BITS 12
+#define FILETAB_CHUNK (1 << FILETAB_CHUNK_BITS)
+/*not an index:*/
+#define FILETAB_NONE UINT32_MAX
+
+typedef struct
+{
+   uint32_t dir;/*the root*/
+   uint32_t name;/*offset of the name in its chunk*/
+   int64_t size;/*bytes, -1 if unknown*/
+   float cost;/*see popFileName()*/
+   uint32_t next;/*the next track of a group or FILETAB_NONE, see --gapless*/
+}fileEntry_t;
+
+/*Adds a copy of the name (not linked to a next one). Returns the index
+  or FILETAB_NONE if there is no memory. Thread safe:*/
+uint32_t fileTabAdd(uint32_t dir, char *name, int64_t size, float cost);
+
+/*The entry and its name are valid until the entry is released:*/
+fileEntry_t *fileTabEntry(uint32_t i);
+char *fileTabName(uint32_t i);
+
+/*The entry is not needed any more. Thread safe:*/
+void fileTabRelease(uint32_t i);
+
+/*Frees everything:*/
+void fileTabFree(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
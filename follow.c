@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "tools.h"
+#include "follow.h"
+
+void followInit(follow_t *w, char *fileName, int64_t size, int idleMs)
+{
+   w->fileName = fileName;
+   w->fd = -2;
+   w->closed = 0;
+   w->size = size;
+   w->grown = getTimeUs();
+   w->idleMs = idleMs;
+   w->end = -1;
+}/*followInit*/
+
+int64_t followSize(FILE *f)
+{
+#ifdef _WIN32
+   struct _stati64 st;
+   if (0 != _fstati64(_fileno(f), &st))
+#else
+   struct stat st;
+   if (0 != fstat(fileno(f), &st))
+#endif
+   {
+      return -1;
+   }
+   return (int64_t)st.st_size;
+}/*followSize*/
+
+#ifdef __linux__
+
+static void openWatch(follow_t *w)
+{
+   w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if ( (w->fd >= 0) && (inotify_add_watch(w->fd, w->fileName, IN_MODIFY | IN_CLOSE_WRITE) < 0) )
+   {
+      close(w->fd);
+      w->fd = -1;
+   }
+   if (w->fd < 0)
+   {
+      logMsg(LOG_DEBUG, "File '%s': no inotify, polling\n", w->fileName);
+   }
+}/*openWatch*/
+
+/*Waits for an event, notes the close:*/
+static void waitEvent(follow_t *w)
+{
+   /*aligned as struct inotify_event:*/
+   int64_t buf[(sizeof(struct inotify_event) + 256) / sizeof(int64_t) * 4];
+   struct pollfd p;
+   ssize_t n;
+
+   if (w->fd < 0)
+   {
+      msleep(FOLLOW_PERIOD);
+      return;
+   }
+   p.fd = w->fd;
+   p.events = POLLIN;
+   if (poll(&p, 1, FOLLOW_PERIOD) <= 0)
+   {
+      return;
+   }
+   while ( (n = read(w->fd, buf, sizeof(buf))) > 0 )
+   {
+      char *e = (char*)buf;
+      while (e < (char*)buf + n)
+      {
+         struct inotify_event *ev = (struct inotify_event*)e;
+         if (0 != (ev->mask & IN_CLOSE_WRITE))
+         {
+            w->closed = 1;
+         }
+         e += sizeof(struct inotify_event) + ev->len;
+      }
+   }
+}/*waitEvent*/
+
+void followClose(follow_t *w)
+{
+   if (w->fd >= 0)
+   {
+      close(w->fd);
+   }
+   w->fd = -1;
+}/*followClose*/
+
+#else /*__linux__*/
+
+static void openWatch(follow_t *w)
+{
+   w->fd = -1;
+}/*openWatch*/
+
+static void waitEvent(follow_t *w)
+{
+   msleep(FOLLOW_PERIOD);
+}/*waitEvent*/
+
+void followClose(follow_t *w)
+{
+   w->fd = -1;
+}/*followClose*/
+
+#endif /*__linux__*/
+
+int followWait(follow_t *w, FILE *f)
+{
+   int64_t size;
+   if (-2 == w->fd)
+   {
+      openWatch(w);
+   }
+   if ( (size = followSize(f)) > w->size )
+   {
+      w->size = size;
+      w->grown = getTimeUs();
+      return FOLLOW_GREW;
+   }
+   if ( (0 != w->closed) || (getTimeUs() - w->grown >= (int64_t)w->idleMs * 1000) )
+   {
+      return FOLLOW_DONE;
+   }
+   waitEvent(w);
+   if ( (size = followSize(f)) > w->size )
+   {
+      w->size = size;
+      w->grown = getTimeUs();
+      return FOLLOW_GREW;
+   }
+   return FOLLOW_QUIET;
+}/*followWait*/
@@ -0,0 +1,63 @@
+#ifndef FOLLOW_H
+#define FOLLOW_H 1
+
+/*
+  Following a file which is still being written (a recording in
+  progress), see --follow.
+
+  The reader encodes what is on the disk and, when it reaches the end,
+  waits for the file to grow. On Linux it waits on inotify for writes
+  and for the writer closing the file, so the end of a recording is seen
+  at once; elsewhere (or if inotify is not available, e.g. on network
+  filesystems) the size is polled. Either way a file which has not grown
+  for the idle time is considered finished.
+
+  Between waits the caller may check whether the writer has finalized
+  the header (see FOLLOW_QUIET), so a polled file is also finished as
+  soon as its header is patched.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*ms, the longest wait without an event:*/
+#define FOLLOW_PERIOD 250
+
+/*see followWait():*/
+#define FOLLOW_GREW 0
+#define FOLLOW_QUIET 1
+#define FOLLOW_DONE 2
+
+typedef struct
+{
+   char *fileName;/*not a copy*/
+   int fd;/*inotify, -1 if the size is polled, -2 before the first wait*/
+   int closed;/*the writer closed the file*/
+   int64_t size;/*the last seen*/
+   int64_t grown;/*us, when the size changed*/
+   int idleMs;
+   int64_t end;/*of the data when the file is finished, -1 before*/
+}follow_t;
+
+void followInit(follow_t *w, char *fileName, int64_t size, int idleMs);
+
+/*The current size of the open file f, -1 on error:*/
+int64_t followSize(FILE *f);
+
+/*Waits up to FOLLOW_PERIOD ms for f to grow. Returns FOLLOW_GREW if it
+  has grown, FOLLOW_QUIET if not yet, FOLLOW_DONE if the writer closed it
+  or it was idle for w->idleMs:*/
+int followWait(follow_t *w, FILE *f);
+
+/*Releases the watch, may be called more than once:*/
+void followClose(follow_t *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
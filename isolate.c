@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tools.h"
+#include "isolate.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <semaphore.h>
+#include <pthread.h>
+
+/*Job queue of slot numbers:*/
+#define QFL_TYPE int
+#define QFL_PREFIX iso_
+#define QFL_NULL (-1)
+#include "queue.h"
+
+/*Sent instead of a slot number to stop a worker:*/
+#define ISO_STOP (-2)
+/*ms, how often the parent looks for dead workers:*/
+#define ISO_REAP_PERIOD 100
+
+typedef struct
+{
+   char fileName[MAX_PATH_LENGTH];
+   int status;
+}isoSlot_t;
+
+/*Everything here lives in the shared mapping:*/
+typedef struct
+{
+   pthread_mutex_t m;
+   sem_t sJobs;/*jobs in jobQ*/
+   sem_t sResults;/*slots in resultQ*/
+   iso_qFL_t jobQ;
+   iso_qFL_t resultQ;
+   int nSlots;
+   isoSlot_t *slots;
+   int *current;/*the slot being encoded by the worker, or -1*/
+}isoShared_t;
+
+static isoShared_t *l_sh = NULL;
+static isolate_t *l_iso = NULL;
+static pid_t *l_pids = NULL;
+
+/*Parent only: free slots and the dispatcher state:*/
+static pthread_mutex_t l_mFree = PTHREAD_MUTEX_INITIALIZER;
+static sem_t l_sFree;
+static int *l_freeSlots = NULL;
+static int l_nFree = 0;
+static int l_inFlight = 0;/*protected by l_mFree*/
+static int l_dispatcherDone = 0;/*protected by l_mFree*/
+
+/*The owner of the mutex may die, recover it:*/
+static void isoLock(void)
+{
+   if (EOWNERDEAD == pthread_mutex_lock(&l_sh->m))
+   {
+      pthread_mutex_consistent(&l_sh->m);
+   }
+}/*isoLock*/
+
+static void isoUnlock(void)
+{
+   pthread_mutex_unlock(&l_sh->m);
+}/*isoUnlock*/
+
+static void theIsolatedWorker(int id)
+{
+   char fileName[MAX_PATH_LENGTH];
+   for(;;)
+   {
+      int slot, status;
+      while ( (0 != sem_wait(&l_sh->sJobs)) && (EINTR == errno) )
+      {
+         ;
+      }
+      isoLock();
+      slot = iso_qFLPop(&l_sh->jobQ);
+      l_sh->current[id] = (slot >= 0)? slot: -1;
+      isoUnlock();
+      if (ISO_STOP == slot)
+      {
+         return;
+      }
+      if (slot < 0)
+      {
+         continue;/*impossible*/
+      }
+      /*encode() may modify the name, the parent needs it intact:*/
+      strcpy(fileName, l_sh->slots[slot].fileName);
+      status = l_iso->encode(id, fileName);
+      l_sh->slots[slot].status = status;
+      isoLock();
+      l_sh->current[id] = -1;
+      iso_qFLPushFifo(&l_sh->resultQ, slot);
+      isoUnlock();
+      sem_post(&l_sh->sResults);
+   }
+}/*theIsolatedWorker*/
+
+static int spawnWorker(int id)
+{
+   pid_t pid = fork();
+   if (pid < 0)
+   {
+      return -1;
+   }
+   if (0 == pid)
+   {
+      signal(SIGINT, SIG_DFL);
+      theIsolatedWorker(id);
+      _exit(0);
+   }
+   l_pids[id] = pid;
+   return 0;
+}/*spawnWorker*/
+
+static void freeSlot(int slot)
+{
+   pthread_mutex_lock(&l_mFree);
+   l_freeSlots[l_nFree++] = slot;
+   --l_inFlight;
+   pthread_mutex_unlock(&l_mFree);
+   sem_post(&l_sFree);
+}/*freeSlot*/
+
+static void *dispatcher(void *unused)
+{
+   for(;;)
+   {
+      char *fileName;
+      int slot;
+
+      sem_wait(&l_sFree);
+      fileName = l_iso->nextJob();
+      if (NULL == fileName)
+      {
+         break;
+      }
+      pthread_mutex_lock(&l_mFree);
+      slot = l_freeSlots[--l_nFree];
+      ++l_inFlight;
+      pthread_mutex_unlock(&l_mFree);
+
+      if (strlen(fileName) >= MAX_PATH_LENGTH)
+      {
+         errorMsg("Too long path name '%s'\n", fileName);
+         free(fileName);
+         freeSlot(slot);
+         continue;
+      }
+      strcpy(l_sh->slots[slot].fileName, fileName);
+      free(fileName);
+      isoLock();
+      iso_qFLPushFifo(&l_sh->jobQ, slot);
+      isoUnlock();
+      sem_post(&l_sh->sJobs);
+   }
+   pthread_mutex_lock(&l_mFree);
+   l_dispatcherDone = 1;
+   pthread_mutex_unlock(&l_mFree);
+   return NULL;
+}/*dispatcher*/
+
+/*Looks for dead workers, fails their jobs and respawns them:*/
+static void reapWorkers(int respawn)
+{
+   int status, reaped = 0;
+   pid_t pid;
+
+   while ( 0 < (pid = waitpid(-1, &status, WNOHANG)) )
+   {
+      int id, slot;
+      for (id = 0; (id < l_iso->nWorkers) && (l_pids[id] != pid); ++id)
+      {
+         ;
+      }
+      if (id == l_iso->nWorkers)
+      {
+         continue;/*not ours*/
+      }
+      l_pids[id] = 0;
+      ++reaped;
+      isoLock();
+      slot = l_sh->current[id];
+      l_sh->current[id] = -1;
+      isoUnlock();
+      if (slot >= 0)
+      {
+         if (WIFSIGNALED(status))
+         {
+            errorMsg("File '%s': worker %d killed by signal %d\n",
+                     l_sh->slots[slot].fileName, id, WTERMSIG(status));
+         }
+         else
+         {
+            errorMsg("File '%s': worker %d exited with %d\n",
+                     l_sh->slots[slot].fileName, id, WEXITSTATUS(status));
+         }
+         l_iso->jobDone(l_sh->slots[slot].fileName, l_iso->crashStatus);
+         freeSlot(slot);
+      }
+      if ( respawn && (0 != spawnWorker(id)) )
+      {
+         errorMsg("Can't respawn worker %d\n", id);
+      }
+   }
+   if (0 != reaped)
+   {
+      /*A worker could die between sem_wait() and the pop, so its count
+        of the job is lost. Extra counts only wake a worker to an empty
+        queue:*/
+      int value, n;
+      isoLock();
+      n = iso_qFLLength(&l_sh->jobQ);
+      isoUnlock();
+      if (0 == sem_getvalue(&l_sh->sJobs, &value))
+      {
+         for (; value < n; ++value)
+         {
+            sem_post(&l_sh->sJobs);
+         }
+      }
+   }
+}/*reapWorkers*/
+
+static void *mapShared(size_t size)
+{
+   void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   return (MAP_FAILED == p)? NULL: p;
+}/*mapShared*/
+
+int runIsolated(isolate_t *iso)
+{
+   pthread_mutexattr_t ma;
+   pthread_t disp;
+   int i, nSlots = 2 * iso->nWorkers;
+   /*room for all slots plus stop markers:*/
+   int qLength = nSlots + iso->nWorkers + 1;
+   size_t size = sizeof(isoShared_t) + nSlots * sizeof(isoSlot_t) +
+                 (iso->nWorkers + 2 * qLength) * sizeof(int);
+   char *p;
+
+   l_iso = iso;
+   if (NULL == (p = mapShared(size)))
+   {
+      return -1;
+   }
+   l_sh = (isoShared_t*)p;
+   p += sizeof(isoShared_t);
+   l_sh->slots = (isoSlot_t*)p;
+   p += nSlots * sizeof(isoSlot_t);
+   l_sh->current = (int*)p;
+   p += iso->nWorkers * sizeof(int);
+   iso_qFLInit((int*)p, qLength, &l_sh->jobQ, QFL_FAIL_IF_FULL);
+   p += qLength * sizeof(int);
+   iso_qFLInit((int*)p, qLength, &l_sh->resultQ, QFL_FAIL_IF_FULL);
+   l_sh->nSlots = nSlots;
+
+   pthread_mutexattr_init(&ma);
+   pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+   pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+   if ( (0 != pthread_mutex_init(&l_sh->m, &ma)) ||
+        (0 != sem_init(&l_sh->sJobs, 1, 0)) ||
+        (0 != sem_init(&l_sh->sResults, 1, 0)) ||
+        (0 != sem_init(&l_sFree, 0, nSlots)) )
+   {
+      return -1;
+   }
+   pthread_mutexattr_destroy(&ma);
+
+   l_freeSlots = malloc(nSlots * sizeof(int));
+   l_pids = calloc(iso->nWorkers, sizeof(pid_t));
+   if ( (NULL == l_freeSlots) || (NULL == l_pids) )
+   {
+      return -1;
+   }
+   for (i = 0; i < nSlots; ++i)
+   {
+      l_freeSlots[l_nFree++] = i;
+   }
+   for (i = 0; i < iso->nWorkers; ++i)
+   {
+      l_sh->current[i] = -1;
+      if (0 != spawnWorker(i))
+      {
+         return -1;
+      }
+   }
+   message("%d worker processes started\n", iso->nWorkers);
+
+   if (0 != pthread_create(&disp, NULL, dispatcher, NULL))
+   {
+      return -1;
+   }
+
+   /*Collect results:*/
+   for(;;)
+   {
+      struct timespec ts;
+      int done;
+
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += ISO_REAP_PERIOD * 1000000L;
+      if (ts.tv_nsec >= 1000000000L)
+      {
+         ts.tv_nsec -= 1000000000L;
+         ++ts.tv_sec;
+      }
+      sem_timedwait(&l_sh->sResults, &ts);
+      /*All the results: a worker could die after queuing its result but
+        before sem_post(), so they are not counted by the semaphore:*/
+      for(;;)
+      {
+         int slot;
+         isoLock();
+         slot = iso_qFLPop(&l_sh->resultQ);
+         isoUnlock();
+         if (slot < 0)
+         {
+            break;
+         }
+         iso->jobDone(l_sh->slots[slot].fileName, l_sh->slots[slot].status);
+         freeSlot(slot);
+      }
+      reapWorkers(1);
+      pthread_mutex_lock(&l_mFree);
+      done = l_dispatcherDone && (0 == l_inFlight);
+      pthread_mutex_unlock(&l_mFree);
+      if (done)
+      {
+         break;
+      }
+   }
+   pthread_join(disp, NULL);
+
+   /*Stop workers:*/
+   isoLock();
+   for (i = 0; i < iso->nWorkers; ++i)
+   {
+      iso_qFLPushFifo(&l_sh->jobQ, ISO_STOP);
+   }
+   isoUnlock();
+   for (i = 0; i < iso->nWorkers; ++i)
+   {
+      sem_post(&l_sh->sJobs);
+   }
+   for (i = 0; i < iso->nWorkers; ++i)
+   {
+      if (0 != l_pids[i])
+      {
+         waitpid(l_pids[i], NULL, 0);
+      }
+   }
+
+   munmap(l_sh, size);
+   free(l_freeSlots);
+   free(l_pids);
+   return 0;
+}/*runIsolated*/
+
+#else /*_WIN32*/
+
+int runIsolated(isolate_t *iso)
+{
+   errorMsg("Isolated workers are not supported on Windows\n");
+   return -1;
+}/*runIsolated*/
+
+#endif
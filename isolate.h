@@ -0,0 +1,49 @@
+#ifndef ISOLATE_H
+#define ISOLATE_H 1
+
+/*
+  Crash-isolated workers: each worker is a separate process, so a file
+  crashing the encoder kills only its process. The parent keeps all the
+  state (counters, journal); a dead worker is respawned and only its
+  file in flight is reported as failed.
+
+  Jobs and results are passed through a shared memory region with two
+  cyclic queues of the "queue.h" type (the int instance with external
+  scratch, QFL_FAIL_IF_FULL) and a table of slots holding file names and
+  statuses. The queues are protected by a process-shared robust mutex and
+  counted by process-shared semaphores, so the dispatch costs one mutex
+  and two semaphore operations per file. A count lost by a worker dying
+  between a queue and its semaphore is recovered by the parent: it takes
+  all the queued results on each pass, and after a worker dies it posts
+  the jobs which are queued but not counted.
+
+  Not available on Windows.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+   /*Blocks until the next job. Returns the malloc'ed full name of the
+     file or NULL if there are no more jobs. Called in the parent:*/
+   char *(*nextJob)(void);
+   /*Encodes fileName, called in a worker process:*/
+   int (*encode)(int worker, char *fileName);
+   /*Called in the parent once per job:*/
+   void (*jobDone)(char *fileName, int status);
+   /*status of a job whose worker crashed:*/
+   int crashStatus;
+   int nWorkers;
+}isolate_t;
+
+/*Runs the workers until nextJob() returns NULL and all jobs are done.
+  Returns 0 on success:*/
+int runIsolated(isolate_t *iso);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
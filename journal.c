@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "tools.h"
+#include "journal.h"
+
+#define JOURNAL_INI_SIZE 1024
+
+static FILE *l_journal = NULL;
+static pthread_mutex_t l_mJournal = PTHREAD_MUTEX_INITIALIZER;
+
+/*Open addressing hash set of loaded names, the size is a power of 2:*/
+static char **l_done = NULL;
+static size_t l_doneSize = 0;
+static size_t l_nDone = 0;
+
+/*FNV-1a:*/
+static size_t hashName(char *name)
+{
+   size_t h = 2166136261u;
+   for (; '\0' != *name; ++name)
+   {
+      h ^= (unsigned char)*name;
+      h *= 16777619u;
+   }
+   return h;
+}/*hashName*/
+
+/*Returns the slot either containing name or empty one:*/
+static char **findSlot(char **set, size_t size, char *name)
+{
+   size_t i = hashName(name) & (size - 1);
+   while ( (NULL != set[i]) && (0 != strcmp(set[i], name)) )
+   {
+      i = (i + 1) & (size - 1);
+   }
+   return set + i;
+}/*findSlot*/
+
+static int addDone(char *name)
+{
+   char **slot;
+   if (2 * (l_nDone + 1) > l_doneSize)
+   {
+      size_t i, size = (0 == l_doneSize)? JOURNAL_INI_SIZE: 2 * l_doneSize;
+      char **set = calloc(size, sizeof(char*));
+      if (NULL == set)
+      {
+         return -1;
+      }
+      for (i = 0; i < l_doneSize; ++i)
+      {
+         if (NULL != l_done[i])
+         {
+            *findSlot(set, size, l_done[i]) = l_done[i];
+         }
+      }
+      free(l_done);
+      l_done = set;
+      l_doneSize = size;
+   }
+   slot = findSlot(l_done, l_doneSize, name);
+   if (NULL == *slot)
+   {
+      if (NULL == (*slot = malloc(strlen(name) + 1)))
+      {
+         return -1;
+      }
+      strcpy(*slot, name);
+      ++l_nDone;
+   }
+   return 0;
+}/*addDone*/
+
+/*Returns the number of loaded records or -1:*/
+static int loadJournal(char *fileName, int *isTorn)
+{
+   char line[MAX_PATH_LENGTH + 2];
+   FILE *f = fopen(fileName, "rb");
+   int n = 0;
+
+   *isTorn = 0;
+   if (NULL == f)
+   {
+      return 0;/*nothing to resume*/
+   }
+   while (NULL != fgets(line, sizeof(line), f))
+   {
+      size_t l = strlen(line);
+      if ( (0 == l) || ('\n' != line[l - 1]) )
+      {
+         /*Too long, or the last record was interrupted:*/
+         *isTorn = feof(f);
+         continue;
+      }
+      line[l - 1] = '\0';
+      if (0 != addDone(line))
+      {
+         fclose(f);
+         return -1;
+      }
+      ++n;
+   }
+   fclose(f);
+   return n;
+}/*loadJournal*/
+
+/*Returns !0 if the last record of the journal was interrupted:*/
+static int isTornJournal(char *fileName)
+{
+   int isTorn = 0;
+   FILE *f = fopen(fileName, "rb");
+   if (NULL == f)
+   {
+      return 0;/*a new one*/
+   }
+   if (0 == COM_FSEEK(f, -1, SEEK_END))
+   {
+      isTorn = ('\n' != fgetc(f));
+   }
+   fclose(f);
+   return isTorn;
+}/*isTornJournal*/
+
+int journalOpen(char *fileName, int resume)
+{
+   int isTorn = 0;
+   if (0 != resume)
+   {
+      int n = loadJournal(fileName, &isTorn);
+      if (n < 0)
+      {
+         return -1;
+      }
+      message("%d completed files loaded from the journal\n", n);
+   }
+   else
+   {
+      isTorn = isTornJournal(fileName);
+   }
+   /*Records of previous runs are kept even if they are not loaded now,
+     a later --resume needs them:*/
+   l_journal = fopen(fileName, "ab");
+   if (NULL == l_journal)
+   {
+      return -1;
+   }
+   if (0 != isTorn)
+   {
+      /*Terminate the interrupted record so it does not glue to the next one:*/
+      fputc('\n', l_journal);
+   }
+   return syncFile(l_journal);
+}/*journalOpen*/
+
+int journalIsOpen(void)
+{
+   return (NULL != l_journal);
+}/*journalIsOpen*/
+
+int journalIsDone(char *name)
+{
+   if (0 == l_nDone)
+   {
+      return 0;
+   }
+   return (NULL != *findSlot(l_done, l_doneSize, name));
+}/*journalIsDone*/
+
+int journalAppend(char *name)
+{
+   int ret = 0;
+   if (NULL != strchr(name, '\n'))
+   {
+      return -1;/*can't be recorded, will be just redone*/
+   }
+   pthread_mutex_lock(&l_mJournal);
+   /*The record must reach the file in one piece, an OS crash may lose
+     only the tail; the outputs of lost records will be just redone:*/
+   if ( (EOF == fputs(name, l_journal)) || (EOF == fputc('\n', l_journal)) ||
+        (0 != fflush(l_journal)) )
+   {
+      ret = -1;
+   }
+   pthread_mutex_unlock(&l_mJournal);
+   return ret;
+}/*journalAppend*/
+
+void journalClose(void)
+{
+   size_t i;
+   if (NULL != l_journal)
+   {
+      syncFile(l_journal);
+      fclose(l_journal);
+      l_journal = NULL;
+   }
+   for (i = 0; i < l_doneSize; ++i)
+   {
+      free(l_done[i]);
+   }
+   free(l_done);
+   l_done = NULL;
+   l_doneSize = l_nDone = 0;
+}/*journalClose*/
@@ -0,0 +1,40 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H 1
+
+/*
+  Append-only journal of completed files, used to resume an interrupted
+  run. Each record is a source file name terminated by '\n'; an
+  incomplete last record (interrupted write) is ignored.
+
+  A record must be appended only after the corresponding output is
+  durable (see syncFile() in tools.h), so a crash loses at most the
+  files which were in flight.
+
+  The set of loaded records is read-only after journalOpen(), so
+  journalIsDone() may be called from any thread without locking.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*Opens (creates) the journal for appending, records of previous runs are
+  never overwritten. If resume != 0, loads them. Returns 0 on success:*/
+int journalOpen(char *fileName, int resume);
+
+/*Returns !0 if the journal is open:*/
+int journalIsOpen(void);
+
+/*Returns !0 if the name was recorded by a previous run:*/
+int journalIsDone(char *name);
+
+/*Appends a record, thread safe. Returns 0 on success:*/
+int journalAppend(char *name);
+
+void journalClose(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -41,55 +41,287 @@
 #include <lame/lame.h>
 #endif
 #include <stdlib.h>
+#include <math.h>
 
 #include <semaphore.h>
 #include <pthread.h>
 
 #include "tools.h"
+#include "trace.h"
+#include "journal.h"
+#include "remote.h"
+#include "isolate.h"
+#include "stats.h"
+#include "arena.h"
+#include "qos.h"
+#include "deadline.h"
+#include "silence.h"
+#include "filetab.h"
+#include "metrics.h"
+#include "follow.h"
+#include "verify.h"
+#include "durable.h"
 
 /*
 uncomment this macro to protect existing .mp3 files:
 #define DO_NOT_OVERRIDE 1
 */
-/*samples to read:*/
+/*frames (pairs of samples) to read by default, see --block:*/
 #define PCM_SIZE  8192
-/*length of encoded buffer to write:*/
-#define MP3_SIZE  PCM_SIZE*2 
+/*length of encoded buffer for a block of frames, the worst case by the
+  LAME docs (1.25 * samples + 7200). A mono block has 2 samples per frame
+  in each "channel", see encodeBlock():*/
+#define MP3_SIZE(frames)  ( 2 * (frames) * 5 / 4 + 7200 )
+#define PCM_BYTES(frames) ( (frames) * 2 * sizeof(int16_t) )
+
+/*--block=FRAMES or --autotune-io:*/
+static int g_blockFrames = PCM_SIZE;
+/*MP3_SIZE(g_blockFrames):*/
+static int g_mp3Size = 0;
+/*--write-buffer=SIZE or --autotune-io, the stdio buffer of output files,
+  0 for the default one:*/
+static size_t g_writeBuffer = 0;
+/*--autotune-io: candidate sizes of reads and writes, bytes:*/
+static size_t g_autotuneSizes[] = {16 << 10, 64 << 10, 256 << 10, 1 << 20, 4 << 20};
+/*the size of the file written and read by the probe:*/
+#define AUTOTUNE_BYTES (32 << 20)
+/*--hugepages, see arena.h:*/
+static int g_hugePages = 0;
 
 /*will be determined in main()*/
 static int g_cpuNumber = 1;
 /*will be equal to number of CPU * 1.5 :*/
 static int g_nWorkers = 0;
 
-/*The file names queue:*/
-#define QFL_TYPE char*
-#define QFL_PREFIX txt_
+/*The file names queue, of indices in the file table (see filetab.h):*/
+#define QFL_TYPE uint32_t
+#define QFL_NULL FILETAB_NONE
+#define QFL_PREFIX idx_
 #include "queue.h"
 /*see detailed explanations in a file "queue.h"*/
 
+/*Queues of streams and blocks of the pipeline, see --pipeline:*/
+#define QFL_TYPE void*
+#define QFL_PREFIX ptr_
+#include "queue.h"
+
 typedef pthread_t pool_t ;
 
 pool_t *g_pool = NULL;
 
+/*Per-worker state, g_workers[i] belongs to g_pool[i]:*/
+typedef struct
+{
+   int id;
+   int conn;/*connection to the coordinator (see --connect) or -1*/
+   int64_t lastHeartbeat;
+   /*blocks from the arena, see allocWorkerBuffers():*/
+   int16_t *pcm;
+   unsigned char *mp3;
+   char *writeBuffer;/*NULL if g_writeBuffer is 0*/
+   verifyJob_t *verify;/*of the file just encoded, see --verify*/
+   char output[MAX_PATH_LENGTH];/*of the file just encoded*/
+}worker_t;
+
+static worker_t *g_workers = NULL;
+
+/*Coordinator/worker mode, see remote.h:*/
+static char *g_coordinator = NULL;/*--connect=ADDR, this is a worker process*/
+static char *g_listenAddress = NULL;/*--coordinator=ADDR*/
+static int g_leaseTimeout = 60;
+static int g_maxRetries = 3;
+
+/*--stats=FILE, see stats.h:*/
+static char *g_statsName = NULL;
+
+/*--metrics=FILE and --metrics-interval=SEC, see metrics.h:*/
+static char *g_metricsName = NULL;
+static int g_metricsInterval = 15;
+
+/*--isolate: workers are processes, see isolate.h:*/
+static int g_isolate = 0;
+
+/*--cpu-budget=F and --max-load=L, see qos.h. The target load of the host
+  in CPUs, 0 without QoS:*/
+static double g_qosTarget = 0.0;
+/*--idle-priority (implied by QoS): workers run as SCHED_IDLE with the
+  idle I/O class:*/
+static int g_idlePriority = 0;
+
 static unsigned g_totalConverted = 0;
 static pthread_mutex_t g_mTotalConverted = PTHREAD_MUTEX_INITIALIZER;
+/*files skipped as recorded in the journal, see --resume:*/
+static unsigned g_totalResumed = 0;
+
+/*Input directories ("roots"). Each root has its own queue of file
+  names filled by its own scanner thread. Workers share all roots by
+  the weighted fair queuing, see popFileName():*/
+typedef struct
+{
+   char pathname[MAX_PATH_LENGTH];/*with the trailing delimiter*/
+   int pathnameLength;
+   unsigned weight;
+   idx_qFL_t qFileName;
+   /*start tag of the next file, in "cost per unit of weight", see
+     FILE_COST():*/
+   double vtime;
+   /*see g_queueBudget:*/
+   size_t queueBytes;
+   size_t queueBudget;
+   pthread_cond_t cQueueSpace;
+   int found;
+   pthread_t scanner;
+   /*the first names of the queue hinted by the prefetcher:*/
+   int prefetched;
+   double prefetchedCost;
+   /*where .mp3 files go, see --out-dir:*/
+   char *outPath;/*with the trailing delimiter or NULL*/
+   int outDev;/*in g_outDevs*/
+   /*SERVER_LANE_* of a lane of the job server (the pathname is ""
+     then), -1 for a directory:*/
+   int lane;
+   /*non-empty roots of the highest priority are served first:*/
+   int priority;
+   /*--gapless: numbered names found by the scanner, one after another,
+     see queueTracks():*/
+   char *tracks;
+   size_t tracksBytes;
+   size_t maxTracksBytes;
+   int nTracks;
+}root_t;
 
-static txt_qFL_t  g_qFileName = QFL0;
+static root_t *g_roots = NULL;
+static int g_nRoots = 0;
+
+/*--server=ADDR: the job server, see remote.h. The lanes are roots from
+  g_firstLane on, with full names of files in their queues:*/
+static char *g_serverAddress = NULL;
+static int g_firstLane = 0;
+static pthread_t g_server;
+/*--submit=ADDR: the client of the server, --lane=LANE, --wait, --shutdown:*/
+static char *g_submitAddress = NULL;
+
+/*Files of server jobs by full names, to find the job when a file is done:*/
+typedef struct srvFile_struct
+{
+   struct srvFile_struct *next;
+   unsigned jobId;
+   char name[1];
+}srvFile_t;
+
+#define SRV_BUCKETS 4096
+static srvFile_t *g_srvFiles[SRV_BUCKETS];
+static pthread_mutex_t g_mSrvFiles = PTHREAD_MUTEX_INITIALIZER;
+
+/*--out-dir=DIR: .mp3 files mirror the roots under DIR instead of going
+  next to the sources. With several roots each one goes into the
+  subdirectory of its last name. Names which are not under a root (of a
+  worker process) are mirrored as a whole:*/
+static char *g_outDir = NULL;/*with the trailing delimiter*/
+/*--dev-writers=N: writes at once to each output device, 0 if unlimited.
+  Pipeline: the writers of each device (--writers by default):*/
+static int g_devWriters = 0;
+
+/*Output devices: the one of --out-dir of each root or of the root
+  itself. Each one has its own limit of writes and its own queue of
+  pipeline writers, so writes to one volume don't wait for another:*/
+typedef struct
+{
+   int64_t id;/*see deviceId()*/
+   sem_t sWriters;/*g_devWriters slots, not in the pipeline*/
+   ptr_qFL_t qWrite;/*streams ready for writers, see pipeTake()*/
+   pthread_cond_t cWrite;
+}outDev_t;
+
+static outDev_t *g_outDevs = NULL;
+static int g_nOutDevs = 0;
+/*sWriters are used:*/
+static int g_devSems = 0;
+
+/*All the queues are protected by g_mFileName, g_sFileName counts queued
+  names plus one final post when all scanners are finished:*/
 static pthread_mutex_t g_mFileName = PTHREAD_MUTEX_INITIALIZER;
 static sem_t g_sFileName;
+/*running scanners, protected by g_mFileName:*/
+static int g_nScanning = 0;
+/*virtual time of the fair queuing, the start tag of the last served file:*/
+static double g_vtime = 0.0;
+
+/*Memory budget of the file names queues, 0 if unbounded. It is shared
+  between roots proportionally to their weights. When the budget of a
+  root is exhausted its scanner waits on cQueueSpace until workers catch
+  up:*/
+static size_t g_queueBudget = 0;
+/*Memory occupied by a queued name of the length l: the name and the
+  entry in the file table and up to two slots of the (doubling) queue
+  buffer:*/
+#define QUEUE_ENTRY_COST(l) ( (l) + 1 + sizeof(fileEntry_t) + 2 * sizeof(uint32_t) )
+
+/*The cost of a file for the fair queuing, in MB: the size with a fixed
+  part for opening, the header and closing:*/
+#define FILE_COST_BYTES (64 << 10)
+#define FILE_COST(size) ( (float)( ((size) > 0? (size): 0) + FILE_COST_BYTES ) / (1 << 20) )
+
+/*--prefetch=N: the prefetcher thread keeps up to N queued files (in the
+  order workers will take them) being read into the page cache, see
+  prefetcher(). 0 if off:*/
+static int g_prefetch = 0;
+/*hinted names which are still queued, protected by g_mFileName:*/
+static int g_nPrefetched = 0;
+static pthread_cond_t g_cPrefetch = PTHREAD_COND_INITIALIZER;
+static pthread_t g_prefetcher;
+
+/*--trim-silence=dB cuts the leading and trailing silence, --max-gap=ms
+  shortens longer silent gaps to ms, see readTrimmed():*/
+static int g_trimEnds = 0;
+static int g_maxGapMs = -1;/*no limit*/
+static silence_t g_silence;
+/*ms of a window of silence detection:*/
+#define TRIM_WINDOW_MS 10
+#define TRIM_DEFAULT_DB -50.0
+
+/*--drop-cache: evict consumed input and written output from the page
+  cache while encoding, in chunks of DROP_CACHE_CHUNK bytes:*/
+static int g_dropCache = 0;
+#define DROP_CACHE_CHUNK (8 << 20)
+
+/*--follow: encode files which are still being written, waiting for
+  more data until the writer closes them or they are idle for
+  --follow-idle=SEC, see followFrames():*/
+static int g_follow = 0;
+static int g_followIdle = 60;
+
+/*--verify: decode every written .mp3 and check it against the source,
+  see verify.h. The files are verified by workers which have nothing to
+  encode (or when verifications pile up), their fileDone() waits until
+  then, see runVerifications():*/
+static int g_verify = 0;
+static double g_verifySnr = -1000.0;/*--verify-snr=dB, no limit*/
+static ptr_qFL_t g_qVerify;
+static pthread_mutex_t g_mVerify = PTHREAD_MUTEX_INITIALIZER;
+
+/*--durable: outputs are made durable in batches by the syncer thread
+  (see durable.h) before their files are done, --durable-window=MS:*/
+static int g_durable = 0;
+static int g_durableWindow = 100;
+/*--remove-source: a .wav is removed when its file is done (implies
+  --durable):*/
+static int g_removeSource = 0;
+
+/*--gapless: sequential tracks of a directory (see trackNumber()) are
+  queued as a group and encoded by one worker with one encoder, joined
+  by lame_encode_flush_nogap(), see encodeGroup():*/
+static int g_gapless = 0;
 
 /*auxiliary:*/
 static sem_t g_sAllThreadsReady;
 static pthread_mutex_t g_mEndScan = PTHREAD_MUTEX_INITIALIZER;
 
-static char g_pathname[MAX_PATH_LENGTH];
-static int g_pathnameLength = MAX_PATH_LENGTH -1;
-
 /*for a pcm file header:*/
 typedef struct
 {
-  char      RIFF[5];/*4+1 for trailing '\0'*/
-  int32_t   chunkSize;     
+  char      RIFF[5];/*4+1 for trailing '\0'; "RIFF", "RF64" or "riff" (Wave64)*/
+  int64_t   chunkSize;/*of RF64 from ds64, of Wave64 including the header*/
   char      WAVE[5];/*4+1 for trailing '\0'*/
   char      FMT[5];/*4+1 for trailing '\0'*/
   int32_t   subchunk1Size;
@@ -100,33 +332,201 @@ typedef struct
   int16_t   blockAlign;
   int16_t   bitsPerSample;
   char      subchunk2ID[5];/*4+1 for trailing '\0'*/
-  int32_t   subchunk2Size;
+  int64_t   subchunk2Size;/*of RF64 from ds64*/
+  int64_t   dataLeft;/*bytes of the data chunk not read yet, see readFrames()*/
+  int64_t   dataStart;/*offset of the data*/
+  follow_t  *follow;/*NULL unless the file is still being written, see --follow*/
 }wav_hdr_t;
 
-/*reading a WAV header*/
-int getPcmHeader(wav_hdr_t *hdr, FILE *f, int checkSrtucture)
+/*The encoder shared by the tracks of a group, see encodeGroup():*/
+typedef struct
+{
+   lame_t gf;/*NULL before the first track*/
+   int quality;
+   /*the track is opened by encodeGroup():*/
+   wav_hdr_t hdr;
+   FILE *pcm;
+   /*!0 unless the next track goes on with this encoder, so the track
+     ends with the full flush and the encoder is closed:*/
+   int last;
+}gapless_t;
+
+/*Wave64 ids are GUIDs, the first 4 bytes of them are the same chars as
+  of RIFF ones. These are the rest, of the "riff" one and of all others
+  ("wave", "fmt ", "data"):*/
+static const unsigned char g_w64Riff[12] =
+   {0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const unsigned char g_w64Guid[12] =
+   {0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+/*the size of RF64 chunks stored in ds64:*/
+#define RF64_SIZE 0xFFFFFFFFu
+
+/*Reads 4 chars of an id into id[5]. A Wave64 id must be followed by
+  the rest of the GUID, otherwise the id is "". Returns 0 on success:*/
+static int readId(FILE *f, char *id, const unsigned char *guid)
+{
+   unsigned char rest[12];
+   id[4] = '\0';
+   if (1 != fread(id, 4, 1, f))
+   {
+      return -1;
+   }
+   if (NULL != guid)
+   {
+      if (1 != fread(rest, 12, 1, f))
+      {
+         return -1;
+      }
+      if (0 != memcmp(rest, guid, 12))
+      {
+         id[0] = '\0';
+      }
+   }
+   return 0;
+}/*readId*/
+
+/*Reads a chunk header. The size is of the content: Wave64 sizes are
+  64 bit and include the header of 24 bytes. Returns 0 on success:*/
+static int readChunk(FILE *f, int w64, char *id, int64_t *size)
+{
+   if (0 != readId(f, id, w64? g_w64Guid: NULL))
+   {
+      return -1;
+   }
+   if (0 != w64)
+   {
+      uint64_t size64;
+      if ( (1 != fread(&size64, sizeof(size64), 1, f)) || (size64 < 24) )
+      {
+         return -1;
+      }
+      *size = (int64_t)size64 - 24;
+   }
+   else
+   {
+      uint32_t size32;
+      if (1 != fread(&size32, sizeof(size32), 1, f))
+      {
+         return -1;
+      }
+      *size = size32;
+   }
+   return 0;
+}/*readChunk*/
+
+/*reading a WAV header: RIFF, RF64 or Wave64. Classic RIFF must be the
+  canonical 44 bytes header, the others may have more chunks. Returns
+  the size of the file declared by the header (or <0 on error), the file
+  is positioned to the data:*/
+int64_t getPcmHeader(wav_hdr_t *hdr, FILE *f, int checkSrtucture)
 {
+   int w64, rf64;
+   uint64_t riff64 = 0, data64 = 0;
+   int64_t size, declared;
+
+   memset(hdr, 0, sizeof(*hdr));
    /*Avoid using #pragma's and packed structure so just read field by field:*/
-   fread(&(hdr->RIFF),1,4,f);hdr->RIFF[4] = '\0';
-   fread(&(hdr->chunkSize),sizeof(int32_t),1,f);
-   fread(&(hdr->WAVE),1,4,f);hdr->WAVE[4] = '\0';
-   fread(&(hdr->FMT),1,4,f);hdr->FMT[4]='\0';
-   fread(&(hdr->subchunk1Size),sizeof(int32_t),1,f);
-   fread(&(hdr->AudioFormat),sizeof(int16_t),1,f);
-   fread(&(hdr->NumChannels),sizeof(int16_t),1,f);
-   fread(&(hdr->sampleRate),sizeof(int32_t),1,f);
-   fread(&(hdr->byteRate),sizeof(int32_t),1,f);
-   fread(&(hdr->blockAlign),sizeof(int16_t),1,f);
-   fread(&(hdr->bitsPerSample),sizeof(int16_t),1,f);
-   fread(&(hdr->subchunk2ID),1,4,f);hdr->subchunk2ID[4] = '\0';
-   fread(&(hdr->subchunk2Size),sizeof(int32_t),1,f);
+   if (0 != readId(f, hdr->RIFF, NULL))
+   {
+      return -1;
+   }
+   w64 = (0 == strcmp(hdr->RIFF, "riff"));
+   rf64 = (0 == strcmp(hdr->RIFF, "RF64"));
+   if (0 != w64)
+   {
+      unsigned char rest[12];
+      uint64_t size64 = 0;
+      if ( (1 != fread(rest, 12, 1, f)) || (0 != memcmp(rest, g_w64Riff, 12)) ||
+           (1 != fread(&size64, sizeof(size64), 1, f)) )
+      {
+         return -1;
+      }
+      hdr->chunkSize = (int64_t)size64;
+      declared = hdr->chunkSize;
+   }
+   else
+   {
+      uint32_t size32 = 0;
+      fread(&size32, sizeof(size32), 1, f);
+      hdr->chunkSize = size32;
+      declared = hdr->chunkSize + 8;
+   }
+   if (0 != readId(f, hdr->WAVE, w64? g_w64Guid: NULL))
+   {
+      return -2;
+   }
+   if (0 != rf64)
+   {
+      /*ds64 must be the first one:*/
+      char id[5];
+      if ( (0 != readChunk(f, 0, id, &size)) || (0 != strcmp(id, "ds64")) ||
+           (size < 2 * (int64_t)sizeof(uint64_t)) ||
+           (1 != fread(&riff64, sizeof(riff64), 1, f)) ||
+           (1 != fread(&data64, sizeof(data64), 1, f)) ||
+           (0 != COM_FSEEK(f, size - 2 * sizeof(uint64_t) + (size & 1), SEEK_CUR)) )
+      {
+         return -9;
+      }
+      hdr->chunkSize = (int64_t)riff64;
+      declared = hdr->chunkSize + 8;
+   }
+
+   /*Look for "fmt " and "data", skip others:*/
+   for (;;)
+   {
+      char id[5];
+      /*chunks are aligned to 2 bytes, of Wave64 to 8:*/
+      int64_t pad;
+      if (0 != readChunk(f, w64, id, &size))
+      {
+         return -4;
+      }
+      pad = w64? (8 - size % 8) % 8: (size & 1);
+      if (0 == strcmp(id, "fmt "))
+      {
+         strcpy(hdr->FMT, id);
+         hdr->subchunk1Size = (int32_t)size;
+         if (size < 16)
+         {
+            return -5;
+         }
+         fread(&(hdr->AudioFormat),sizeof(int16_t),1,f);
+         fread(&(hdr->NumChannels),sizeof(int16_t),1,f);
+         fread(&(hdr->sampleRate),sizeof(int32_t),1,f);
+         fread(&(hdr->byteRate),sizeof(int32_t),1,f);
+         fread(&(hdr->blockAlign),sizeof(int16_t),1,f);
+         fread(&(hdr->bitsPerSample),sizeof(int16_t),1,f);
+         size -= 16;
+      }
+      else if (0 == strcmp(id, "data"))
+      {
+         strcpy(hdr->subchunk2ID, id);
+         hdr->dataStart = COM_FTELL(f);
+         hdr->subchunk2Size = ( (0 != rf64) && (RF64_SIZE == size) )? (int64_t)data64: size;
+         hdr->dataLeft = hdr->subchunk2Size;
+         break;
+      }
+      else if ('\0' == hdr->FMT[0])
+      {
+         /*Classic RIFF: "fmt " must go first:*/
+         if ( (0 == w64) && (0 == rf64) && (0 != checkSrtucture) )
+         {
+            return -3;
+         }
+      }
+      if (0 != COM_FSEEK(f, size + pad, SEEK_CUR))
+      {
+         return -4;
+      }
+   }
+
    if (0 != checkSrtucture)
    {
-      if (0 != strcmp(hdr->RIFF, "RIFF"))
+      if ( (0 == w64) && (0 == rf64) && (0 != strcmp(hdr->RIFF, "RIFF")) )
       {
          return -1;
       }
-      if (0 != strcmp(hdr->WAVE, "WAVE"))
+      if (0 != strcmp(hdr->WAVE, w64? "wave": "WAVE"))
       {
          return -2;
       }
@@ -134,11 +534,7 @@ int getPcmHeader(wav_hdr_t *hdr, FILE *f, int checkSrtucture)
       {
          return -3;
       }
-      if (0 != strcmp(hdr->subchunk2ID, "data"))
-      {
-         return -4;
-      }
-      if (16 != hdr->subchunk1Size)
+      if ( (0 == w64) && (0 == rf64) && (16 != hdr->subchunk1Size) )
       {
          return -5;
       }
@@ -150,321 +546,3528 @@ int getPcmHeader(wav_hdr_t *hdr, FILE *f, int checkSrtucture)
       {
          return -7;
       }
-      if (20 != hdr->chunkSize - hdr->subchunk1Size - hdr->subchunk2Size)
+      if ( (0 == w64) && (0 == rf64) &&
+           (20 != hdr->chunkSize - hdr->subchunk1Size - hdr->subchunk2Size) )
+      {
+         return -8;
+      }
+      /*the data must be in the file:*/
+      if (COM_FTELL(f) + hdr->subchunk2Size > declared)
       {
          return -8;
       }
    }/*if (0 != checkSrtucture)*/
-   return hdr->chunkSize;
+   return declared;
 }/*getPcmHeader*/
 
-void prnPcmHeader(wav_hdr_t *hdr)
+/*Prints the header into buf, returns the number of written chars:*/
+int sprnPcmHeader(char *buf, size_t size, wav_hdr_t *hdr)
 {
-   unblockedMessage("RIFF header     :%s\n", hdr->RIFF);
-   unblockedMessage("Chunk size      :%" PRId32 "\n", hdr->chunkSize);
-   unblockedMessage("WAVE header     :%s\n", hdr->WAVE);
-   unblockedMessage("FMT             :%s\n", hdr->FMT);
-   unblockedMessage("Subchunk1 size  :%" PRId32 "\n", hdr->subchunk1Size);
-   unblockedMessage("Audio format    :%" PRId16 "\n", hdr->AudioFormat);
-   unblockedMessage("Num of chans    :%" PRId16 "\n", hdr->NumChannels);
-   unblockedMessage("Samples per sec :%" PRId32 "\n", hdr->sampleRate);
-   unblockedMessage("Bytes per sec   :%" PRId32 "\n", hdr->byteRate);
-   unblockedMessage("Block align     :%" PRId16 "\n", hdr->blockAlign);
-   unblockedMessage("Bits per sample :%" PRId16 "\n", hdr->bitsPerSample);
-   unblockedMessage("Subchunk2 ID    :%s\n", hdr->subchunk2ID);
-   unblockedMessage("Subchunk2 size  :%" PRId32 "\n", hdr->subchunk2Size);
-}/*prnPcmHeader*/
+   int n = snprintf(buf, size,
+      "RIFF header     :%s\n"
+      "Chunk size      :%" PRId64 "\n"
+      "WAVE header     :%s\n"
+      "FMT             :%s\n"
+      "Subchunk1 size  :%" PRId32 "\n"
+      "Audio format    :%" PRId16 "\n"
+      "Num of chans    :%" PRId16 "\n"
+      "Samples per sec :%" PRId32 "\n"
+      "Bytes per sec   :%" PRId32 "\n"
+      "Block align     :%" PRId16 "\n"
+      "Bits per sample :%" PRId16 "\n"
+      "Subchunk2 ID    :%s\n"
+      "Subchunk2 size  :%" PRId64 "\n",
+      hdr->RIFF, hdr->chunkSize, hdr->WAVE, hdr->FMT, hdr->subchunk1Size,
+      hdr->AudioFormat, hdr->NumChannels, hdr->sampleRate, hdr->byteRate,
+      hdr->blockAlign, hdr->bitsPerSample, hdr->subchunk2ID, hdr->subchunk2Size);
+   return (n < 0)? 0: n;
+}/*sprnPcmHeader*/
 
-static char *readHeader (wav_hdr_t *hdr, FILE **pcm, char *fileName)
+/*Opens fullname and reads the header. If follow is not NULL (see
+  --follow) a header which does not match the size of the file is taken
+  as a recording in progress: the file is followed with *follow, and a
+  file shorter than its header is waited for. Returns 0 on success,
+  otherwise -1 and the file is closed:*/
+static int readHeader (wav_hdr_t *hdr, FILE **pcm, char *fullname, follow_t *follow)
 {
-   int l = g_pathnameLength + strlen(fileName) + 1;
-   /*TODO: malloc may fails*/
-   char *fullname = strcpy(malloc(l),g_pathname);
-   strcat(fullname, fileName);
-
-   free(fileName);
-
    *pcm = fopen(fullname, "rb");
-   /*TODO: error check*/
+   if (NULL == *pcm)
+   {
+      errorMsg("Can't open file '%s'\n", fullname);
+      return -1;
+   }
 
    {/*Read header:*/
-      int pcmFileSize = getFileSize(*pcm);
-      int chunkSize = getPcmHeader(hdr, *pcm, 1);
-      if ( (0 > chunkSize) || (8 != (pcmFileSize - chunkSize) ) )
-      {
-         blockMessage();
-         unblockedMessage("**** Ignore file '%s':\n", fullname);
-         unblockedMessage(" Unsupported adio format or broken data.\n\n");
-         prnPcmHeader (hdr);
-         unblockMessage();
+      int64_t pcmFileSize = getFileSize(*pcm);
+      int64_t declared = getPcmHeader(hdr, *pcm, 1);
+      /*-8 is the only error of sizes, the header ends beyond the file
+        on the others:*/
+      if ( (NULL != follow) && (declared < 0) && (-8 != declared) && feof(*pcm) )
+      {
+         int rc;
+         followInit(follow, fullname, pcmFileSize, g_followIdle * 1000);
+         while (FOLLOW_DONE != (rc = followWait(follow, *pcm)))
+         {
+            if (FOLLOW_GREW == rc)
+            {
+               /*clears EOF:*/
+               COM_FSEEK(*pcm, 0, SEEK_SET);
+               pcmFileSize = follow->size;
+               declared = getPcmHeader(hdr, *pcm, 1);
+               if ( (declared >= 0) || (-8 == declared) || !feof(*pcm) )
+               {
+                  break;
+               }
+            }
+         }
+         followClose(follow);
+      }
+      if ( (NULL != follow) && ( (-8 == declared) || ( (declared >= 0) && (pcmFileSize != declared) ) ) &&
+           (0 == COM_FSEEK(*pcm, hdr->dataStart, SEEK_SET)) )
+      {
+         followInit(follow, fullname, pcmFileSize, g_followIdle * 1000);
+         hdr->follow = follow;
+         /*unknown until the file is finished, see followFinish():*/
+         hdr->dataLeft = INT64_MAX;
+         logMsg(LOG_INFO, "File '%s' is being written, following it\n", fullname);
+         return 0;
+      }
+      if ( (0 > declared) || (pcmFileSize != declared) )
+      {
+         if (LOG_WARNING <= g_logLevel)
+         {
+            /*One record, so that it is not interleaved with others:*/
+            char report[MAX_PATH_LENGTH + 1024];
+            int n = snprintf(report, sizeof(report),
+                  "**** Ignore file '%s':\n"
+                  " Unsupported adio format or broken data.\n\n", fullname);
+            if ( (n < 0) || (n >= (int)sizeof(report)) )
+            {
+               n = 0;
+            }
+            sprnPcmHeader(report + n, sizeof(report) - n, hdr);
+            logMessage(LOG_WARNING, "%s", report);
+         }
          fclose (*pcm);
          *pcm = NULL;
-         free (fullname);
-         return NULL;
+         return -1;
       }
    }/*:Read header*/
-   return fullname;
+   return 0;
 }/*readHeader*/
 
-/*some cleanup:*/
-static void cln(int id, char *fileName, FILE *pcm, FILE *mp3, unsigned int *counter)
+/*Ends following the file when the writer has finalized the header (the
+  declared size is the size of the file) or, if force, at the last whole
+  frame on the disk. Returns !0 if the end of the data is known:*/
+static int followFinish(wav_hdr_t *hdr, FILE *f, int force)
 {
-   if (NULL != fileName)
+   follow_t *w = hdr->follow;
+   int64_t pos = COM_FTELL(f);
+   int64_t size = followSize(f);
+   int64_t declared = -1;
+   wav_hdr_t final;
+
+   if (0 == COM_FSEEK(f, 0, SEEK_SET))
    {
-     free(fileName);
+      declared = getPcmHeader(&final, f, 1);
    }
-   if (NULL != pcm)
+   if (0 != COM_FSEEK(f, pos, SEEK_SET))
    {
-      fclose(pcm);
+      size = pos;
+      force = 1;
+      declared = -1;
    }
-   if (NULL != mp3)
+   if ( (declared == size) && (final.dataStart == hdr->dataStart) &&
+        (final.NumChannels == hdr->NumChannels) )
    {
-      fclose(mp3);
+      w->end = final.dataStart + final.subchunk2Size;
    }
-   if (NULL != counter)
+   else if (0 != force)
    {
-      pthread_mutex_lock(&g_mTotalConverted);
-      /*atomic increment would be quite enough, BTW..,*/
-      ++(*counter);
-      pthread_mutex_unlock(&g_mTotalConverted);
+      w->end = hdr->dataStart + (size - hdr->dataStart) / PCM_BYTES(1) * PCM_BYTES(1);
    }
-}/*cln*/
+   else
+   {
+      return 0;
+   }
+   hdr->subchunk2Size = w->end - hdr->dataStart;
+   followClose(w);
+   logMsg(LOG_INFO, "File '%s' is finished%s\n", w->fileName,
+          (declared == size)? "": ", the header is not finalized");
+   return 1;
+}/*followFinish*/
 
-/* The main routine performing a real encoding*/
-static void theWorker(int id)
+/*readFrames() of a file being written: reads the frames which are on
+  the disk, at the end waits for more until the file is finished:*/
+static size_t followFrames(wav_hdr_t *hdr, int16_t *pcm, FILE *f)
 {
-
-   for(;;)/*mail loop*/
+   follow_t *w = hdr->follow;
+   for(;;)
    {
-      wav_hdr_t hdr;
-      char *fileName = NULL;
-      FILE *pcm = NULL, *mp3 = NULL;
-      lame_t gf = NULL;
-      size_t numRead = 0, numWrite = 0;
+      int64_t end = (w->end >= 0)? w->end: followSize(f);
+      int64_t avail = (end - COM_FTELL(f)) / (int64_t)PCM_BYTES(1);
+      size_t n = g_blockFrames;
+      int rc;
 
-      int16_t pcm_buffer[PCM_SIZE*2];
-      unsigned char mp3_buffer[MP3_SIZE];
-      int l;
-
-      /*First, wait for a file name to encode:*/
-      sem_wait(&g_sFileName);
-      /*There was something in the queue, try to catch it:*/
-      pthread_mutex_lock(&g_mFileName);
-      fileName = txt_qFLPop(&g_qFileName);
-      pthread_mutex_unlock(&g_mFileName);
-      if (NULL == fileName)
+      if (hdr->dataLeft / (int64_t)PCM_BYTES(1) < avail)
       {
-        /*Somebody was faster :( */
-        /*BTW, impossible in this incarnation! Just intrnal error...*/
-        continue;
+         avail = hdr->dataLeft / PCM_BYTES(1);
       }
-
-      /*We have got something*/
-      if ('\0' == *fileName)
+      if (avail < (int64_t)n)
       {
-         /*That's all*/
-         return;
+         n = (avail > 0)? (size_t)avail: 0;
+      }
+      if (n > 0)
+      {
+         clearerr(f);
+         n = fread(pcm, PCM_BYTES(1), n, f);
+         hdr->dataLeft -= n * PCM_BYTES(1);
+         return n;
+      }
+      if ( (w->end >= 0) || (hdr->dataLeft < (int64_t)PCM_BYTES(1)) )
+      {
+         return 0;
+      }
+      rc = followWait(w, f);
+      if (FOLLOW_GREW != rc)
+      {
+         followFinish(hdr, f, FOLLOW_DONE == rc);
       }
+   }
+}/*followFrames*/
+
+/*Reads up to g_blockFrames frames of the data chunk, nothing after it.
+  Returns the number of frames:*/
+static size_t readFrames(wav_hdr_t *hdr, int16_t *pcm, FILE *f)
+{
+   size_t n = g_blockFrames;
+   if (NULL != hdr->follow)
+   {
+      return followFrames(hdr, pcm, f);
+   }
+   if (hdr->dataLeft / (int64_t)PCM_BYTES(1) < (int64_t)n)
+   {
+      n = (size_t)(hdr->dataLeft / PCM_BYTES(1));
+   }
+   n = fread(pcm, PCM_BYTES(1), n, f);
+   hdr->dataLeft -= n * PCM_BYTES(1);
+   return n;
+}/*readFrames*/
+
+/*State of a file being trimmed, see readTrimmed():*/
+typedef struct
+{
+   int head;/*the leading silence is not passed yet*/
+   int64_t run;/*silent frames after the last sound which are not passed on*/
+   int64_t replay;/*frames of a kept gap to read again*/
+   int64_t skip;/*frames of the gap to skip after the replay*/
+   size_t window;/*frames*/
+   int64_t maxGap;/*frames, -1 if there is no limit*/
+}trim_t;
+
+static void trimInit(trim_t *t, wav_hdr_t *hdr)
+{
+   /*a mono frame is 2 samples, see encodeBlock():*/
+   double framesPerMs = (double)hdr->sampleRate * hdr->NumChannels / 2000.0;
+   memset(t, 0, sizeof(trim_t));
+   t->head = g_trimEnds;
+   t->window = (size_t)(framesPerMs * TRIM_WINDOW_MS);
+   if (0 == t->window)
+   {
+      t->window = 1;
+   }
+   t->maxGap = (g_maxGapMs < 0)? -1: (int64_t)(framesPerMs * g_maxGapMs);
+}/*trimInit*/
+
+/*Moves the position in the data chunk by frames. Returns 0 on success:*/
+static int seekFrames(wav_hdr_t *hdr, FILE *f, int64_t frames)
+{
+   int64_t bytes = frames * (int64_t)PCM_BYTES(1);
+   if (0 != COM_FSEEK(f, bytes, SEEK_CUR))
+   {
+      return -1;
+   }
+   hdr->dataLeft -= bytes;
+   return 0;
+}/*seekFrames*/
 
-      /*We have some file name to encode. Convert it to a full-path name,
-        open a file and read a header:*/
-      fileName = readHeader(&hdr, &pcm, fileName);
+/*readFrames() without silence to be cut: the leading and the trailing
+  silence if --trim-silence, gaps above --max-gap. Silent frames are not
+  kept in memory, a gap is read again when the sound after it shows that
+  (a part of) it must be passed on:*/
+static size_t readTrimmed(wav_hdr_t *hdr, int16_t *pcm, FILE *f, trim_t *t)
+{
+   if ( (0 == g_trimEnds) && (g_maxGapMs < 0) )
+   {
+      return readFrames(hdr, pcm, f);
+   }
+   for(;;)
+   {
+      size_t n, s, e;
+      int64_t gap, kept;
 
-      if(NULL == fileName)
+      if (t->replay > 0)
       {
-         /*wrong format, input file was closed*/
-         cln(id, NULL, NULL, NULL, NULL);
-         continue;
+         int64_t left = hdr->dataLeft;
+         if (hdr->dataLeft > t->replay * (int64_t)PCM_BYTES(1))
+         {
+            hdr->dataLeft = t->replay * PCM_BYTES(1);
+         }
+         n = readFrames(hdr, pcm, f);
+         hdr->dataLeft = left - n * PCM_BYTES(1);
+         t->replay = (0 == n)? 0: t->replay - n;
+         if ( (0 == t->replay) && (0 != t->skip) && (0 != seekFrames(hdr, f, t->skip)) )
+         {
+            hdr->dataLeft = 0;
+         }
+         t->skip = (0 == t->replay)? 0: t->skip;
+         return n;
       }
 
-      /*init lame with parameters compatible with ones read from the header:*/
-      gf = lame_init();
-      if ( NULL ==   gf )
+      if (0 == (n = readFrames(hdr, pcm, f)))
       {
-         errorMsg("File '%s': lame_init fails\n", fileName);
-         cln(id, fileName, pcm, NULL, NULL);
-         continue;
+         /*without --trim-silence the tail is a gap:*/
+         if ( (0 == g_trimEnds) && (t->run > 0) && (0 == seekFrames(hdr, f, -t->run)) )
+         {
+            t->replay = (t->run < t->maxGap)? t->run: t->maxGap;
+            t->skip = t->run - t->replay;
+            t->run = 0;
+            if (t->replay > 0)
+            {
+               continue;
+            }
+         }
+         return 0;
       }
-      lame_set_num_channels(gf, hdr.NumChannels);
-      lame_set_quality(gf, 3);
-      lame_set_in_samplerate(gf, hdr.sampleRate);
-      //lame_set_VBR(gf, vbr_default);/*sometimes segfaults*/
-      lame_set_VBR(gf, vbr_rh);
-      //lame_set_compression_ratio(gf, 5);
-
-      if ( -1 ==   lame_init_params(gf) )
+      if (n == (s = silenceFind(&g_silence, pcm, n, t->window, 0)))
       {
-         errorMsg("File '%s': lame_init fails\n", fileName);
-         cln(id, fileName, pcm, NULL, NULL);
+         if (0 == t->head)
+         {
+            t->run += n;
+         }
          continue;
       }
 
-      /*Now proceed the output file.*/
-      /*"...wav" -> ...mp3:*/
-      l = strlen(fileName);
-      fileName[--l] = '3';
-      fileName[--l] = 'p';
-      fileName[--l] = 'm';
-
-#ifdef DO_NOT_OVERRIDE
-      mp3 = fopen(fileName, "r");
-      if (NULL != mp3)
+      /*the sound begins at s:*/
+      gap = t->run + s;
+      kept = (0 != t->head)? 0: ( (t->maxGap < 0) || (gap <= t->maxGap) )? gap: t->maxGap;
+      t->head = 0;
+      t->run = 0;
+      if ( (kept == gap) && (gap == (int64_t)s) )
+      {
+         s = 0;/*the whole gap is in the block*/
+      }
+      else if (kept > 0)
       {
-         message("File '%s' exists, do nothing\n", fileName);
-         fclose(mp3);
-         mp3 = NULL;
-         cln(id, fileName, pcm, NULL, NULL);
+         /*back to the start of the gap:*/
+         if (0 != seekFrames(hdr, f, -(int64_t)n - (gap - (int64_t)s)))
+         {
+            return 0;
+         }
+         t->replay = kept;
+         t->skip = gap - kept;
          continue;
       }
-#endif
-      /*Can't create a file at the scan time:( :*/
-      pthread_mutex_lock(&g_mEndScan);      
-      mp3 = fopen(fileName, "wb");
-      pthread_mutex_unlock(&g_mEndScan);
 
-      /*Encode the file:*/
-      do 
+      /*pass the block up to a gap which must be cut:*/
+      for (e = s; ; )
       {
-         numRead = fread(pcm_buffer, 2*sizeof(int16_t), PCM_SIZE, pcm);
-         if (numRead == 0)
-         { 
-            numWrite = lame_encode_flush(gf, mp3_buffer, MP3_SIZE);
+         size_t r;
+         e += silenceFind(&g_silence, pcm + 2 * e, n - e, t->window, 1);
+         if (e == n)
+         {
+            break;
          }
-         else
+         r = e + silenceFind(&g_silence, pcm + 2 * e, n - e, t->window, 0);
+         if (r == n)
          {
-            if (1 == hdr.NumChannels)
-            {
-               numWrite = lame_encode_buffer(gf, pcm_buffer, pcm_buffer, numRead*2 , mp3_buffer, MP3_SIZE);
-            }
-            else
-            {
-               numWrite = lame_encode_buffer_interleaved(gf, pcm_buffer, numRead, mp3_buffer, MP3_SIZE);
-            }
-            if (numWrite < 0)
+            /*a gap or the tail, the next blocks will tell:*/
+            break;
+         }
+         if ( (t->maxGap >= 0) && ((int64_t)(r - e) > t->maxGap) )
+         {
+            /*keep the beginning of the gap, go on after it:*/
+            if (0 != seekFrames(hdr, f, -(int64_t)(n - r)))
             {
-               /*TODO: error!*/
+               return 0;
             }
+            n = e + (size_t)t->maxGap;
+            e = n;
+            break;
          }
-         fwrite(mp3_buffer, numWrite, 1, mp3);
+         e = r;
       }
-      while (numRead != 0);
-      /*ready*/
-
-      lame_close(gf);
-      gf = NULL;
-      cln (id, fileName, pcm, mp3, &g_totalConverted);/*here g_totalConverted was incremented*/
-      mp3 = pcm = NULL;
-
-      message("%u files processed\n", g_totalConverted);
-
-   }/*for(;;)*/
-}/*theWorker*/
+      if ( (e < n) && (0 != seekFrames(hdr, f, -(int64_t)(n - e))) )
+      {
+         return 0;
+      }
+      n = e - s;
+      if (0 != s)
+      {
+         memmove(pcm, pcm + 2 * s, n * PCM_BYTES(1));
+      }
+      return n;
+   }
+}/*readTrimmed*/
 
-static void *startWorker (void *ptr)
+/*some cleanup. Returns !0 if the output can't be closed (the rest of
+  it is not written):*/
+static int cln(FILE *pcm, FILE *mp3)
 {
-   int id;
+   if (NULL != pcm)
    {
-      pool_t *p = (pool_t*)ptr;
-      id = p - g_pool;/*This is the order number of my resources*/
+      fclose(pcm);
    }
-   message(" started worker %d\n", id);
-
-   /*finish setup:*/
-   sem_post(&g_sAllThreadsReady);/*indicator end of initialisation*/
-
-   /*do the job*/
-   theWorker(id);
+   return (NULL != mp3)? fclose(mp3): 0;
+}/*cln*/
 
-   return NULL;
-}/*startWorker*/
+static unsigned srvHash(char *name)
+{
+   unsigned h = 5381;
+   while ('\0' != *name)
+   {
+      h = h * 33 + (unsigned char)*name++;
+   }
+   return h % SRV_BUCKETS;
+}/*srvHash*/
 
-/*This callback is invoked on each of a scanned directory element*/
-static int doScanDirectory( int i, char *dirEntry, int isDirectory, void *data)
+/*Remembers the job of the file before it is queued:*/
+static int srvFileAdd(char *name, unsigned jobId)
 {
-   int *n = (int*)data;
-   if (!isDirectory)
+   unsigned h = srvHash(name);
+   srvFile_t *f = malloc(sizeof(srvFile_t) + strlen(name));
+   if (NULL == f)
    {
-      size_t l = strlen(dirEntry);
-      char *ch = dirEntry + (l - 4);
-      if (
-            ('.' == ch[0]) &&
-            ('W' == myToupper(ch[1])) &&
-            ('A' == myToupper(ch[2])) &&
-            ('V' == myToupper(ch[3]))
-         )
-      {
-         /*TODO: mutex lock/unlock and sem_post may fail:*/
-         pthread_mutex_lock(&g_mFileName);
-         /*TODO: malloc and txt_qFLPushFifo may fail!*/
-         txt_qFLPushFifo(&g_qFileName, strcpy(malloc(l+1),dirEntry));
-         sem_post(&g_sFileName);
-         pthread_mutex_unlock(&g_mFileName);
-         ++(*n);
-      }
+      return -1;
    }
+   strcpy(f->name, name);
+   f->jobId = jobId;
+   pthread_mutex_lock(&g_mSrvFiles);
+   f->next = g_srvFiles[h];
+   g_srvFiles[h] = f;
+   pthread_mutex_unlock(&g_mSrvFiles);
    return 0;
-}/*scanDirectory*/
+}/*srvFileAdd*/
 
-static int scanDirectory (char *pathName)
+/*Reports the file to its job, if it is of a job:*/
+static void srvFileDone(char *name, int status)
 {
-   int foundItems = 0;
-   int i;
-   int tot = listDir(pathName, doScanDirectory, (void*)&foundItems);
-   if (tot < 0)
+   srvFile_t **pp, *f = NULL;
+   pthread_mutex_lock(&g_mSrvFiles);
+   for (pp = g_srvFiles + srvHash(name); NULL != *pp; pp = &(*pp)->next)
+   {
+      if (0 == strcmp((*pp)->name, name))
+      {
+         f = *pp;
+         *pp = f->next;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&g_mSrvFiles);
+   if (NULL != f)
    {
-      return tot;
+      serverFileDone(f->jobId, status);
+      free(f);
    }
+}/*srvFileDone*/
 
-   /*send empty file name as end-of-work:*/
-   /*TODO: mutex lock/unlock and sem_post may fail:*/
+/*Files waiting in all the queues, called by the metrics exporter:*/
+static int queueDepth(void)
+{
+   int i, n = 0;
    pthread_mutex_lock(&g_mFileName);
-   for (i = 0; i < g_nWorkers; ++i)
+   for (i = 0; i < g_nRoots; ++i)
    {
-      txt_qFLPushFifo(&g_qFileName, "");
-      sem_post(&g_sFileName);
+      n += idx_qFLLength(&g_roots[i].qFileName);
    }
    pthread_mutex_unlock(&g_mFileName);
-   if (0 == foundItems)
-   {
-      message("No files found!\n");
-   }   
-   return foundItems;
-}/*scanDirectory*/
+   return n;
+}/*queueDepth*/
 
-int main(int argc, char *argv[])
+/*Counts a finished file, see --metrics:*/
+static void metricsFile(int status)
 {
-   int i;
+   metricsAdd( (REMOTE_OK == status)? METRIC_CONVERTED:
+               (REMOTE_IGNORED == status)? METRIC_IGNORED: METRIC_FAILED, 1);
+}/*metricsFile*/
 
-   if (2 != argc)
+/*Accounts a finished file. The output is already durable if the journal
+  is open or with --durable:*/
+static void fileDone(char *fileName, int status)
+{
+   metricsFile(status);
+   if (NULL != g_serverAddress)
+   {
+      srvFileDone(fileName, status);
+   }
+   if (REMOTE_OK != status)
+   {
+      return;
+   }
+   pthread_mutex_lock(&g_mTotalConverted);
+   /*atomic increment would be quite enough, BTW..,*/
+   ++g_totalConverted;
+   pthread_mutex_unlock(&g_mTotalConverted);
+   if ( journalIsOpen() && (0 != journalAppend(fileName)) )
+   {
+      errorMsg("File '%s': can't write the journal\n", fileName);
+   }
+   if ( (0 != g_removeSource) && (0 != remove(fileName)) )
+   {
+      errorMsg("Can't remove '%s'\n", fileName);
+   }
+   logMsg(LOG_INFO, "%u files processed\n", g_totalConverted);
+}/*fileDone*/
+
+/*The syncer callback, see --durable:*/
+static void fileSynced(char *fileName, char *output, int rc)
+{
+   if (0 != rc)
+   {
+      errorMsg("File '%s': can't sync\n", output);
+   }
+   fileDone(fileName, (0 == rc)? REMOTE_OK: REMOTE_FAILED);
+}/*fileSynced*/
+
+/*Accounts an encoded file, with --durable after its output is synced:*/
+static void fileEncoded(char *fileName, char *output, int status)
+{
+   if ( (0 != g_durable) && (REMOTE_OK == status) )
+   {
+      durableAdd(fileName, output);
+   }
+   else
+   {
+      fileDone(fileName, status);
+   }
+}/*fileEncoded*/
+
+/*The output is synced by the worker, not in a batch (see --durable):*/
+static int syncEachFile(void)
+{
+   return journalIsOpen() && (0 == g_durable);
+}/*syncEachFile*/
+
+/*Buffers are taken once from the arena, see arena.h:*/
+static void allocWorkerBuffers(worker_t *w)
+{
+   w->pcm = arenaAlloc(PCM_BYTES(g_blockFrames));
+   w->mp3 = arenaAlloc(g_mp3Size);
+   w->writeBuffer = (0 != g_writeBuffer)? arenaAlloc(g_writeBuffer): NULL;
+   if ( (NULL == w->pcm) || (NULL == w->mp3) ||
+        ( (0 != g_writeBuffer) && (NULL == w->writeBuffer) ) )
+   {
+      halt(15, "The buffer arena is exhausted\n");
+   }
+}/*allocWorkerBuffers*/
+
+/*Renews the lease of a remote worker right away, before and after a
+  step which may take long:*/
+static void heartbeatNow(worker_t *w)
+{
+   if (w->conn >= 0)
+   {
+      remoteHeartbeat(w->conn);
+      w->lastHeartbeat = getTimeUs();
+   }
+}/*heartbeatNow*/
+
+/*Called between blocks of the encode loop:*/
+static void heartbeat(worker_t *w)
+{
+   if ( (w->conn >= 0) &&
+        (getTimeUs() - w->lastHeartbeat > (int64_t)REMOTE_HEARTBEAT * 1000000) )
+   {
+      heartbeatNow(w);
+   }
+}/*heartbeat*/
+
+/*Called between blocks. A worker paused by QoS keeps its lease:*/
+static void workerTick(worker_t *w)
+{
+   heartbeat(w);
+   if (0 != g_qosOn)
+   {
+      while (0 != qosWait(w->id, REMOTE_HEARTBEAT * 1000 / 2))
+      {
+         heartbeat(w);
+      }
+   }
+}/*workerTick*/
+
+/*Called between chunks read by the verification of a remote worker:*/
+static void verifyTick(void *w)
+{
+   workerTick((worker_t*)w);
+}/*verifyTick*/
+
+/*Returns lame initialized according to the header or NULL:*/
+static lame_t initLame(wav_hdr_t *hdr, char *fileName, int quality)
+{
+   lame_t gf = lame_init();
+   if ( NULL ==   gf )
+   {
+      errorMsg("File '%s': lame_init fails\n", fileName);
+      return NULL;
+   }
+   lame_set_num_channels(gf, hdr->NumChannels);
+   lame_set_quality(gf, quality);
+   lame_set_in_samplerate(gf, hdr->sampleRate);
+   //lame_set_VBR(gf, vbr_default);/*sometimes segfaults*/
+   lame_set_VBR(gf, vbr_rh);
+   //lame_set_compression_ratio(gf, 5);
+
+   if ( -1 ==   lame_init_params(gf) )
+   {
+      errorMsg("File '%s': lame_init fails\n", fileName);
+      lame_close(gf);
+      return NULL;
+   }
+   return gf;
+}/*initLame*/
+
+/*Encodes numRead frames (read as pairs of samples) of pcm into mp3 of
+  g_mp3Size bytes. Returns the number of bytes or <0 on error:*/
+static int encodeBlock(lame_t gf, wav_hdr_t *hdr, int16_t *pcm, size_t numRead, unsigned char *mp3)
+{
+   if (1 == hdr->NumChannels)
+   {
+      return lame_encode_buffer(gf, pcm, pcm, numRead*2 , mp3, g_mp3Size);
+   }
+   return lame_encode_buffer_interleaved(gf, pcm, numRead, mp3, g_mp3Size);
+}/*encodeBlock*/
+
+/*The quality of the next file, see --deadline:*/
+static int fileQuality(void)
+{
+   return (0 != g_deadlineOn)? deadlineQuality(): DEADLINE_BEST_QUALITY;
+}/*fileQuality*/
+
+/*encodeBlock() measured for --deadline and --metrics:*/
+static int encodeTimed(lame_t gf, wav_hdr_t *hdr, int16_t *pcm, size_t numRead,
+                       unsigned char *mp3, int quality)
+{
+   int64_t started, us;
+   int n;
+   if ( (0 == g_deadlineOn) && (0 == g_metricsOn) )
+   {
+      return encodeBlock(gf, hdr, pcm, numRead, mp3);
+   }
+   started = getTimeUs();
+   n = encodeBlock(gf, hdr, pcm, numRead, mp3);
+   us = getTimeUs() - started;
+   if (0 != g_deadlineOn)
+   {
+      deadlineEncoded(quality, numRead * PCM_BYTES(1), us);
+   }
+   metricsAdd(METRIC_BYTES_IN, numRead * PCM_BYTES(1));
+   metricsAdd(METRIC_ENCODE_US, us);
+   return n;
+}/*encodeTimed*/
+
+/*A queued file is finished, its bytes which were not encoded are not
+  work any more, see --deadline:*/
+static void forgetFile(char *fileName, int64_t size, int64_t encoded)
+{
+   if (0 != g_deadlineOn)
+   {
+      if (size < 0)
+      {
+         size = getPathSize(fileName);
+      }
+      if (size > encoded)
+      {
+         deadlineForget(size - encoded);
+      }
+   }
+}/*forgetFile*/
+
+/*Page cache hygiene of one file being encoded, see --drop-cache:*/
+typedef struct
+{
+   int64_t readSince;/*input bytes consumed since the last drop*/
+   int64_t written;/*output bytes written*/
+   int64_t kicked;/*the writeback is started up to here*/
+   int64_t dropped;/*the output is dropped up to here*/
+}cacheDrop_t;
+
+/*Called after each block. The output is dropped one chunk behind the
+  writeback, so the worker waits only for pages which are most probably
+  written already:*/
+static void dropCacheStep(FILE *pcm, FILE *mp3, cacheDrop_t *cd, size_t numRead, int numWrite)
+{
+   cd->readSince += numRead * 2 * sizeof(int16_t);
+   if (cd->readSince >= DROP_CACHE_CHUNK)
+   {
+      dropFileCache(pcm, 0, COM_FTELL(pcm), 0);
+      cd->readSince = 0;
+   }
+   cd->written += numWrite;
+   if (cd->written - cd->kicked >= DROP_CACHE_CHUNK)
+   {
+      fflush(mp3);
+      if (cd->kicked > cd->dropped)
+      {
+         dropFileCache(mp3, cd->dropped, cd->kicked - cd->dropped, 1);
+         cd->dropped = cd->kicked;
+      }
+      startWriteback(mp3, cd->kicked, cd->written - cd->kicked);
+      cd->kicked = cd->written;
+   }
+}/*dropCacheStep*/
+
+/*Makes the .mp3 name of the .wav file, see --out-dir. mp3Name is of
+  MAX_PATH_LENGTH. Returns the output device or -1 on error:*/
+static int outputName(char *fileName, char *mp3Name)
+{
+   root_t *root = NULL;
+   char *prefix = "", *rest = fileName;
+   size_t l;
+   int i;
+
+   /*the longest root the file is under:*/
+   for (i = 0; i < g_nRoots; ++i)
+   {
+      root_t *r = g_roots + i;
+      if ( (r->lane < 0) && (0 == strncmp(fileName, r->pathname, r->pathnameLength)) &&
+           ( (NULL == root) || (r->pathnameLength > root->pathnameLength) ) )
+      {
+         root = r;
+      }
+   }
+   if (NULL != g_outDir)
+   {
+      if (NULL != root)
+      {
+         prefix = root->outPath;
+         rest = fileName + root->pathnameLength;
+      }
+      else
+      {
+         prefix = g_outDir;
+         /*"/dir/a.wav" -> "OUT/dir/a.mp3", "C:\dir\a.wav" -> "OUT\C\dir\a.mp3":*/
+         while (SYSTEM_DIR_DELIMITER == *rest)
+         {
+            ++rest;
+         }
+      }
+   }
+   l = strlen(prefix) + strlen(rest);
+   if ( (l < 4) || (l >= MAX_PATH_LENGTH) )
+   {
+      return -1;
+   }
+   strcpy(mp3Name, prefix);
+   strcat(mp3Name, rest);
+   memcpy(mp3Name + l - 3, "mp3", 3);
+   if ( (NULL != g_outDir) && (NULL == root) )
+   {
+      char *colon = strchr(mp3Name + strlen(prefix), ':');
+      if (NULL != colon)
+      {
+         memmove(colon, colon + 1, strlen(colon));
+      }
+      if (0 != makeDirs(mp3Name))
+      {
+         return -1;
+      }
+   }
+   return (NULL != root)? root->outDev: 0;
+}/*outputName*/
+
+/*Limit writes to the output device, see --dev-writers:*/
+static void devWriteBegin(int dev)
+{
+   if (0 != g_devSems)
+   {
+      sem_wait(&g_outDevs[dev].sWriters);
+   }
+}/*devWriteBegin*/
+
+static void devWriteEnd(int dev)
+{
+   if (0 != g_devSems)
+   {
+      sem_post(&g_outDevs[dev].sWriters);
+   }
+}/*devWriteEnd*/
+
+/*Patches the first frame of the output with the LAME tag (the delay and
+  the padding for gapless playback). Returns 0 on success:*/
+static int writeLameTag(lame_t gf, FILE *mp3, unsigned char *buf)
+{
+   size_t n;
+   if (0 == lame_get_bWriteVbrTag(gf))
+   {
+      return 0;
+   }
+   n = lame_get_lametag_frame(gf, buf, g_mp3Size);
+   if (n > (size_t)g_mp3Size)
+   {
+      return -1;
+   }
+   if ( (0 != n) &&
+        ( (0 != COM_FSEEK(mp3, 0, SEEK_SET)) || (1 != fwrite(buf, n, 1, mp3)) ||
+          (0 != COM_FSEEK(mp3, 0, SEEK_END)) ) )
+   {
+      return -1;
+   }
+   return 0;
+}/*writeLameTag*/
+
+/*The encoder of a group is kept for the next track unless it failed or
+  the group ends:*/
+static void releaseLame(lame_t gf, gapless_t *g, int failed)
+{
+   if (NULL == g)
+   {
+      lame_close(gf);
+   }
+   else if ( (0 != failed) || (0 != g->last) )
+   {
+      lame_close(gf);
+      g->gf = NULL;
+   }
+}/*releaseLame*/
+
+/* The main routine performing a real encoding. fileName is a full name
+  of the .wav file, see outputName() for the .mp3 one. g is NULL or the
+  encoder shared by a group of tracks, see --gapless.
+  If durable != 0, the output is synced before return.
+  Returns REMOTE_OK, REMOTE_IGNORED if the file is not a supported PCM,
+  or REMOTE_FAILED:*/
+static int encodeFile(worker_t *w, char *fileName, int durable, gapless_t *g)
+{
+   wav_hdr_t hdr;
+   FILE *pcm = NULL, *mp3 = NULL;
+   lame_t gf = NULL;
+   size_t numRead = 0;
+   int numWrite = 0;
+
+   int16_t *pcm_buffer = w->pcm;
+   unsigned char *mp3_buffer = w->mp3;
+   int dev, ret = REMOTE_OK;
+   char mp3Name[MAX_PATH_LENGTH];
+   int64_t t = traceStart();
+   int64_t started = getTimeUs();
+   cacheDrop_t cd = {0, 0, 0, 0};
+   int quality = fileQuality();
+   int64_t size = -1, encoded = 0;
+   trim_t trim;
+   follow_t follow;
+
+   /*Open a file and read a header:*/
+   if (NULL != g)
+   {
+      hdr = g->hdr;
+      pcm = g->pcm;
+      g->pcm = NULL;
+   }
+   else if (0 != readHeader(&hdr, &pcm, fileName, (0 != g_follow)? &follow: NULL))
+   {
+      /*wrong format, input file was closed*/
+      traceEnd("readHeader", t, NULL);
+      forgetFile(fileName, -1, 0);
+      return REMOTE_IGNORED;
+   }
+   traceEnd("readHeader", t, NULL);
+   trimInit(&trim, &hdr);
+   if (0 != g_deadlineOn)
+   {
+      /*as it was queued:*/
+      size = getPathSize(fileName);
+   }
+
+   /*init lame with parameters compatible with ones read from the header:*/
+   t = traceStart();
+   /*a track of the group goes on with the encoder of the same format, see
+     encodeGroup():*/
+   if ( (NULL != g) && (NULL != g->gf) )
+   {
+      gf = g->gf;
+      quality = g->quality;
+   }
+   else
+   {
+      gf = initLame(&hdr, fileName, quality);
+      if ( NULL ==   gf )
+      {
+         cln(pcm, NULL);
+         forgetFile(fileName, size, 0);
+         return REMOTE_FAILED;
+      }
+      if (NULL != g)
+      {
+         g->gf = gf;
+         g->quality = quality;
+      }
+   }
+   traceEnd("lame_init_params", t, NULL);
+
+   /*Now proceed the output file.*/
+   if ( 0 > (dev = outputName(fileName, mp3Name)) )
+   {
+      errorMsg("Can't make the output name of '%s'\n", fileName);
+      releaseLame(gf, g, 0);
+      cln(pcm, NULL);
+      forgetFile(fileName, size, 0);
+      return REMOTE_FAILED;
+   }
+
+#ifdef DO_NOT_OVERRIDE
+   mp3 = fopen(mp3Name, "r");
+   if (NULL != mp3)
+   {
+      message("File '%s' exists, do nothing\n", mp3Name);
+      fclose(mp3);
+      releaseLame(gf, g, 0);
+      cln(pcm, NULL);
+      forgetFile(fileName, size, 0);
+      return REMOTE_IGNORED;
+   }
+#endif
+   /*Can't create a file at the scan time:( :*/
+   pthread_mutex_lock(&g_mEndScan);      
+   mp3 = fopen(mp3Name, "wb");
+   pthread_mutex_unlock(&g_mEndScan);
+   if (NULL == mp3)
+   {
+      errorMsg("Can't create file '%s'\n", mp3Name);
+      releaseLame(gf, g, 0);
+      cln(pcm, NULL);
+      forgetFile(fileName, size, 0);
+      return REMOTE_FAILED;
+   }
+   if (NULL != w->writeBuffer)
+   {
+      setvbuf(mp3, w->writeBuffer, _IOFBF, g_writeBuffer);
+   }
+
+   /*Encode the file:*/
+   do 
+   {
+      t = traceStart();
+      numRead = readTrimmed(&hdr, pcm_buffer, pcm, &trim);
+      traceEnd("read", t, NULL);
+      t = traceStart();
+      if (numRead == 0)
+      { 
+         /*the next track goes on where this one ends:*/
+         numWrite = ( (NULL != g) && (0 == g->last) )?
+            lame_encode_flush_nogap(gf, mp3_buffer, g_mp3Size):
+            lame_encode_flush(gf, mp3_buffer, g_mp3Size);
+         traceEnd("flush", t, NULL);
+      }
+      else
+      {
+         numWrite = encodeTimed(gf, &hdr, pcm_buffer, numRead, mp3_buffer, quality);
+         encoded += numRead * PCM_BYTES(1);
+         traceEnd("encode", t, NULL);
+      }
+      if (numWrite < 0)
+      {
+         errorMsg("File '%s': encoding fails (%d)\n", fileName, numWrite);
+         ret = REMOTE_FAILED;
+         break;
+      }
+      t = traceStart();
+      devWriteBegin(dev);
+      if ( (numWrite > 0) && (1 != fwrite(mp3_buffer, numWrite, 1, mp3)) )
+      {
+         devWriteEnd(dev);
+         traceEnd("write", t, NULL);
+         errorMsg("File '%s': can't write\n", mp3Name);
+         ret = REMOTE_FAILED;
+         break;
+      }
+      devWriteEnd(dev);
+      metricsAdd(METRIC_BYTES_OUT, numWrite);
+      traceEnd("write", t, NULL);
+      if (0 != g_dropCache)
+      {
+         dropCacheStep(pcm, mp3, &cd, numRead, numWrite);
+      }
+      workerTick(w);
+   }
+   while (numRead != 0);
+   /*ready*/
+
+   t = traceStart();
+   if ( (NULL != g) && (REMOTE_OK == ret) )
+   {
+      int rc;
+      devWriteBegin(dev);
+      rc = writeLameTag(gf, mp3, mp3_buffer);
+      devWriteEnd(dev);
+      if (0 != rc)
+      {
+         errorMsg("File '%s': can't write the LAME tag\n", mp3Name);
+         ret = REMOTE_FAILED;
+      }
+      else if ( (0 == g->last) && (0 != lame_init_bitstream(gf)) )
+      {
+         /*the end of the track stays in the encoder:*/
+         errorMsg("File '%s': can't restart the encoder, the end is lost\n", mp3Name);
+         ret = REMOTE_FAILED;
+      }
+   }
+   if (NULL != gf)
+   {
+      releaseLame(gf, g, REMOTE_OK != ret);
+      gf = NULL;
+   }
+   if (NULL != hdr.follow)
+   {
+      followClose(hdr.follow);
+   }
+   devWriteBegin(dev);
+   /*a write failed before is not reported by the sync, which may have
+     nothing left to flush:*/
+   if ( (REMOTE_OK == ret) && (0 != ferror(mp3)) )
+   {
+      errorMsg("File '%s': can't write\n", mp3Name);
+      ret = REMOTE_FAILED;
+   }
+   if ( (REMOTE_OK == ret) && (0 != durable) )
+   {
+      heartbeatNow(w);
+      if (0 != syncFile(mp3))
+      {
+         errorMsg("File '%s': can't sync\n", mp3Name);
+         ret = REMOTE_FAILED;
+      }
+      heartbeatNow(w);
+   }
+   if ( (0 != fflush(mp3)) && (REMOTE_OK == ret) )
+   {
+      errorMsg("File '%s': can't write\n", mp3Name);
+      ret = REMOTE_FAILED;
+   }
+   devWriteEnd(dev);
+   if (0 != g_dropCache)
+   {
+      dropFileCache(mp3, cd.dropped, 0, 1);
+      dropFileCache(pcm, 0, 0, 0);
+   }
+   /*never reported done (synced, journaled, its source removed):*/
+   if ( (0 != cln(pcm, mp3)) && (REMOTE_OK == ret) )
+   {
+      errorMsg("File '%s': can't close\n", mp3Name);
+      ret = REMOTE_FAILED;
+   }
+   traceEnd("close", t, NULL);
+   forgetFile(fileName, size, encoded);
+   if (REMOTE_OK == ret)
+   {
+      statsFile(getTimeUs() - started, hdr.subchunk2Size);
+      metricsLatency(getTimeUs() - started);
+      strcpy(w->output, mp3Name);
+      if (0 != g_verify)
+      {
+         if ( NULL == (w->verify = verifyNewJob(fileName, mp3Name)) )
+         {
+            halt(15, "malloc fails\n");
+         }
+         w->verify->dataStart = hdr.dataStart;
+         w->verify->frames = encoded / PCM_BYTES(1);
+         w->verify->channels = hdr.NumChannels;
+         /*trimmed output can't be compared sample by sample:*/
+         w->verify->compare = (0 == g_trimEnds) && (g_maxGapMs < 0);
+         w->verify->status = ret;
+      }
+   }
+   return ret;
+}/*encodeFile*/
+
+/*Decodes the output of a job, see --verify. Returns the status of the
+  file:*/
+static int verifyOutput(verifyJob_t *job)
+{
+   verifyResult_t r;
+   int64_t t = traceStart();
+   int rc = verifyFile(job, g_verifySnr, &r);
+
+   traceEnd("verify", t, job->output);
+   if (0 != rc)
+   {
+      errorMsg("File '%s': verification fails, %s\n", job->output, r.problem);
+      return REMOTE_FAILED;
+   }
+   if (0 != r.exact)
+   {
+      logMsg(LOG_INFO, "File '%s' verified: bit-exact\n", job->output);
+   }
+   else if (0 != job->compare)
+   {
+      logMsg(LOG_INFO, "File '%s' verified: SNR %.1f dB, delay %d\n", job->output, r.snr, r.lag);
+   }
+   else
+   {
+      logMsg(LOG_INFO, "File '%s' verified: %" PRId64 " samples\n", job->output, r.decoded);
+   }
+   return job->status;
+}/*verifyOutput*/
+
+/*Verifies the queued outputs while nothing is waiting to be encoded or
+  while there are at least as many as workers (so they can't pile up),
+  all of them if all. Files are done after the verification:*/
+static void runVerifications(int all)
+{
+   for(;;)
+   {
+      verifyJob_t *job = NULL;
+      int idle = (0 != all) || (0 == queueDepth());
+
+      pthread_mutex_lock(&g_mVerify);
+      if ( !ptr_qFLIsEmpty(&g_qVerify) &&
+           ( (0 != idle) || (ptr_qFLLength(&g_qVerify) >= g_nWorkers) ) )
+      {
+         job = ptr_qFLPop(&g_qVerify);
+      }
+      pthread_mutex_unlock(&g_mVerify);
+      if (NULL == job)
+      {
+         return;
+      }
+      metricsBusy(1);
+      fileEncoded(job->source, job->output, verifyOutput(job));
+      metricsBusy(0);
+      verifyFreeJob(job);
+   }
+}/*runVerifications*/
+
+/*Weighted fair queuing (start-time fair queuing with the cost of a file
+  by its size, see FILE_COST()): serves the non-empty root with the least
+  start tag. A root which was idle can't accumulate a credit: when it gets
+  new names its tag is moved to the current virtual time, see
+  pushFileName(). Must be called with g_mFileName locked. Returns the
+  index in the file table or FILETAB_NONE if all the queues are empty:*/
+static uint32_t popFileName(root_t **root)
+{
+   root_t *best = NULL;
+   uint32_t file;
+   fileEntry_t *e;
+   int i;
+
+   for (i = 0; i < g_nRoots; ++i)
+   {
+      root_t *r = g_roots + i;
+      if ( !idx_qFLIsEmpty(&r->qFileName) &&
+           ( (NULL == best) || (r->priority > best->priority) ||
+             ( (r->priority == best->priority) && (r->vtime < best->vtime) ) ) )
+      {
+         best = r;
+      }
+   }
+   if (NULL == best)
+   {
+      return FILETAB_NONE;
+   }
+   file = idx_qFLPop(&best->qFileName);
+   e = fileTabEntry(file);
+   g_vtime = best->vtime;
+   best->vtime += e->cost / best->weight;
+   if (best->prefetched > 0)
+   {
+      --best->prefetched;
+      best->prefetchedCost -= e->cost;
+      --g_nPrefetched;
+   }
+   if (0 != g_prefetch)
+   {
+      pthread_cond_signal(&g_cPrefetch);
+   }
+   if (0 != g_queueBudget)
+   {
+      uint32_t f;
+      /*all the names of a group, see queueGroup():*/
+      for (f = file; FILETAB_NONE != f; f = fileTabEntry(f)->next)
+      {
+         best->queueBytes -= QUEUE_ENTRY_COST(strlen(fileTabName(f)));
+      }
+      pthread_cond_signal(&best->cQueueSpace);
+   }
+   *root = best;
+   return file;
+}/*popFileName*/
+
+/*Must be called with g_mFileName locked:*/
+static void pushFileName(root_t *root, uint32_t file)
+{
+   if ( idx_qFLIsEmpty(&root->qFileName) && (root->vtime < g_vtime) )
+   {
+      root->vtime = g_vtime;
+   }
+   /*TODO: idx_qFLPushFifo may fail!*/
+   idx_qFLPushFifo(&root->qFileName, file);
+   if (0 != g_prefetch)
+   {
+      pthread_cond_signal(&g_cPrefetch);
+   }
+}/*pushFileName*/
+
+/*The root whose next not hinted name will be served first, by the same
+  virtual time as popFileName() uses. Must be called with g_mFileName
+  locked. Returns NULL if the window is full or nothing is left:*/
+static root_t *nextToPrefetch(void)
+{
+   root_t *best = NULL;
+   double bestTag = 0.0;
+   int i;
+
+   if (g_nPrefetched >= g_prefetch)
+   {
+      return NULL;
+   }
+   for (i = 0; i < g_nRoots; ++i)
+   {
+      root_t *r = g_roots + i;
+      if (idx_qFLLength(&r->qFileName) > r->prefetched)
+      {
+         double tag = r->vtime + r->prefetchedCost / r->weight;
+         if ( (NULL == best) || (tag < bestTag) )
+         {
+            best = r;
+            bestTag = tag;
+         }
+      }
+   }
+   return best;
+}/*nextToPrefetch*/
+
+/*Reads ahead the files which workers will take next, see --prefetch.
+  Finishes when all scanners are finished and all names are hinted:*/
+static void *prefetcher(void *unused)
+{
+   char fullname[MAX_PATH_LENGTH];
+
+   pthread_mutex_lock(&g_mFileName);
+   for(;;)
+   {
+      root_t *root = nextToPrefetch();
+      uint32_t file;
+      char *fileName;
+
+      if (NULL == root)
+      {
+         if ( (0 == g_nScanning) && (g_nPrefetched < g_prefetch) )
+         {
+            break;
+         }
+         pthread_cond_wait(&g_cPrefetch, &g_mFileName);
+         continue;
+      }
+      /*The name is released by a worker after the pop, copy it now:*/
+      file = idx_qFLPeek(&root->qFileName, root->prefetched);
+      fileName = fileTabName(file);
+      ++root->prefetched;
+      root->prefetchedCost += fileTabEntry(file)->cost;
+      ++g_nPrefetched;
+      if (root->pathnameLength + strlen(fileName) >= MAX_PATH_LENGTH)
+      {
+         continue;
+      }
+      strcpy(fullname, root->pathname);
+      strcpy(fullname + root->pathnameLength, fileName);
+      pthread_mutex_unlock(&g_mFileName);
+      if (0 != prefetchFile(fullname))
+      {
+         logMsg(LOG_DEBUG, "File '%s': can't prefetch\n", fullname);
+      }
+      pthread_mutex_lock(&g_mFileName);
+   }
+   pthread_mutex_unlock(&g_mFileName);
+   return NULL;
+}/*prefetcher*/
+
+/*Composes the full name of the taken file into fullname of
+  MAX_PATH_LENGTH and releases the entry. Returns 0 on success:*/
+static int fullFileName(root_t *root, uint32_t file, char *fullname)
+{
+   char *fileName = fileTabName(file);
+   int ret = -1;
+   if (root->pathnameLength + strlen(fileName) >= MAX_PATH_LENGTH)
+   {
+      errorMsg("Too long path name '%s%s'\n", root->pathname, fileName);
+      forgetFile(fileName, fileTabEntry(file)->size, 0);
+   }
+   else
+   {
+      strcpy(fullname, root->pathname);
+      strcpy(fullname + root->pathnameLength, fileName);
+      ret = 0;
+   }
+   fileTabRelease(file);
+   return ret;
+}/*fullFileName*/
+
+/*The rest of a group taken by nextFile(), see --gapless:*/
+typedef struct
+{
+   root_t *root;
+   uint32_t next;/*FILETAB_NONE if it was the last*/
+}group_t;
+
+/*Composes the full name of the next track of the group. Returns -1
+  after the last one:*/
+static int nextTrack(group_t *group, char *fullname)
+{
+   while (FILETAB_NONE != group->next)
+   {
+      uint32_t file = group->next;
+      group->next = fileTabEntry(file)->next;
+      if (0 == fullFileName(group->root, file, fullname))
+      {
+         return 0;
+      }
+   }
+   return -1;
+}/*nextTrack*/
+
+/*Waits for the next file in the local queues and composes its full name
+  into fullname of MAX_PATH_LENGTH. If group is not NULL, it gets the
+  rest of the group of the file. Returns -1 if that's all:*/
+static int nextFile(char *fullname, group_t *group)
+{
+   for(;;)
+   {
+      root_t *root = NULL;
+      uint32_t file;
+
+      /*First, wait for a file name to encode:*/
+      sem_wait(&g_sFileName);
+      /*There was something in the queue, try to catch it:*/
+      pthread_mutex_lock(&g_mFileName);
+      file = popFileName(&root);
+      if ( (FILETAB_NONE == file) && (0 == g_nScanning) )
+      {
+         /*That's all, wake up the next one:*/
+         pthread_mutex_unlock(&g_mFileName);
+         sem_post(&g_sFileName);
+         return -1;
+      }
+      pthread_mutex_unlock(&g_mFileName);
+      if (FILETAB_NONE != file)
+      {
+         /*taken before fullFileName() releases the entry:*/
+         group_t rest = {root, fileTabEntry(file)->next};
+         /*Somebody was faster :( BTW, impossible in this incarnation!
+           If the name is wrong, the next track of the group is the first:*/
+         if ( (0 == fullFileName(root, file, fullname)) ||
+              (0 == nextTrack(&rest, fullname)) )
+         {
+            if (NULL != group)
+            {
+               *group = rest;
+            }
+            return 0;
+         }
+      }
+   }
+}/*nextFile*/
+
+/*Reads the header of a track, one of a wrong format is done as ignored:*/
+static int readTrack(char *name, wav_hdr_t *hdr, FILE **pcm)
+{
+   int64_t t = traceStart();
+   int rc = readHeader(hdr, pcm, name, NULL);
+
+   traceEnd("readHeader", t, NULL);
+   if (0 != rc)
+   {
+      forgetFile(name, -1, 0);
+      fileDone(name, REMOTE_IGNORED);
+   }
+   return rc;
+}/*readTrack*/
+
+/*The next track of the group with a right format. Returns -1 after the
+  last one:*/
+static int openTrack(group_t *group, char *name, wav_hdr_t *hdr, FILE **pcm)
+{
+   while (0 == nextTrack(group, name))
+   {
+      if (0 == readTrack(name, hdr, pcm))
+      {
+         return 0;
+      }
+   }
+   return -1;
+}/*openTrack*/
+
+/*Encodes the tracks of a group, starting with fullname, see --gapless.
+  The header of the next track is read before a track ends: the track
+  ends with lame_encode_flush_nogap() only if the next one goes on with
+  the same encoder (the rest of its samples is encoded there), otherwise
+  with the full flush, and the next one gets a new encoder:*/
+static void encodeGroup(worker_t *w, char *fullname, group_t *group)
+{
+   char next[MAX_PATH_LENGTH];
+   wav_hdr_t hdr;
+   FILE *pcm = NULL;
+   gapless_t g;
+   int more;
+
+   memset(&g, 0, sizeof(g));
+   if ( (0 != readTrack(fullname, &g.hdr, &g.pcm)) &&
+        (0 != openTrack(group, fullname, &g.hdr, &g.pcm)) )
+   {
+      return;
+   }
+   do
+   {
+      int64_t t;
+      int rc;
+      more = (0 == openTrack(group, next, &hdr, &pcm));
+      g.last = !more || (hdr.NumChannels != g.hdr.NumChannels) ||
+               (hdr.sampleRate != g.hdr.sampleRate);
+      t = traceStart();
+      rc = encodeFile(w, fullname, syncEachFile(), &g);
+      traceEnd("file", t, fullname);
+      fileEncoded(fullname, w->output, rc);
+      strcpy(fullname, next);
+      g.hdr = hdr;
+      g.pcm = pcm;
+   }
+   while (0 != more);
+   if (NULL != g.gf)
+   {
+      lame_close(g.gf);
+   }
+}/*encodeGroup*/
+
+/*Takes files from the local queues:*/
+static void theWorker(worker_t *w)
+{
+   for(;;)/*mail loop*/
+   {
+      char fullname[MAX_PATH_LENGTH];
+      group_t group;
+      int64_t t;
+      int rc;
+
+      if (0 != g_verify)
+      {
+         runVerifications(0);
+      }
+      t = traceStart();
+      if (0 != nextFile(fullname, &group))
+      {
+         if (0 != g_verify)
+         {
+            runVerifications(1);
+         }
+         return;
+      }
+      traceEnd("queue wait", t, NULL);
+
+      if (FILETAB_NONE != group.next)
+      {
+         metricsBusy(1);
+         encodeGroup(w, fullname, &group);
+         metricsBusy(0);
+         continue;
+      }
+      t = traceStart();
+      metricsBusy(1);
+      rc = encodeFile(w, fullname, syncEachFile(), NULL);
+      metricsBusy(0);
+      traceEnd("file", t, fullname);
+      if (NULL != w->verify)
+      {
+         pthread_mutex_lock(&g_mVerify);
+         ptr_qFLPushFifo(&g_qVerify, w->verify);
+         pthread_mutex_unlock(&g_mVerify);
+         w->verify = NULL;
+      }
+      else
+      {
+         fileEncoded(fullname, w->output, rc);
+      }
+   }/*for(;;)*/
+}/*theWorker*/
+
+/*Takes files from the coordinator, see --connect:*/
+static void theRemoteWorker(worker_t *w)
+{
+   char fileName[MAX_PATH_LENGTH];
+   unsigned jobId;
+   int sync, rc;
+
+   w->conn = remoteConnect(g_coordinator);
+   if (w->conn < 0)
+   {
+      errorMsg("Worker %d: can't connect to '%s'\n", w->id, g_coordinator);
+      return;
+   }
+   for(;;)
+   {
+      int64_t t = traceStart();
+      rc = remoteGetJob(w->conn, fileName, &jobId, &sync);
+      traceEnd("queue wait", t, NULL);
+      if (rc <= 0)
+      {
+         break;
+      }
+      w->lastHeartbeat = getTimeUs();
+      t = traceStart();
+      metricsBusy(1);
+      rc = encodeFile(w, fileName, sync, NULL);
+      if (NULL != w->verify)
+      {
+         /*before the coordinator journals it, the lease is kept:*/
+         w->verify->tick = verifyTick;
+         w->verify->tickArg = w;
+         rc = verifyOutput(w->verify);
+         verifyFreeJob(w->verify);
+         w->verify = NULL;
+      }
+      metricsBusy(0);
+      metricsFile(rc);
+      traceEnd("file", t, fileName);
+      if (REMOTE_OK == rc)
+      {
+         logMsg(LOG_INFO, "File '%s' converted\n", fileName);
+      }
+      if (0 != remoteJobDone(w->conn, jobId, rc))
+      {
+         rc = -1;
+         break;
+      }
+   }
+   if (rc < 0)
+   {
+      errorMsg("Worker %d: lost connection to the coordinator\n", w->id);
+   }
+   remoteClose(w->conn);
+   w->conn = -1;
+}/*theRemoteWorker*/
+
+/*A malloc'ed copy of the name or NULL:*/
+static char *copyName(char *fullname)
+{
+   char *copy = malloc(strlen(fullname) + 1);
+   if (NULL == copy)
+   {
+      halt(15, "malloc fails\n");
+   }
+   return strcpy(copy, fullname);
+}/*copyName*/
+
+/*Like nextFile(), but returns the malloc'ed full name of the next file
+  or NULL if that's all. See isolate.h:*/
+static char *nextFullName(void)
+{
+   char fullname[MAX_PATH_LENGTH];
+   return (0 != nextFile(fullname, NULL))? NULL: copyName(fullname);
+}/*nextFullName*/
+
+/*Pipeline mode (--pipeline), the "multi-buffer" design described in
+  Readme. The header provider opens files and probes their headers,
+  readers read PCM blocks, encoders (the workers) encode them and writers
+  write MP3 blocks. Blocks are taken from two recycled pools, so the
+  memory is bounded by the pools. A file in work is a stream with its own
+  queues of read and of encoded blocks. Each stage has a queue of streams
+  ready for it and serves a stream by one thread at a time, so blocks of
+  a file are processed in order. While a reader waits for the storage,
+  other streams are encoded and written. Everything is protected by
+  g_mPipe.*/
+
+#define PIPE_READ 0
+#define PIPE_ENCODE 1
+#define PIPE_WRITE 2
+#define PIPE_STAGES 3
+
+/*stream_t.stage[]:*/
+#define PIPE_IDLE 0
+#define PIPE_QUEUED 1
+#define PIPE_BUSY 2
+
+/*read blocks of a stream waiting for an encoder:*/
+#define PIPE_DEPTH 4
+/*blocks in each pool:*/
+#define PIPE_BLOCKS (g_nWorkers * PIPE_DEPTH)
+/*streams in work per encoder:*/
+#define PIPE_STREAMS_PER_ENCODER 2
+
+typedef struct
+{
+   size_t n;/*frames, 0 at the end of the file*/
+   int16_t *pcm;/*g_blockFrames frames from the arena*/
+}pcmBlock_t;
+
+typedef struct
+{
+   int n;/*bytes*/
+   int last;/*the flushed tail of the file*/
+   unsigned char *mp3;/*g_mp3Size bytes from the arena*/
+}mp3Block_t;
+
+typedef struct
+{
+   char fileName[MAX_PATH_LENGTH];/*.wav*/
+   char mp3Name[MAX_PATH_LENGTH];
+   int dev;/*output device, see outputName()*/
+   wav_hdr_t hdr;
+   FILE *pcm, *mp3;
+   lame_t gf;
+   trim_t trim;
+   int quality;
+   int64_t size;/*of the .wav as queued, see --deadline*/
+   int64_t encoded;/*PCM bytes*/
+   int status;/*REMOTE_OK or REMOTE_FAILED*/
+   int64_t started;/*us, see --stats*/
+   int eof;/*the last block is read*/
+   int nPcm;/*read blocks which are not encoded yet*/
+   int stage[PIPE_STAGES];
+   ptr_qFL_t pcmBlocks;
+   ptr_qFL_t mp3Blocks;
+}stream_t;
+
+static int g_pipeline = 0;
+static int g_nReaders = 2;/*--readers=N*/
+static int g_nWriters = 1;/*--writers=N*/
+/*writers of each output device, see --dev-writers:*/
+static int g_nDevWriters = 0;
+
+static pthread_mutex_t g_mPipe = PTHREAD_MUTEX_INITIALIZER;
+static ptr_qFL_t g_qStage[PIPE_STAGES];
+static pthread_cond_t g_cStage[PIPE_STAGES];
+static ptr_qFL_t g_qPcmFree, g_qMp3Free;
+static pthread_cond_t g_cPcmFree = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_cMp3Free = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_cStreams = PTHREAD_COND_INITIALIZER;
+static int g_nStreams = 0;
+static int g_maxStreams = 0;
+static int g_headersDone = 0;
+/*header provider, readers and writers:*/
+static pthread_t *g_pipeThreads = NULL;
+
+static int pipeReady(stream_t *s, int stage)
+{
+   switch (stage)
+   {
+      case PIPE_READ:
+         return (0 == s->eof) && (s->nPcm < PIPE_DEPTH);
+      case PIPE_ENCODE:
+         return !ptr_qFLIsEmpty(&s->pcmBlocks);
+      default:
+         return !ptr_qFLIsEmpty(&s->mp3Blocks);
+   }
+}/*pipeReady*/
+
+/*The queue of streams ready for the stage and its condition. Each
+  output device has its own queue of writers:*/
+static ptr_qFL_t *pipeQueue(int stage, int dev, pthread_cond_t **c)
+{
+   if (PIPE_WRITE == stage)
+   {
+      *c = &g_outDevs[dev].cWrite;
+      return &g_outDevs[dev].qWrite;
+   }
+   *c = g_cStage + stage;
+   return g_qStage + stage;
+}/*pipeQueue*/
+
+/*Queues the stream to each idle stage which has something to do. Must
+  be called with g_mPipe locked:*/
+static void pipeKick(stream_t *s)
+{
+   int i;
+   for (i = 0; i < PIPE_STAGES; ++i)
+   {
+      if ( (PIPE_IDLE == s->stage[i]) && pipeReady(s, i) )
+      {
+         pthread_cond_t *c;
+         s->stage[i] = PIPE_QUEUED;
+         ptr_qFLPushFifo(pipeQueue(i, s->dev, &c), s);
+         pthread_cond_signal(c);
+      }
+   }
+}/*pipeKick*/
+
+static int pipeIsOver(void)
+{
+   return g_headersDone && (0 == g_nStreams);
+}/*pipeIsOver*/
+
+/*Wakes up everybody when all files are done. Must be called with g_mPipe
+  locked:*/
+static void pipeWakeAll(void)
+{
+   int i;
+   if (pipeIsOver())
+   {
+      for (i = 0; i < PIPE_STAGES; ++i)
+      {
+         pthread_cond_broadcast(g_cStage + i);
+      }
+      for (i = 0; i < g_nOutDevs; ++i)
+      {
+         pthread_cond_broadcast(&g_outDevs[i].cWrite);
+      }
+   }
+}/*pipeWakeAll*/
+
+/*Waits for a stream ready for the stage (writers: on the device) and
+  makes it busy. Returns NULL when all files are done:*/
+static stream_t *pipeTake(int stage, int dev)
+{
+   stream_t *s = NULL;
+   pthread_cond_t *c;
+   ptr_qFL_t *q = pipeQueue(stage, dev, &c);
+   pthread_mutex_lock(&g_mPipe);
+   while ( ptr_qFLIsEmpty(q) && !pipeIsOver() )
+   {
+      pthread_cond_wait(c, &g_mPipe);
+   }
+   if (!ptr_qFLIsEmpty(q))
+   {
+      s = ptr_qFLPop(q);
+      s->stage[stage] = PIPE_BUSY;
+   }
+   pthread_mutex_unlock(&g_mPipe);
+   return s;
+}/*pipeTake*/
+
+/*Must be called with g_mPipe locked:*/
+static void pipeRelease(stream_t *s, int stage)
+{
+   s->stage[stage] = PIPE_IDLE;
+   pipeKick(s);
+}/*pipeRelease*/
+
+/*Must be called with g_mPipe locked:*/
+static void *pipeGetBuffer(ptr_qFL_t *pool, pthread_cond_t *c)
+{
+   while ( ptr_qFLIsEmpty(pool) )
+   {
+      pthread_cond_wait(c, &g_mPipe);
+   }
+   return ptr_qFLPop(pool);
+}/*pipeGetBuffer*/
+
+static void *pipeHeaderProvider(void *unused)
+{
+   traceThreadName("header provider");
+   for(;;)
+   {
+      stream_t *s;
+      char fileName[MAX_PATH_LENGTH];
+      int64_t t;
+
+      pthread_mutex_lock(&g_mPipe);
+      while (g_nStreams >= g_maxStreams)
+      {
+         pthread_cond_wait(&g_cStreams, &g_mPipe);
+      }
+      pthread_mutex_unlock(&g_mPipe);
+
+      if (0 != nextFile(fileName, NULL))
+      {
+         break;
+      }
+      if (NULL == (s = calloc(1, sizeof(stream_t))))
+      {
+         halt(15, "malloc fails\n");
+      }
+      strcpy(s->fileName, fileName);
+      s->started = getTimeUs();
+      s->quality = fileQuality();
+      s->size = (0 != g_deadlineOn)? getPathSize(s->fileName): -1;
+      if ( 0 > (s->dev = outputName(s->fileName, s->mp3Name)) )
+      {
+         errorMsg("Can't make the output name of '%s'\n", s->fileName);
+         forgetFile(s->fileName, s->size, 0);
+         fileDone(s->fileName, REMOTE_FAILED);
+         free(s);
+         continue;
+      }
+
+      t = traceStart();
+      if (0 != readHeader(&s->hdr, &s->pcm, s->fileName, NULL))
+      {
+         traceEnd("readHeader", t, NULL);
+         forgetFile(s->fileName, s->size, 0);
+         fileDone(s->fileName, REMOTE_IGNORED);
+         free(s);
+         continue;
+      }
+      traceEnd("readHeader", t, NULL);
+      trimInit(&s->trim, &s->hdr);
+      t = traceStart();
+      s->gf = initLame(&s->hdr, s->fileName, s->quality);
+      traceEnd("lame_init_params", t, NULL);
+      if ( (NULL == s->gf) ||
+           (NULL == ptr_qFLInit(NULL, PIPE_DEPTH + 1, &s->pcmBlocks, QFL_REALLOC_IF_FULL)) ||
+           (NULL == ptr_qFLInit(NULL, PIPE_DEPTH + 1, &s->mp3Blocks, QFL_REALLOC_IF_FULL)) )
+      {
+         cln(s->pcm, NULL);
+         forgetFile(s->fileName, s->size, 0);
+         fileDone(s->fileName, REMOTE_FAILED);
+         free(s);
+         continue;
+      }
+      s->status = REMOTE_OK;
+
+      pthread_mutex_lock(&g_mPipe);
+      ++g_nStreams;
+      pipeKick(s);
+      pthread_mutex_unlock(&g_mPipe);
+   }
+
+   pthread_mutex_lock(&g_mPipe);
+   g_headersDone = 1;
+   pipeWakeAll();
+   pthread_mutex_unlock(&g_mPipe);
+   return NULL;
+}/*pipeHeaderProvider*/
+
+static void *pipeReader(void *arg)
+{
+   char name[32];
+   sprintf(name, "reader %d", (int)(intptr_t)arg);
+   traceThreadName(name);
+   for(;;)
+   {
+      pcmBlock_t *b;
+      stream_t *s = pipeTake(PIPE_READ, 0);
+      int64_t t;
+      int ok;
+
+      if (NULL == s)
+      {
+         break;
+      }
+      pthread_mutex_lock(&g_mPipe);
+      b = pipeGetBuffer(&g_qPcmFree, &g_cPcmFree);
+      ok = (REMOTE_OK == s->status);
+      pthread_mutex_unlock(&g_mPipe);
+
+      t = traceStart();
+      /*stop reading a failed file:*/
+      b->n = ok? readTrimmed(&s->hdr, b->pcm, s->pcm, &s->trim): 0;
+      traceEnd("read", t, s->fileName);
+      if (0 == b->n)
+      {
+         if (g_dropCache)
+         {
+            dropFileCache(s->pcm, 0, 0, 0);
+         }
+         cln(s->pcm, NULL);
+         s->pcm = NULL;
+      }
+
+      pthread_mutex_lock(&g_mPipe);
+      ptr_qFLPushFifo(&s->pcmBlocks, b);
+      ++s->nPcm;
+      if (0 == b->n)
+      {
+         s->eof = 1;
+      }
+      pipeRelease(s, PIPE_READ);
+      pthread_mutex_unlock(&g_mPipe);
+   }
+   return NULL;
+}/*pipeReader*/
+
+static void thePipelineEncoder(worker_t *w)
+{
+   for(;;)
+   {
+      pcmBlock_t *b;
+      mp3Block_t *m;
+      stream_t *s = pipeTake(PIPE_ENCODE, 0);
+      int64_t t;
+      int ok;
+
+      if (NULL == s)
+      {
+         break;
+      }
+      metricsBusy(1);
+      pthread_mutex_lock(&g_mPipe);
+      b = ptr_qFLPop(&s->pcmBlocks);
+      m = pipeGetBuffer(&g_qMp3Free, &g_cMp3Free);
+      ok = (REMOTE_OK == s->status);
+      pthread_mutex_unlock(&g_mPipe);
+
+      t = traceStart();
+      m->last = 0;
+      if (0 == b->n)
+      {
+         m->n = lame_encode_flush(s->gf, m->mp3, g_mp3Size);
+         m->last = 1;
+         traceEnd("flush", t, s->fileName);
+      }
+      else if (!ok)
+      {
+         m->n = 0;/*skip the rest of a failed file*/
+      }
+      else
+      {
+         m->n = encodeTimed(s->gf, &s->hdr, b->pcm, b->n, m->mp3, s->quality);
+         /*one encoder of the stream at a time:*/
+         s->encoded += b->n * PCM_BYTES(1);
+         traceEnd("encode", t, s->fileName);
+      }
+      if (m->n < 0)
+      {
+         errorMsg("File '%s': encoding fails (%d)\n", s->fileName, m->n);
+         ok = 0;
+         m->n = 0;
+      }
+      if (m->last)
+      {
+         lame_close(s->gf);
+         s->gf = NULL;
+      }
+      workerTick(w);
+
+      pthread_mutex_lock(&g_mPipe);
+      if (!ok)
+      {
+         s->status = REMOTE_FAILED;
+      }
+      --s->nPcm;
+      ptr_qFLPushFifo(&g_qPcmFree, b);
+      pthread_cond_signal(&g_cPcmFree);
+      ptr_qFLPushFifo(&s->mp3Blocks, m);
+      pipeRelease(s, PIPE_ENCODE);
+      pthread_mutex_unlock(&g_mPipe);
+      metricsBusy(0);
+   }
+}/*thePipelineEncoder*/
+
+/*Called by the writer after the last block, no other stage touches the
+  stream any more:*/
+static void pipeFinish(stream_t *s)
+{
+   if (NULL != s->mp3)
+   {
+      /*see encodeFile():*/
+      if ( (REMOTE_OK == s->status) && (0 != ferror(s->mp3)) )
+      {
+         errorMsg("File '%s': can't write\n", s->fileName);
+         s->status = REMOTE_FAILED;
+      }
+      if ( (REMOTE_OK == s->status) && syncEachFile() && (0 != syncFile(s->mp3)) )
+      {
+         errorMsg("File '%s': can't sync\n", s->fileName);
+         s->status = REMOTE_FAILED;
+      }
+      if ( (0 != fflush(s->mp3)) && (REMOTE_OK == s->status) )
+      {
+         errorMsg("File '%s': can't write\n", s->fileName);
+         s->status = REMOTE_FAILED;
+      }
+      if (g_dropCache)
+      {
+         dropFileCache(s->mp3, 0, 0, 1);
+      }
+   }
+   if ( (0 != cln(s->pcm, s->mp3)) && (REMOTE_OK == s->status) )
+   {
+      errorMsg("File '%s': can't close\n", s->fileName);
+      s->status = REMOTE_FAILED;
+   }
+   forgetFile(s->fileName, s->size, s->encoded);
+   if (REMOTE_OK == s->status)
+   {
+      statsFile(getTimeUs() - s->started, s->hdr.subchunk2Size);
+      metricsLatency(getTimeUs() - s->started);
+   }
+   fileEncoded(s->fileName, s->mp3Name, s->status);
+   ptr_qFLDestroy(&s->pcmBlocks);
+   ptr_qFLDestroy(&s->mp3Blocks);
+   free(s);
+
+   pthread_mutex_lock(&g_mPipe);
+   --g_nStreams;
+   pthread_cond_signal(&g_cStreams);
+   pipeWakeAll();
+   pthread_mutex_unlock(&g_mPipe);
+}/*pipeFinish*/
+
+/*arg is the number of the writer, g_nDevWriters of each device:*/
+static void *pipeWriter(void *arg)
+{
+   char name[32];
+   int dev = (int)(intptr_t)arg / g_nDevWriters;
+   sprintf(name, "writer %d", (int)(intptr_t)arg);
+   traceThreadName(name);
+   for(;;)
+   {
+      mp3Block_t *m;
+      stream_t *s = pipeTake(PIPE_WRITE, dev);
+      int64_t t;
+      int last, ok;
+
+      if (NULL == s)
+      {
+         break;
+      }
+      pthread_mutex_lock(&g_mPipe);
+      m = ptr_qFLPop(&s->mp3Blocks);
+      ok = (REMOTE_OK == s->status);
+      pthread_mutex_unlock(&g_mPipe);
+
+      t = traceStart();
+      /*s->mp3 belongs to the writer:*/
+      if ( (NULL == s->mp3) && ok )
+      {
+         /*Can't create a file at the scan time:( :*/
+         pthread_mutex_lock(&g_mEndScan);
+         s->mp3 = fopen(s->mp3Name, "wb");
+         pthread_mutex_unlock(&g_mEndScan);
+         if (NULL == s->mp3)
+         {
+            errorMsg("Can't create file '%s'\n", s->mp3Name);
+            ok = 0;
+         }
+         else if (0 != g_writeBuffer)
+         {
+            /*a stream may be written by any writer, so stdio owns it:*/
+            setvbuf(s->mp3, NULL, _IOFBF, g_writeBuffer);
+         }
+      }
+      if ( (NULL != s->mp3) && (m->n > 0) && (1 != fwrite(m->mp3, m->n, 1, s->mp3)) )
+      {
+         errorMsg("File '%s': can't write\n", s->fileName);
+         ok = 0;
+      }
+      else if ( (NULL != s->mp3) && (m->n > 0) )
+      {
+         metricsAdd(METRIC_BYTES_OUT, m->n);
+      }
+      traceEnd("write", t, s->fileName);
+      last = m->last;
+
+      pthread_mutex_lock(&g_mPipe);
+      if (!ok)
+      {
+         s->status = REMOTE_FAILED;
+      }
+      ptr_qFLPushFifo(&g_qMp3Free, m);
+      pthread_cond_signal(&g_cMp3Free);
+      if (0 == last)
+      {
+         pipeRelease(s, PIPE_WRITE);
+      }
+      pthread_mutex_unlock(&g_mPipe);
+      if (0 != last)
+      {
+         pipeFinish(s);
+      }
+   }
+   return NULL;
+}/*pipeWriter*/
+
+/*Allocates the pools and starts the header provider, readers and
+  writers. Encoders are the workers:*/
+static void startPipeline(void)
+{
+   int i, nBlocks = PIPE_BLOCKS;
+   pcmBlock_t *pcm = malloc(nBlocks * sizeof(pcmBlock_t));
+   mp3Block_t *mp3 = malloc(nBlocks * sizeof(mp3Block_t));
+
+   g_nDevWriters = (0 != g_devWriters)? g_devWriters: g_nWriters;
+   g_pipeThreads = malloc( (1 + g_nReaders + g_nOutDevs * g_nDevWriters) * sizeof(pthread_t) );
+   if ( (NULL == pcm) || (NULL == mp3) || (NULL == g_pipeThreads) )
+   {
+      halt(15, "malloc fails\n");
+   }
+   for (i = 0; i < nBlocks; ++i)
+   {
+      pcm[i].pcm = arenaAlloc(PCM_BYTES(g_blockFrames));
+      mp3[i].mp3 = arenaAlloc(g_mp3Size);
+      if ( (NULL == pcm[i].pcm) || (NULL == mp3[i].mp3) )
+      {
+         halt(15, "The buffer arena is exhausted\n");
+      }
+   }
+   if ( (NULL == ptr_qFLInit(NULL, nBlocks + 1, &g_qPcmFree, QFL_REALLOC_IF_FULL)) ||
+        (NULL == ptr_qFLInit(NULL, nBlocks + 1, &g_qMp3Free, QFL_REALLOC_IF_FULL)) )
+   {
+      halt(15, "malloc fails\n");
+   }
+   for (i = 0; i < nBlocks; ++i)
+   {
+      ptr_qFLPushFifo(&g_qPcmFree, pcm + i);
+      ptr_qFLPushFifo(&g_qMp3Free, mp3 + i);
+   }
+   g_maxStreams = g_nWorkers * PIPE_STREAMS_PER_ENCODER;
+   for (i = 0; i < PIPE_STAGES; ++i)
+   {
+      if (NULL == ptr_qFLInit(NULL, g_maxStreams + 1, g_qStage + i, QFL_REALLOC_IF_FULL))
+      {
+         halt(15, "malloc fails\n");
+      }
+      pthread_cond_init(g_cStage + i, NULL);
+   }
+
+   if (pthread_create(g_pipeThreads, NULL, pipeHeaderProvider, NULL))
+   {
+      halt(20, "Can't start the header provider\n");
+   }
+   for (i = 0; i < g_nReaders; ++i)
+   {
+      if (pthread_create(g_pipeThreads + 1 + i, NULL, pipeReader, (void*)(intptr_t)i))
+      {
+         halt(20, "Can't start reader %d of %d\n", i, g_nReaders);
+      }
+   }
+   for (i = 0; i < g_nOutDevs; ++i)
+   {
+      if (NULL == ptr_qFLInit(NULL, g_maxStreams + 1, &g_outDevs[i].qWrite, QFL_REALLOC_IF_FULL))
+      {
+         halt(15, "malloc fails\n");
+      }
+   }
+   for (i = 0; i < g_nOutDevs * g_nDevWriters; ++i)
+   {
+      if (pthread_create(g_pipeThreads + 1 + g_nReaders + i, NULL, pipeWriter, (void*)(intptr_t)i))
+      {
+         halt(20, "Can't start writer %d of %d\n", i, g_nOutDevs * g_nDevWriters);
+      }
+   }
+}/*startPipeline*/
+
+static void joinPipeline(void)
+{
+   int i;
+   for (i = 0; i < 1 + g_nReaders + g_nOutDevs * g_nDevWriters; ++i)
+   {
+      pthread_join(g_pipeThreads[i], NULL);
+   }
+}/*joinPipeline*/
+
+static void *startWorker (void *ptr)
+{
+   int id;
+   {
+      pool_t *p = (pool_t*)ptr;
+      id = p - g_pool;/*This is the order number of my resources*/
+   }
+   message(" started worker %d\n", id);
+   metricsWorker(id);
+   if ( (0 != g_idlePriority) && (0 != qosIdlePriority()) )
+   {
+      logMsg(LOG_WARNING, "Worker %d: can't switch to the idle priority\n", id);
+   }
+   if (g_traceEnabled)
+   {
+      char name[32];
+      sprintf(name, "worker %d", id);
+      traceThreadName(name);
+   }
+
+   /*finish setup:*/
+   sem_post(&g_sAllThreadsReady);/*indicator end of initialisation*/
+
+   /*do the job*/
+   if (NULL != g_coordinator)
+   {
+      theRemoteWorker(g_workers + id);
+   }
+   else if (0 != g_pipeline)
+   {
+      thePipelineEncoder(g_workers + id);
+   }
+   else
+   {
+      theWorker(g_workers + id);
+   }
+   qosDone(id);
+
+   return NULL;
+}/*startWorker*/
+
+/*Queues n names as one entry: the first one, linked to the rest which
+  are taken by the same worker (see --gapless). The entry costs as much
+  as all of them:*/
+static void queueGroup(root_t *root, char **names, int n)
+{
+   size_t l = 0;
+   uint32_t file = FILETAB_NONE, prev = FILETAB_NONE;
+   float cost = 0.0f;
+   int i;
+
+   for (i = 0; i < n; ++i)
+   {
+      int64_t size = -1;
+      uint32_t f;
+      if (root->pathnameLength + strlen(names[i]) < MAX_PATH_LENGTH)
+      {
+         char fullname[MAX_PATH_LENGTH];
+         strcpy(fullname, root->pathname);
+         strcpy(fullname + root->pathnameLength, names[i]);
+         size = getPathSize(fullname);
+      }
+      if ( (0 != g_deadlineOn) && (size > 0) )
+      {
+         deadlineQueued(size);
+      }
+      f = fileTabAdd((uint32_t)(root - g_roots), names[i], size, FILE_COST(size));
+      if (FILETAB_NONE == f)
+      {
+         halt(15, "The file table is full\n");
+      }
+      if (FILETAB_NONE == prev)
+      {
+         file = f;
+      }
+      else
+      {
+         fileTabEntry(prev)->next = f;
+      }
+      prev = f;
+      cost += FILE_COST(size);
+      l += QUEUE_ENTRY_COST(strlen(names[i]));
+   }
+   fileTabEntry(file)->cost = cost;
+   /*TODO: mutex lock/unlock and sem_post may fail:*/
+   pthread_mutex_lock(&g_mFileName);
+   if (0 != g_queueBudget)
+   {
+      /*Bounded queue, wait for a room (but never for an empty queue):*/
+      while ( (0 != root->queueBytes) &&
+              (root->queueBytes + l > root->queueBudget) )
+      {
+         pthread_cond_wait(&root->cQueueSpace, &g_mFileName);
+      }
+      root->queueBytes += l;
+   }
+   pushFileName(root, file);
+   sem_post(&g_sFileName);
+   pthread_mutex_unlock(&g_mFileName);
+   metricsAdd(METRIC_QUEUED, n);
+}/*queueGroup*/
+
+static void queueFile(root_t *root, char *fileName)
+{
+   queueGroup(root, &fileName, 1);
+}/*queueFile*/
+
+/*A name of a track: its number is the first run of digits, the text
+  before it is the prefix shared by the group ("01 - Intro.wav",
+  "Track02.wav", "book_003.wav"):*/
+typedef struct
+{
+   char *name;
+   size_t prefix;
+   long number;/*-1 if none*/
+}track_t;
+
+static void trackNumber(track_t *t, char *name)
+{
+   char *ch = name;
+   t->name = name;
+   while ( ('\0' != *ch) && ( (*ch < '0') || (*ch > '9') ) )
+   {
+      ++ch;
+   }
+   t->prefix = (size_t)(ch - name);
+   t->number = ('\0' != *ch)? strtol(ch, NULL, 10): -1;
+}/*trackNumber*/
+
+/*By the prefix, then by the number:*/
+static int cmpTracks(const void *a, const void *b)
+{
+   const track_t *x = (const track_t*)a, *y = (const track_t*)b;
+   size_t l = (x->prefix < y->prefix)? x->prefix: y->prefix;
+   int c = memcmp(x->name, y->name, l);
+   if (0 != c)
+   {
+      return c;
+   }
+   if (x->prefix != y->prefix)
+   {
+      return (x->prefix < y->prefix)? -1: 1;
+   }
+   if (x->number != y->number)
+   {
+      return (x->number < y->number)? -1: 1;
+   }
+   return strcmp(x->name, y->name);
+}/*cmpTracks*/
+
+/*A name found by the scanner of the root, see --gapless. One without a
+  number is not a track and is queued right away, a track is kept (in
+  the buffer of the root) until all the names are known:*/
+static void addTrack(root_t *root, char *fileName)
+{
+   size_t l = strlen(fileName) + 1;
+   track_t t;
+
+   trackNumber(&t, fileName);
+   if (t.number < 0)
+   {
+      queueFile(root, fileName);
+      return;
+   }
+   if (root->tracksBytes + l > root->maxTracksBytes)
+   {
+      root->maxTracksBytes = (0 == root->maxTracksBytes)? 4096: 2 * root->maxTracksBytes;
+      if (root->maxTracksBytes < root->tracksBytes + l)
+      {
+         root->maxTracksBytes = root->tracksBytes + l;
+      }
+      root->tracks = realloc(root->tracks, root->maxTracksBytes);
+      if (NULL == root->tracks)
+      {
+         halt(15, "malloc fails\n");
+      }
+   }
+   memcpy(root->tracks + root->tracksBytes, fileName, l);
+   root->tracksBytes += l;
+   ++root->nTracks;
+}/*addTrack*/
+
+/*Queues the tracks found by the scanner of the root: the ones with the
+  same prefix and consecutive numbers as groups, the rest one by one:*/
+static void queueTracks(root_t *root)
+{
+   track_t *t = malloc(root->nTracks * sizeof(track_t) + 1);
+   char **group = malloc(root->nTracks * sizeof(char*) + 1);
+   char *name = root->tracks;
+   int i, n;
+
+   if ( (NULL == t) || (NULL == group) )
+   {
+      halt(15, "malloc fails\n");
+   }
+   for (i = 0; i < root->nTracks; ++i)
+   {
+      trackNumber(t + i, name);
+      name += strlen(name) + 1;
+   }
+   qsort(t, root->nTracks, sizeof(track_t), cmpTracks);
+   for (i = 0; i < root->nTracks; i += n)
+   {
+      group[0] = t[i].name;
+      for (n = 1; (i + n < root->nTracks) && (t[i].number >= 0) &&
+                  (t[i + n].prefix == t[i].prefix) &&
+                  (0 == memcmp(t[i + n].name, t[i].name, t[i].prefix)) &&
+                  (t[i + n].number == t[i + n - 1].number + 1); ++n)
+      {
+         group[n] = t[i + n].name;
+      }
+      if (n > 1)
+      {
+         logMsg(LOG_DEBUG, "'%s%s': a group of %d tracks\n", root->pathname, group[0], n);
+      }
+      queueGroup(root, group, n);
+   }
+   free(root->tracks);
+   free(group);
+   free(t);
+   root->tracks = NULL;
+   root->tracksBytes = root->maxTracksBytes = 0;
+   root->nTracks = 0;
+}/*queueTracks*/
+
+static int isWavName(char *name)
+{
+   size_t l = strlen(name);
+   char *ch = name + (l - 4);
+   return (l > 4) &&
+          ('.' == ch[0]) &&
+          ('W' == myToupper(ch[1])) &&
+          ('A' == myToupper(ch[2])) &&
+          ('V' == myToupper(ch[3]));
+}/*isWavName*/
+
+/*This callback is invoked on each of a scanned directory element*/
+static int doScanDirectory( int i, char *dirEntry, int isDirectory, void *data)
+{
+   root_t *root = (root_t*)data;
+   if (!isDirectory)
+   {
+      size_t l = strlen(dirEntry);
+      if (isWavName(dirEntry))
+      {
+         if ( journalIsOpen() && (root->pathnameLength + l < MAX_PATH_LENGTH) )
+         {
+            char fullname[MAX_PATH_LENGTH];
+            strcpy(fullname, root->pathname);
+            strcpy(fullname + root->pathnameLength, dirEntry);
+            if (journalIsDone(fullname))
+            {
+               pthread_mutex_lock(&g_mTotalConverted);
+               ++g_totalResumed;
+               metricsAdd(METRIC_SKIPPED, 1);
+               pthread_mutex_unlock(&g_mTotalConverted);
+               return 0;
+            }
+         }
+         if (0 != g_gapless)
+         {
+            addTrack(root, dirEntry);
+         }
+         else
+         {
+            queueFile(root, dirEntry);
+         }
+         ++root->found;
+      }
+   }
+   return 0;
+}/*scanDirectory*/
+
+/*A scanner (or the job server) will queue no more files:*/
+static void scanFinished(void)
+{
+   /*TODO: mutex lock/unlock and sem_post may fail:*/
+   pthread_mutex_lock(&g_mFileName);
+   if (0 == --g_nScanning)
+   {
+      /*end-of-work, see theWorker():*/
+      sem_post(&g_sFileName);
+      if (0 != g_prefetch)
+      {
+         pthread_cond_signal(&g_cPrefetch);
+      }
+   }
+   pthread_mutex_unlock(&g_mFileName);
+}/*scanFinished*/
+
+/*The scanner thread of a root:*/
+static void *scanDirectory (void *ptr)
+{
+   root_t *root = (root_t*)ptr;
+   int64_t t;
+
+   if (g_traceEnabled)
+   {
+      char name[32];
+      sprintf(name, "scanner %d", (int)(root - g_roots));
+      traceThreadName(name);
+   }
+   t = traceStart();
+   if (listDir(root->pathname, doScanDirectory, ptr) < 0)
+   {
+      errorMsg("Can't scan '%s'\n", root->pathname);
+   }
+   if (0 != g_gapless)
+   {
+      queueTracks(root);
+   }
+   traceEnd("scan", t, NULL);
+   scanFinished();
+   return NULL;
+}/*scanDirectory*/
+
+/*Parses "path[@weight]" into the next root:*/
+static void addRoot(char *arg)
+{
+   root_t *root;
+   char *at = strrchr(arg, '@');
+   size_t l = strlen(arg);
+   int i;
+
+   root = g_roots = realloc(g_roots, (g_nRoots + 1) * sizeof(root_t));
+   if (NULL == g_roots)
+   {
+      halt(15, "malloc fails\n");
+   }
+   root += g_nRoots++;
+   memset(root, 0, sizeof(root_t));
+   root->weight = 1;
+   root->lane = -1;
+
+   if ( (NULL != at) && ('\0' != at[1]) && (strspn(at + 1, "0123456789") == strlen(at + 1)) )
+   {
+      root->weight = atoi(at + 1);
+      if (0 == root->weight)
+      {
+         halt(10, "Wrong weight in '%s'\n", arg);
+      }
+      l = at - arg;
+   }
+
+   /*Save a name of a given directory to scan as ".../
+     ( ...or \ on Windows)"*/
+   if (l >= MAX_PATH_LENGTH - 1)
+   {
+      halt(15, "Too long path name\n");
+   }
+   for (i = 0; i < (int)l; ++i)
+   {
+      root->pathname[i] = arg[i];
+   }
+   root->pathnameLength = i;
+
+   if ( (0 == i) || (SYSTEM_DIR_DELIMITER != root->pathname[i - 1]) )
+   {
+      root->pathname[root->pathnameLength++] = SYSTEM_DIR_DELIMITER;
+   }
+   root->pathname[root->pathnameLength] = '\0';
+}/*addRoot*/
+
+/*The index of the output device, a new one if it is not known yet:*/
+static int addOutDev(int64_t id)
+{
+   int i;
+   for (i = 0; i < g_nOutDevs; ++i)
+   {
+      if (g_outDevs[i].id == id)
+      {
+         return i;
+      }
+   }
+   g_outDevs[g_nOutDevs].id = id;
+   return g_nOutDevs++;
+}/*addOutDev*/
+
+/*Creates output directories of roots and finds output devices, see
+  --out-dir and --dev-writers:*/
+static void initOutput(void)
+{
+   int i, j, nDirs = 0;
+
+   for (i = 0; i < g_nRoots; ++i)
+   {
+      nDirs += (g_roots[i].lane < 0);
+   }
+   if ( NULL == (g_outDevs = calloc(g_nRoots + 1, sizeof(outDev_t))) )
+   {
+      halt(15, "malloc fails\n");
+   }
+   if (NULL != g_outDir)
+   {
+      if (0 != makeDirs(g_outDir))
+      {
+         halt(10, "Can't create '%s'\n", g_outDir);
+      }
+      /*of names out of roots:*/
+      addOutDev(deviceId(g_outDir));
+   }
+   for (i = 0; i < g_nRoots; ++i)
+   {
+      root_t *root = g_roots + i;
+      char *name = root->pathname + root->pathnameLength - 1;
+      size_t l = 0;
+
+      if (root->lane >= 0)
+      {
+         /*names are full, see outputName():*/
+         root->outDev = 0;
+         continue;
+      }
+      if (NULL == g_outDir)
+      {
+         root->outDev = addOutDev(deviceId(root->pathname));
+         continue;
+      }
+      /*the last name of the root if there are several:*/
+      if (nDirs > 1)
+      {
+         while ( (name > root->pathname) && (SYSTEM_DIR_DELIMITER != name[-1]) )
+         {
+            --name;
+            ++l;
+         }
+         if ( (0 == l) || (0 == strncmp(name, ".", l)) || (0 == strncmp(name, "..", l)) )
+         {
+            halt(10, "--out-dir: name the directory '%s' by its path\n", root->pathname);
+         }
+      }
+      if ( NULL == (root->outPath = malloc(strlen(g_outDir) + l + 2)) )
+      {
+         halt(15, "malloc fails\n");
+      }
+      strcpy(root->outPath, g_outDir);
+      if (0 != l)
+      {
+         strncat(root->outPath, name, l);
+         root->outPath[strlen(g_outDir) + l] = SYSTEM_DIR_DELIMITER;
+         root->outPath[strlen(g_outDir) + l + 1] = '\0';
+      }
+      for (j = 0; j < i; ++j)
+      {
+         if (0 == strcmp(g_roots[j].outPath, root->outPath))
+         {
+            halt(10, "--out-dir: directories '%s' and '%s' have the same name\n",
+                 g_roots[j].pathname, root->pathname);
+         }
+      }
+      if (0 != makeDirs(root->outPath))
+      {
+         halt(10, "Can't create '%s'\n", root->outPath);
+      }
+      root->outDev = addOutDev(deviceId(root->outPath));
+   }
+   if (0 == g_nOutDevs)
+   {
+      /*a worker process writing next to the sources:*/
+      addOutDev(-1);
+   }
+
+   /*pipeline writers are already limited by their number:*/
+   g_devSems = (0 != g_devWriters) && (0 == g_pipeline);
+   for (i = 0; i < g_nOutDevs; ++i)
+   {
+      pthread_cond_init(&g_outDevs[i].cWrite, NULL);
+      if ( (0 != g_devSems) && (sem_init(&g_outDevs[i].sWriters, 0, g_devWriters) == -1) )
+      {
+         halt(10, "Error initialising device semaphores\n");
+      }
+   }
+   logMsg(LOG_DEBUG, "%d output devices\n", g_nOutDevs);
+}/*initOutput*/
+
+/*The lanes of the job server are roots without a scanner, after the
+  directories. The high lane is served first:*/
+static void addLanes(void)
+{
+   int i;
+   g_firstLane = g_nRoots;
+   g_roots = realloc(g_roots, (g_nRoots + SERVER_LANES) * sizeof(root_t));
+   if (NULL == g_roots)
+   {
+      halt(15, "malloc fails\n");
+   }
+   for (i = 0; i < SERVER_LANES; ++i)
+   {
+      root_t *root = g_roots + g_nRoots++;
+      memset(root, 0, sizeof(root_t));
+      root->weight = 1;
+      root->lane = i;
+      root->priority = (SERVER_LANE_HIGH == i);
+   }
+}/*addLanes*/
+
+typedef struct
+{
+   char *dir;
+   root_t *root;
+   unsigned jobId;
+   int files;
+}submit_t;
+
+/*Queues the full name as a file of the job:*/
+static int submitFile(submit_t *s, char *fileName)
+{
+   if (0 != srvFileAdd(fileName, s->jobId))
+   {
+      return -1;
+   }
+   queueFile(s->root, fileName);
+   pthread_mutex_lock(&g_mFileName);
+   ++s->root->found;
+   pthread_mutex_unlock(&g_mFileName);
+   ++s->files;
+   return 0;
+}/*submitFile*/
+
+/*listDir() callback of a submitted directory:*/
+static int doSubmitDirectory(int i, char *dirEntry, int isDirectory, void *data)
+{
+   submit_t *s = (submit_t*)data;
+   char fullname[MAX_PATH_LENGTH];
+   if ( isDirectory || !isWavName(dirEntry) )
+   {
+      return 0;
+   }
+   if (strlen(s->dir) + strlen(dirEntry) >= MAX_PATH_LENGTH)
+   {
+      errorMsg("Too long path name '%s%s'\n", s->dir, dirEntry);
+      return 0;
+   }
+   strcpy(fullname, s->dir);
+   strcat(fullname, dirEntry);
+   return submitFile(s, fullname);
+}/*doSubmitDirectory*/
+
+/*Job server callback, see remote.h:*/
+static int serverSubmit(char *path, int lane, unsigned jobId)
+{
+   char dir[MAX_PATH_LENGTH];
+   size_t l = strlen(path);
+   submit_t s;
+   FILE *f;
+
+   s.dir = dir;
+   s.root = g_roots + g_firstLane + lane;
+   s.jobId = jobId;
+   s.files = 0;
+   if ( (0 == l) || (l >= MAX_PATH_LENGTH - 1) )
+   {
+      return -1;
+   }
+   strcpy(dir, path);
+   if (SYSTEM_DIR_DELIMITER != dir[l - 1])
+   {
+      dir[l] = SYSTEM_DIR_DELIMITER;
+      dir[l + 1] = '\0';
+   }
+   if (listDir(dir, doSubmitDirectory, &s) >= 0)
+   {
+      logMsg(LOG_INFO, "Job %u: %d files of '%s'\n", jobId, s.files, path);
+      return s.files;
+   }
+   if ( (0 != s.files) || !isWavName(path) || (NULL == (f = fopen(path, "rb"))) )
+   {
+      return (0 != s.files)? s.files: -1;
+   }
+   fclose(f);
+   logMsg(LOG_INFO, "Job %u: '%s'\n", jobId, path);
+   return (0 == submitFile(&s, path))? 1: -1;
+}/*serverSubmit*/
+
+/*The job server thread, it is like a scanner until SHUTDOWN:*/
+static void *serverThread(void *arg)
+{
+   server_t s;
+   (void)arg;
+   if (g_traceEnabled)
+   {
+      traceThreadName("server");
+   }
+   s.submit = serverSubmit;
+   if (0 != runServer(g_serverAddress, &s))
+   {
+      halt(20, "The job server fails\n");
+   }
+   scanFinished();
+   return NULL;
+}/*serverThread*/
+
+/*--submit: sends pathnames to the job server. Returns the exit code:*/
+static int submitJobs(char *lane, int wait, int shut)
+{
+   char reply[MAX_PATH_LENGTH + 64];
+   unsigned *ids = malloc((g_nRoots + 1) * sizeof(unsigned));
+   int conn = remoteConnect(g_submitAddress);
+   int i, rc = 0;
+
+   if (NULL == ids)
+   {
+      halt(15, "malloc fails\n");
+   }
+   if (conn < 0)
+   {
+      errorMsg("Can't connect to '%s'\n", g_submitAddress);
+      return 20;
+   }
+   for (i = 0; i < g_nRoots; ++i)
+   {
+      root_t *root = g_roots + i;
+      char *full;
+      int files;
+      /*addRoot() appends the delimiter, a file name must not have it:*/
+      if (root->pathnameLength > 1)
+      {
+         root->pathname[--root->pathnameLength] = '\0';
+      }
+#ifdef _WIN32
+      full = _fullpath(NULL, root->pathname, 0);
+#else
+      full = realpath(root->pathname, NULL);
+#endif
+      if (NULL == full)
+      {
+         errorMsg("Can't find '%s'\n", root->pathname);
+         rc = 10;
+         continue;
+      }
+      if ( (0 != remoteRequest(conn, reply, sizeof(reply), "SUBMIT %s %s", lane, full)) ||
+           (2 != sscanf(reply, "OK %u %d", ids + i, &files)) )
+      {
+         errorMsg("'%s': %s\n", full, reply);
+         ids[i] = 0;
+         rc = 10;
+      }
+      else
+      {
+         message("Job %u: %d files of '%s'\n", ids[i], files, full);
+      }
+      free(full);
+   }
+   for (i = 0; (0 != wait) && (i < g_nRoots); ++i)
+   {
+      unsigned id;
+      int counts[3];
+      if (0 == ids[i])
+      {
+         continue;
+      }
+      if ( (0 != remoteRequest(conn, reply, sizeof(reply), "WAIT %u", ids[i])) ||
+           (4 != sscanf(reply, "DONE %u %d %d %d", &id, counts, counts + 1, counts + 2)) )
+      {
+         errorMsg("Job %u: %s\n", ids[i], reply);
+         rc = 20;
+         break;
+      }
+      message("Job %u: %d converted, %d ignored, %d failed\n", id, counts[0], counts[1], counts[2]);
+      if (0 != counts[2])
+      {
+         rc = 1;
+      }
+   }
+   if ( (0 != shut) &&
+        ( (0 != remoteRequest(conn, reply, sizeof(reply), "SHUTDOWN")) ||
+          (0 != strcmp(reply, "OK")) ) )
+   {
+      errorMsg("Can't shut down the server: %s\n", reply);
+      rc = 20;
+   }
+   remoteClose(conn);
+   free(ids);
+   return rc;
+}/*submitJobs*/
+
+/*"HH:MM" (the next one) or "+N[s|m|h]" from now. Returns -1 on error:*/
+static time_t parseDeadline(char *str)
+{
+   time_t now = time(NULL);
+   int h, m, n = 0;
+
+   if ('+' == *str)
+   {
+      char *end;
+      double val = strtod(str + 1, &end);
+      int unit = ('\0' == *end)? 1:
+                 ('s' == *end)? 1: ('m' == *end)? 60: ('h' == *end)? 3600: 0;
+      if ( (end == str + 1) || (val <= 0) || (0 == unit) ||
+           ( ('\0' != *end) && ('\0' != end[1]) ) )
+      {
+         return (time_t)-1;
+      }
+      return now + (time_t)(val * unit);
+   }
+   if ( (2 == sscanf(str, "%d:%d%n", &h, &m, &n)) && ('\0' == str[n]) &&
+        (h >= 0) && (h < 24) && (m >= 0) && (m < 60) )
+   {
+      struct tm tm = *localtime(&now);
+      time_t t;
+      tm.tm_hour = h;
+      tm.tm_min = m;
+      tm.tm_sec = 0;
+      tm.tm_isdst = -1;
+      if ( (t = mktime(&tm)) <= now )
+      {
+         /*tomorrow:*/
+         ++tm.tm_mday;
+         tm.tm_isdst = -1;
+         t = mktime(&tm);
+      }
+      return t;
+   }
+   return (time_t)-1;
+}/*parseDeadline*/
+
+static void usage(char *prgName)
+{
+   halt(10,
+      "usage: %s [options] pathname[@weight] [pathname[@weight] ...]\n"
+      "  Files of several directories share the workers proportionally\n"
+      "  to the weights (1 by default)\n"
+      "options:\n"
+      "  --log=FILE        duplicate all messages to FILE\n"
+      "  --log-level=N     0 errors only, 1 warnings, 2 info (default), 3 debug\n"
+      "  --trace=FILE      write a Chrome trace-event timeline of workers into FILE\n"
+      "  --queue-memory=SIZE  limit the memory of queued names (e.g. 64M),\n"
+      "                    the scanner waits while the queue is full\n"
+      "  --journal=FILE    record completed files into FILE\n"
+      "  --resume          skip files completed according to the journal\n"
+      "  --workers=N       number of workers (1.5 * number of CPU by default)\n"
+      "  --coordinator=ADDR  do not encode, serve files to worker processes\n"
+      "                    on ADDR (unix:PATH or HOST:PORT)\n"
+      "  --lease=SEC       coordinator: give a file to another worker if the\n"
+      "                    current one is silent for SEC seconds (60)\n"
+      "  --retries=N       coordinator: give up a file after N lost workers (3)\n"
+      "  --connect=ADDR    worker process: take files from the coordinator\n"
+      "                    at ADDR, no pathname is needed\n"
+      "  --isolate         run each worker in its own process, a crash of\n"
+      "                    the encoder fails only the file being encoded\n"
+      "  --prefetch=N      read ahead up to N queued files into the page cache\n"
+      "  --drop-cache      evict consumed input and written output from\n"
+      "                    the page cache\n"
+      "  --pipeline        separate threads for headers, reading, encoding\n"
+      "                    (the workers) and writing, for high latency storage\n"
+      "  --readers=N       pipeline: number of reading threads (2)\n"
+      "  --writers=N       pipeline: number of writing threads (1)\n"
+      "  --stats=FILE      write throughput, peak memory and per-file latency\n"
+      "                    percentiles into FILE\n"
+      "  --metrics=FILE    keep live counters in FILE in the Prometheus text\n"
+      "                    format (for the node_exporter textfile collector)\n"
+      "  --metrics-interval=SEC  rewrite --metrics every SEC seconds (15)\n"
+      "  --block=FRAMES    frames read and encoded at once (8192)\n"
+      "  --write-buffer=SIZE  buffer of output files (e.g. 256k)\n"
+      "  --autotune-io     probe reads in the first pathname and writes in the\n"
+      "                    output directory, pick the fastest sizes\n"
+      "  --hugepages       back the buffers by huge pages\n"
+      "  --cpu-budget=F    QoS: let the host be busy up to F (0..1) of its CPUs,\n"
+      "                    workers pause while others need the CPU\n"
+      "  --max-load=L      QoS: the same with a target load of L CPUs\n"
+      "  --idle-priority   run workers as SCHED_IDLE with the idle I/O class\n"
+      "                    (implied by QoS)\n"
+      "  --trim-silence=DB cut the leading and trailing silence below DB dBFS\n"
+      "                    (e.g. -50) before encoding\n"
+      "  --max-gap=MS      shorten silent gaps longer than MS ms to MS ms\n"
+      "  --follow          encode files which are still being written, waiting\n"
+      "                    for more data until the writer closes them\n"
+      "  --follow-idle=SEC --follow: a file not growing for SEC seconds (60)\n"
+      "                    is finished\n"
+      "  --durable         report files done only when their outputs are on\n"
+      "                    the disk, syncing them in batches\n"
+      "  --durable-window=MS  --durable: wait up to MS ms to batch files (100)\n"
+      "  --remove-source   remove a .wav when its .mp3 is durable (implies\n"
+      "                    --durable)\n"
+      "  --gapless         encode sequential tracks of a directory (the same\n"
+      "                    prefix, consecutive numbers) by one encoder, without\n"
+      "                    gaps between them\n"
+      "  --verify          decode every .mp3 written and check its frames,\n"
+      "                    duration and (unless trimmed) the SNR to the source\n"
+      "  --verify-snr=DB   --verify: fail outputs with the SNR below DB\n"
+      "  --deadline=WHEN   finish by WHEN (HH:MM or +N[s|m|h]), lowering the\n"
+      "                    quality of files only as much as needed\n"
+      "  --out-dir=DIR     write .mp3 files into DIR mirroring the pathnames\n"
+      "                    instead of next to the sources\n"
+      "  --dev-writers=N   at most N writes at once to each output device;\n"
+      "                    pipeline: N writers of each device (--writers)\n"
+      "  --server=ADDR     job server: also take files and directories from\n"
+      "                    clients on ADDR (unix:PATH) until --shutdown,\n"
+      "                    no pathname is needed\n"
+      "  --submit=ADDR     client: send the pathnames to the job server\n"
+      "  --lane=LANE       client: 'high' (served first) or 'bulk' (default)\n"
+      "  --wait            client: wait until the submitted jobs are finished\n"
+      "  --shutdown        client: let the server finish queued jobs and exit\n",
+      prgName);
+}/*usage*/
+
+/*Coordinator callback, see remote.h:*/
+static char *coordinatorNextJob(int *isOver)
+{
+   root_t *root = NULL;
+   char fullname[MAX_PATH_LENGTH];
+   uint32_t file;
+
+   pthread_mutex_lock(&g_mFileName);
+   file = popFileName(&root);
+   if ( (FILETAB_NONE == file) && (0 == g_nScanning) )
+   {
+      *isOver = 1;
+   }
+   pthread_mutex_unlock(&g_mFileName);
+   if ( (FILETAB_NONE == file) || (0 != fullFileName(root, file, fullname)) )
+   {
+      return NULL;
+   }
+   return copyName(fullname);
+}/*coordinatorNextJob*/
+
+/*Isolated workers callback, runs in a worker process:*/
+static int isolatedEncode(int id, char *fileName)
+{
+   /*once per worker process:*/
+   static int idle = 0;
+   if ( (0 != g_idlePriority) && (0 == idle) )
+   {
+      idle = 1;
+      if (0 != qosIdlePriority())
+      {
+         logMsg(LOG_WARNING, "Worker %d: can't switch to the idle priority\n", id);
+      }
+   }
+   return encodeFile(g_workers + id, fileName, journalIsOpen(), NULL);
+}/*isolatedEncode*/
+
+/*Writes a probe file by unbuffered calls of the size, synced and dropped
+  from the page cache. Returns the rate in MB/s or a negative value:*/
+static double writeProbe(char *name, char *buf, size_t size)
+{
+   size_t done;
+   double rate;
+   int64_t t;
+   FILE *f = fopen(name, "wb");
+
+   if (NULL == f)
+   {
+      return -1.0;
+   }
+   setvbuf(f, NULL, _IONBF, 0);
+   t = getTimeUs();
+   for (done = 0; done < AUTOTUNE_BYTES; done += size)
+   {
+      if (1 != fwrite(buf, size, 1, f))
+      {
+         break;
+      }
+   }
+   syncFile(f);
+   rate = (double)done / (getTimeUs() - t + 1);/*MB/s*/
+   dropFileCache(f, 0, 0, 1);
+   fclose(f);
+   return rate;
+}/*writeProbe*/
+
+/*Writes a probe file in outDir and reads one back in inDir (the same file
+  if they are the same) with each of g_autotuneSizes[] by unbuffered
+  calls. The files are synced and dropped from the page cache before
+  reading, so both are measured against the storage, each on its device.
+  Sets g_blockFrames to the fastest read size and g_writeBuffer to the
+  fastest write size. Returns 0 on success:*/
+static int autotuneIo(char *inDir, char *outDir)
+{
+   int nSizes = sizeof(g_autotuneSizes) / sizeof(g_autotuneSizes[0]);
+   size_t maxSize = g_autotuneSizes[nSizes - 1];
+   double bestRead = 0.0, bestWrite = 0.0;
+   char inName[MAX_PATH_LENGTH], outName[MAX_PATH_LENGTH];
+   char *buf;
+   int i, separate;
+
+   if ( ((size_t)snprintf(inName, sizeof(inName), "%s.lameWav2mp3-autotune.tmp", inDir) >= sizeof(inName)) ||
+        ((size_t)snprintf(outName, sizeof(outName), "%s.lameWav2mp3-autotune.tmp", outDir) >= sizeof(outName)) )
+   {
+      return -1;
+   }
+   if (NULL == (buf = malloc(maxSize)))
+   {
+      return -1;
+   }
+   memset(buf, 0x55, maxSize);
+   /*the file read back is written once:*/
+   separate = (0 != strcmp(inName, outName));
+   if ( (0 != separate) && (writeProbe(inName, buf, maxSize) < 0.0) )
+   {
+      free(buf);
+      return -1;
+   }
+   for (i = 0; i < nSizes; ++i)
+   {
+      size_t size = g_autotuneSizes[i], done;
+      double writeRate, readRate;
+      int64_t t;
+      FILE *f;
+
+      if ( (writeRate = writeProbe(outName, buf, size)) < 0.0 )
+      {
+         break;
+      }
+      if (NULL == (f = fopen(inName, "rb")))
+      {
+         break;
+      }
+      setvbuf(f, NULL, _IONBF, 0);
+      if (0 != separate)
+      {
+         /*read by the previous size:*/
+         dropFileCache(f, 0, 0, 0);
+      }
+      t = getTimeUs();
+      for (done = 0; size == fread(buf, 1, size, f); done += size)
+      {
+         ;
+      }
+      readRate = (double)done / (getTimeUs() - t + 1);
+      fclose(f);
+
+      logMsg(LOG_INFO, "autotune: %lu KB blocks: write %.1f MB/s, read %.1f MB/s\n",
+             (unsigned long)(size >> 10), writeRate, readRate);
+      if (writeRate > bestWrite)
+      {
+         bestWrite = writeRate;
+         g_writeBuffer = size;
+      }
+      if (readRate > bestRead)
+      {
+         bestRead = readRate;
+         g_blockFrames = size / PCM_BYTES(1);
+      }
+   }
+   remove(outName);
+   if (0 != separate)
+   {
+      remove(inName);
+   }
+   free(buf);
+   return (i == nSizes)? 0: -1;
+}/*autotuneIo*/
+
+/*If arg is "--name=value", returns value, otherwise NULL:*/
+static char *optionValue(char *arg, char *name)
+{
+   size_t l = strlen(name);
+   if ( (0 == strncmp(arg, name, l)) && ('=' == arg[l]) )
+   {
+      return arg + l + 1;
+   }
+   return NULL;
+}/*optionValue*/
+
+int main(int argc, char *argv[])
+{
+   int i;
+   unsigned totalWeight = 0;
+   int totalFound = 0;
+   char *journalName = NULL;
+   int resume = 0;
+   int nThreads;/*worker threads, there are none with --isolate*/
+   int autotune = 0;
+   double cpuBudget = 0.0;
+   char *lane = "bulk";
+   int wait = 0;
+   int shut = 0;
+   time_t deadline = 0;
+   double trimDb = 0.0;
+
+   for (i = 1; i < argc; ++i)
    {
-      halt(10, "usage: %s pathname\n", argv[0]);
+      char *val;
+      if ( ('-' != argv[i][0]) || ('-' != argv[i][1]) )
+      {
+         addRoot(argv[i]);
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--log")) )
+      {
+         if (0 != openLog(val))
+         {
+            halt(10, "Can't open log file '%s'\n", val);
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--log-level")) )
+      {
+         g_logLevel = atoi(val);
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--queue-memory")) )
+      {
+         int64_t budget = parseSize(val);
+         if (budget <= 0)
+         {
+            halt(10, "Wrong queue memory size '%s'\n", val);
+         }
+         g_queueBudget = (size_t)budget;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--journal")) )
+      {
+         journalName = val;
+      }
+      else if (0 == strcmp(argv[i], "--resume"))
+      {
+         resume = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--workers")) )
+      {
+         if ( 0 >= (g_nWorkers = atoi(val)) )
+         {
+            halt(10, "Wrong number of workers '%s'\n", val);
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--coordinator")) )
+      {
+         g_listenAddress = val;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--connect")) )
+      {
+         g_coordinator = val;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--lease")) )
+      {
+         g_leaseTimeout = atoi(val);
+         if (g_leaseTimeout <= REMOTE_HEARTBEAT)
+         {
+            halt(10, "The lease must be longer than %d seconds\n", REMOTE_HEARTBEAT);
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--retries")) )
+      {
+         g_maxRetries = atoi(val);
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--prefetch")) )
+      {
+         if ( 0 > (g_prefetch = atoi(val)) )
+         {
+            halt(10, "Wrong number of files to prefetch '%s'\n", val);
+         }
+      }
+      else if (0 == strcmp(argv[i], "--follow"))
+      {
+         g_follow = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--follow-idle")) )
+      {
+         if ( 0 >= (g_followIdle = atoi(val)) )
+         {
+            halt(10, "Wrong idle time '%s'\n", val);
+         }
+      }
+      else if (0 == strcmp(argv[i], "--durable"))
+      {
+         g_durable = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--durable-window")) )
+      {
+         if ( 0 > (g_durableWindow = atoi(val)) )
+         {
+            halt(10, "Wrong window '%s'\n", val);
+         }
+      }
+      else if (0 == strcmp(argv[i], "--remove-source"))
+      {
+         g_removeSource = 1;
+         g_durable = 1;
+      }
+      else if (0 == strcmp(argv[i], "--gapless"))
+      {
+         g_gapless = 1;
+      }
+      else if (0 == strcmp(argv[i], "--verify"))
+      {
+         g_verify = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--verify-snr")) )
+      {
+         g_verifySnr = atof(val);
+      }
+      else if (0 == strcmp(argv[i], "--drop-cache"))
+      {
+         g_dropCache = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--stats")) )
+      {
+         g_statsName = val;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--metrics-interval")) )
+      {
+         if ( 0 >= (g_metricsInterval = atoi(val)) )
+         {
+            halt(10, "Wrong metrics interval '%s'\n", val);
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--metrics")) )
+      {
+         g_metricsName = val;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--block")) )
+      {
+         g_blockFrames = atoi(val);
+         if ( (g_blockFrames < 1152) || (g_blockFrames > (1 << 22)) )
+         {
+            halt(10, "The block must be from 1152 to %d frames\n", 1 << 22);
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--write-buffer")) )
+      {
+         int64_t size = parseSize(val);
+         if ( (size < 0) || (size > (64 << 20)) )
+         {
+            halt(10, "Wrong write buffer size '%s'\n", val);
+         }
+         g_writeBuffer = (size_t)size;
+      }
+      else if (0 == strcmp(argv[i], "--autotune-io"))
+      {
+         autotune = 1;
+      }
+      else if (0 == strcmp(argv[i], "--hugepages"))
+      {
+         g_hugePages = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--cpu-budget")) )
+      {
+         cpuBudget = atof(val);
+         if ( (cpuBudget <= 0.0) || (cpuBudget > 1.0) )
+         {
+            halt(10, "The CPU budget must be a fraction from 0 to 1\n");
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--max-load")) )
+      {
+         if ( (g_qosTarget = atof(val)) <= 0.0 )
+         {
+            halt(10, "Wrong load '%s'\n", val);
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--deadline")) )
+      {
+         if ((time_t)-1 == (deadline = parseDeadline(val)))
+         {
+            halt(10, "Wrong deadline '%s', HH:MM or +N[s|m|h] are expected\n", val);
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--trim-silence")) )
+      {
+         char *end;
+         trimDb = -fabs(strtod(val, &end));
+         if ( (end == val) || ('\0' != *end) || (0.0 == trimDb) )
+         {
+            halt(10, "Wrong silence threshold '%s', dB like -50 is expected\n", val);
+         }
+         g_trimEnds = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--max-gap")) )
+      {
+         if ( ('\0' == *val) || (strspn(val, "0123456789") != strlen(val)) )
+         {
+            halt(10, "Wrong gap '%s', milliseconds are expected\n", val);
+         }
+         g_maxGapMs = atoi(val);
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--out-dir")) )
+      {
+         size_t l = strlen(val);
+         if ( (0 == l) || (l >= MAX_PATH_LENGTH - 1) ||
+              (NULL == (g_outDir = malloc(l + 2))) )
+         {
+            halt(10, "Wrong output directory '%s'\n", val);
+         }
+         strcpy(g_outDir, val);
+         if (SYSTEM_DIR_DELIMITER != g_outDir[l - 1])
+         {
+            g_outDir[l] = SYSTEM_DIR_DELIMITER;
+            g_outDir[l + 1] = '\0';
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--dev-writers")) )
+      {
+         if ( 0 >= (g_devWriters = atoi(val)) )
+         {
+            halt(10, "Wrong number of device writers '%s'\n", val);
+         }
+      }
+      else if (0 == strcmp(argv[i], "--idle-priority"))
+      {
+         g_idlePriority = 1;
+      }
+      else if (0 == strcmp(argv[i], "--pipeline"))
+      {
+         g_pipeline = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--readers")) )
+      {
+         if ( 0 >= (g_nReaders = atoi(val)) )
+         {
+            halt(10, "Wrong number of readers '%s'\n", val);
+         }
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--writers")) )
+      {
+         if ( 0 >= (g_nWriters = atoi(val)) )
+         {
+            halt(10, "Wrong number of writers '%s'\n", val);
+         }
+      }
+      else if (0 == strcmp(argv[i], "--isolate"))
+      {
+         g_isolate = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--server")) )
+      {
+         g_serverAddress = val;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--submit")) )
+      {
+         g_submitAddress = val;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--lane")) )
+      {
+         if ( (0 != strcmp(val, "high")) && (0 != strcmp(val, "bulk")) )
+         {
+            halt(10, "The lane must be 'high' or 'bulk'\n");
+         }
+         lane = val;
+      }
+      else if (0 == strcmp(argv[i], "--wait"))
+      {
+         wait = 1;
+      }
+      else if (0 == strcmp(argv[i], "--shutdown"))
+      {
+         shut = 1;
+      }
+      else if ( NULL != (val = optionValue(argv[i], "--trace")) )
+      {
+         if (0 != traceOpen(val))
+         {
+            halt(10, "Can't open trace file '%s'\n", val);
+         }
+      }
+      else
+      {
+         usage(argv[0]);
+      }
    }
 
-   /*Save a name of a given directory to scan as ".../
-     ( ...or \ on Windows)"*/
-   for (i = 0; '\0' != argv[1][i]; ++i)
+   if (NULL != g_submitAddress)
+   {
+      if ( (0 == g_nRoots) && (0 == shut) )
+      {
+         usage(argv[0]);
+      }
+      return submitJobs(lane, wait, shut);
+   }
+   if (NULL != g_coordinator)
    {
-      if (i >= MAX_PATH_LENGTH - 1)
+      if ( (0 != g_nRoots) || (NULL != g_listenAddress) || (NULL != journalName) )
       {
-         halt(15, "Too long path name\n");
+         halt(10, "A worker process (--connect) gets files from the coordinator only\n");
       }
-      g_pathname[i] = argv[1][i];
    }
-   g_pathnameLength = i;
-   
-   if (SYSTEM_DIR_DELIMITER != g_pathname[g_pathnameLength - 1])
+   else if ( (0 == g_nRoots) && (NULL == g_serverAddress) )
+   {
+      usage(argv[0]);
+   }
+   if ( (NULL != g_serverAddress) && ( (NULL != g_coordinator) || (NULL != g_listenAddress) ) )
+   {
+      halt(10, "--server can't be combined with --connect or --coordinator\n");
+   }
+   /*directories are scanned, lanes are not:*/
+   g_firstLane = g_nRoots;
+   if ( (0 != g_prefetch) && ( (NULL != g_coordinator) || (NULL != g_listenAddress) ) )
+   {
+      halt(10, "--prefetch works only where the files are queued and encoded\n");
+   }
+   if ( (0 != g_pipeline) &&
+        ( (NULL != g_coordinator) || (NULL != g_listenAddress) || (0 != g_isolate) ) )
+   {
+      halt(10, "--pipeline can't be combined with --connect, --coordinator or --isolate\n");
+   }
+   if ( (0 != g_follow) &&
+        ( (0 != g_pipeline) || (NULL != g_coordinator) || (NULL != g_listenAddress) ) )
+   {
+      halt(10, "--follow can't be combined with --pipeline, --connect or --coordinator\n");
+   }
+   /*the check reads the files back from the page cache:*/
+   if ( (0 != g_verify) && ( (0 != g_pipeline) || (0 != g_isolate) || (0 != g_dropCache) ) )
+   {
+      halt(10, "--verify can't be combined with --pipeline, --isolate or --drop-cache\n");
+   }
+   if ( (0 != g_gapless) &&
+        ( (0 != g_pipeline) || (0 != g_isolate) || (NULL != g_coordinator) ||
+          (NULL != g_listenAddress) || (0 != g_follow) || (0 != g_verify) ) )
+   {
+      halt(10, "--gapless can't be combined with --pipeline, --isolate, --connect,\n"
+               "--coordinator, --follow or --verify\n");
+   }
+   if ( (0 != g_durable) && ( (0 != g_isolate) || (NULL != g_coordinator) ) )
+   {
+      halt(10, "--durable and --remove-source can't be combined with --isolate or --connect\n");
+   }
+   /*a recording in progress is done after an idle timeout, it may go on:*/
+   if ( (0 != g_removeSource) && (0 != g_follow) )
+   {
+      halt(10, "--remove-source can't be combined with --follow\n");
+   }
+   if ( (0 != g_gapless) && ( (0 != g_trimEnds) || (g_maxGapMs >= 0) ) )
+   {
+      halt(10, "--gapless can't be combined with --trim-silence or --max-gap\n");
+   }
+   /*the tracks are kept until the scan of the directory ends:*/
+   if ( (0 != g_gapless) && (0 != g_queueBudget) )
+   {
+      halt(10, "--gapless can't be combined with --queue-memory\n");
+   }
+   if (0 != g_isolate)
    {
-      g_pathname[g_pathnameLength++] = SYSTEM_DIR_DELIMITER;
+      if ( (NULL != g_coordinator) || (NULL != g_listenAddress) )
+      {
+         halt(10, "--isolate can't be combined with --connect or --coordinator\n");
+      }
+      if (g_traceEnabled)
+      {
+         halt(10, "--trace can't be combined with --isolate\n");
+      }
    }
 
-   g_pathname[g_pathnameLength] = '\0';
+   if (NULL != journalName)
+   {
+      if (0 != journalOpen(journalName, resume))
+      {
+         halt(10, "Can't open journal '%s'\n", journalName);
+      }
+   }
+   else if (0 != resume)
+   {
+      halt(10, "--resume requires --journal=FILE\n");
+   }
 
    g_cpuNumber =  getCpuNumber();
+   if ( (cpuBudget > 0.0) &&
+        ( (0.0 == g_qosTarget) || (cpuBudget * g_cpuNumber < g_qosTarget) ) )
+   {
+      g_qosTarget = cpuBudget * g_cpuNumber;
+   }
+   if (g_qosTarget > 0.0)
+   {
+      if ( (NULL != g_listenAddress) || (0 != g_isolate) )
+      {
+         halt(10, "QoS can't be combined with --coordinator or --isolate\n");
+      }
+      g_idlePriority = 1;
+   }
+   if (g_maxGapMs >= 0)
+   {
+      /*the default threshold of --max-gap alone:*/
+      trimDb = (0.0 == trimDb)? TRIM_DEFAULT_DB: trimDb;
+   }
+   silenceInit(&g_silence, trimDb);
+   if ( (0 != deadline) &&
+        ( (NULL != g_coordinator) || (NULL != g_listenAddress) || (0 != g_isolate) ) )
+   {
+      halt(10, "--deadline can't be combined with --connect, --coordinator or --isolate\n");
+   }
 
-   if (0 == g_nWorkers)
+   if (NULL != g_listenAddress)
+   {
+      g_nWorkers = 0;/*the coordinator does not encode*/
+   }
+   else if (0 == g_nWorkers)
    {
       g_nWorkers = g_cpuNumber + g_cpuNumber / 2;
-   }/*else TODO: manually setting instead of hardcoding*/
+   }
+
+   /*From now on nobody waits for the console:*/
+   if (0 != startLogger())
+   {
+      halt(10, "Can't start the logger\n");
+   }
+
+   if (NULL != g_serverAddress)
+   {
+      addLanes();
+   }
+   /*the output directory is created:*/
+   initOutput();
+   if (0 != autotune)
+   {
+      if ( (0 == g_nRoots) || (g_roots[0].lane >= 0) )
+      {
+         errorMsg("Nothing to autotune, no pathname\n");
+      }
+      else
+      {
+         /*reads from the first directory, writes where .mp3 files go:*/
+         char *out = (NULL != g_outDir)? g_outDir: g_roots[0].pathname;
+         if (0 != autotuneIo(g_roots[0].pathname, out))
+         {
+            errorMsg("Can't autotune I/O in '%s' and '%s'\n", g_roots[0].pathname, out);
+         }
+         else
+         {
+            message("Autotuned: blocks of %d frames, write buffer %lu KB\n",
+                    g_blockFrames, (unsigned long)(g_writeBuffer >> 10));
+         }
+      }
+   }
+   g_mp3Size = MP3_SIZE(g_blockFrames);
+   /*Buffers of workers (encoders of the pipeline use the pools):*/
+   {
+      size_t block = ARENA_ROUND(PCM_BYTES(g_blockFrames)) + ARENA_ROUND(g_mp3Size);
+      size_t size = g_nWorkers * ARENA_ROUND(g_writeBuffer);
+      size += (0 != g_pipeline)? PIPE_BLOCKS * block: g_nWorkers * block;
+      if ( (size > 0) && (0 != arenaInit(size, g_hugePages)) )
+      {
+         halt(15, "Can't allocate %lu bytes of buffers\n", (unsigned long)size);
+      }
+      if (0 != g_hugePages)
+      {
+         message(arenaIsHuge()? "Buffers are backed by huge pages\n":
+                                "No huge pages available, buffers use normal pages\n");
+      }
+   }
 
    if ( 
         (sem_init(&g_sFileName, 0, 0) == -1)||
@@ -474,22 +4077,77 @@ int main(int argc, char *argv[])
       halt(10, "Error initialising global semaphores\n");
    }
 
-   /*We can't change the content of a directory while scanning ):*/
-   pthread_mutex_lock(&g_mEndScan);
+   /*We can't change the content of a directory while scanning ):
+     With a bounded queue the scanner may wait for workers, so they must
+     be able to finish files. Remote and isolated workers can't be
+     stopped anyway, and a worker process does not scan at all. The job
+     server queues files until SHUTDOWN.
+     Created files are .mp3, the scanner ignores them anyway:*/
+   if ( (0 == g_queueBudget) && (NULL == g_listenAddress) && (NULL == g_coordinator) &&
+        (0 == g_isolate) && (NULL == g_serverAddress) )
+   {
+      pthread_mutex_lock(&g_mEndScan);
+   }
 
-   /*TODO: qFLInit may fail*/
-   /*initialize file names queue:*/
-   txt_qFLInit(NULL, 0, &g_qFileName, QFL_REALLOC_IF_FULL);
+   for (i = 0; i < g_nRoots; ++i)
+   {
+      totalWeight += g_roots[i].weight;
+   }
+   for (i = 0; i < g_nRoots; ++i)
+   {
+      root_t *root = g_roots + i;
+      /*TODO: qFLInit may fail*/
+      /*initialize file names queue:*/
+      idx_qFLInit(NULL, 0, &root->qFileName, QFL_REALLOC_IF_FULL);
+      root->queueBudget = (size_t)( (double)g_queueBudget * root->weight / totalWeight );
+      pthread_cond_init(&root->cQueueSpace, NULL);
+   }
 
-   g_pool = malloc( g_nWorkers * sizeof(pool_t) );
+   g_pool = malloc( g_nWorkers * sizeof(pool_t) + 1 );
+   g_workers = calloc( g_nWorkers + 1, sizeof(worker_t) );
 
-   if (NULL == g_pool )
+   if ( (NULL == g_pool ) || (NULL == g_workers) )
+   {
+       halt(15, "malloc fails\n");
+   }
+   if ( (0 != g_verify) && (NULL == ptr_qFLInit(NULL, 0, &g_qVerify, QFL_REALLOC_IF_FULL)) )
    {
        halt(15, "malloc fails\n");
    }
 
-  /*start workers:*/
+   nThreads = (0 != g_isolate)? 0: g_nWorkers;
    for(i = 0; i < g_nWorkers; ++i)
+   {
+      g_workers[i].id = i;
+      g_workers[i].conn = -1;
+      if (0 == g_pipeline)
+      {
+         allocWorkerBuffers(g_workers + i);
+      }
+   }
+
+   /*Before workers, they take their counters at start:*/
+   if ( (NULL != g_metricsName) &&
+        (0 != metricsStart(g_metricsName, g_metricsInterval, queueDepth)) )
+   {
+      errorMsg("Can't start the metrics exporter\n");
+   }
+   /*the coordinator lets its workers sync:*/
+   if ( (0 != g_durable) && (NULL == g_listenAddress) &&
+        (0 != durableStart(g_durableWindow, fileSynced)) )
+   {
+      halt(20, "Can't start the syncer\n");
+   }
+
+   /*Encoders of the pipeline are the workers, so the pipeline must be
+     ready before them. The header provider waits for scanners:*/
+   if (0 != g_pipeline)
+   {
+      startPipeline();
+   }
+
+  /*start workers:*/
+   for(i = 0; i < nThreads; ++i)
    {
       if(
             pthread_create (g_pool + i,
@@ -499,35 +4157,169 @@ int main(int argc, char *argv[])
       {
          halt(20, "Can't start worker %d of %d\n", i, g_nWorkers);
       }
-   }/*for(i = 0; i < g_nWorkers; ++i)*/
+   }/*for(i = 0; i < nThreads; ++i)*/
 
    message("Waiting init\n");
 
    /*Wait when initialization finishes*/
-   for(i = g_nWorkers; i > 0; --i)
+   for(i = nThreads; i > 0; --i)
    {
       sem_wait(&g_sAllThreadsReady);
    }
+   statsStart();
+   if ( (g_qosTarget > 0.0) && (0 != qosStart(g_qosTarget, g_nWorkers)) )
+   {
+      errorMsg("Can't start QoS, the load is not available\n");
+   }
 
-   message("Everybody is ready, start scanner\n");
+   if (NULL != g_coordinator)
+   {
+      /*Worker process, nothing to scan:*/
+      for(i = 0; i < nThreads; ++i)
+      {
+         pthread_join(g_pool[i], NULL);
+      }
+      message("\nWorkers are finished\n");
+      qosStop();
+      if ( (NULL != g_metricsName) && (0 != metricsStop()) )
+      {
+         errorMsg("Can't write metrics '%s'\n", g_metricsName);
+      }
+      if ( (NULL != g_statsName) && (0 != statsWrite(g_statsName)) )
+      {
+         errorMsg("Can't write stats '%s'\n", g_statsName);
+      }
+      if (0 != traceClose())
+      {
+         errorMsg("Can't write the trace\n");
+      }
+      stopLogger();
+      return 0;
+   }
 
-   i = scanDirectory( argv[1]);
-   if ( i < 0 )
+   message("Everybody is ready, start scanners\n");
+   if (0 != deadline)
    {
-      halt(2, "Internal error\n");
+      /*before files are queued:*/
+      deadlineStart(deadline, g_nWorkers);
    }
 
-   message("%d .wav files found\n", i);
-   pthread_mutex_unlock(&g_mEndScan);
+   g_nScanning = g_firstLane + (NULL != g_serverAddress);
+   for (i = 0; i < g_firstLane; ++i)
+   {
+      if ( pthread_create(&g_roots[i].scanner, NULL, scanDirectory, g_roots + i) )
+      {
+         halt(20, "Can't start scanner %d of %d\n", i, g_firstLane);
+      }
+   }
+   if ( (NULL != g_serverAddress) && pthread_create(&g_server, NULL, serverThread, NULL) )
+   {
+      halt(20, "Can't start the job server\n");
+   }
+   if ( (0 != g_prefetch) && pthread_create(&g_prefetcher, NULL, prefetcher, NULL) )
+   {
+      halt(20, "Can't start the prefetcher\n");
+   }
+   if (NULL != g_listenAddress)
+   {
+      coordinator_t c;
+      c.nextJob = coordinatorNextJob;
+      c.jobDone = fileDone;
+      /*the workers sync each file, not in batches:*/
+      c.sync = journalIsOpen() || (0 != g_durable);
+      c.leaseTimeout = g_leaseTimeout;
+      c.maxRetries = g_maxRetries;
+      if (0 != runCoordinator(g_listenAddress, &c))
+      {
+         halt(20, "Coordinator fails\n");
+      }
+   }
+   if (0 != g_isolate)
+   {
+      isolate_t iso;
+      iso.nextJob = nextFullName;
+      iso.encode = isolatedEncode;
+      iso.jobDone = fileDone;
+      iso.crashStatus = REMOTE_FAILED;
+      iso.nWorkers = g_nWorkers;
+      if (0 != runIsolated(&iso))
+      {
+         halt(20, "Can't run isolated workers\n");
+      }
+   }
+   for (i = 0; i < g_firstLane; ++i)
+   {
+      pthread_join(g_roots[i].scanner, NULL);
+      if (g_nRoots > 1)
+      {
+         message("%d .wav files found in '%s'\n", g_roots[i].found, g_roots[i].pathname);
+      }
+      totalFound += g_roots[i].found;
+   }
+   if (NULL != g_serverAddress)
+   {
+      pthread_join(g_server, NULL);
+      for (i = g_firstLane; i < g_nRoots; ++i)
+      {
+         message("%d .wav files submitted to the %s lane\n", g_roots[i].found,
+                 (SERVER_LANE_HIGH == g_roots[i].lane)? "high": "bulk");
+         totalFound += g_roots[i].found;
+      }
+   }
+
+   if (0 == totalFound)
+   {
+      message("No files found!\n");
+   }
+   message("%d .wav files found\n", totalFound);
+   if (0 != g_totalResumed)
+   {
+      message("%u files skipped as already converted\n", g_totalResumed);
+   }
+   if ( (0 == g_queueBudget) && (NULL == g_listenAddress) && (0 == g_isolate) &&
+        (NULL == g_serverAddress) )
+   {
+      pthread_mutex_unlock(&g_mEndScan);
+   }
    /*now workers are able to write results to hard drive*/
 
    /*Wait for the job is finished:*/
-   for(i = 0; i < g_nWorkers; ++i)
+   for(i = 0; i < nThreads; ++i)
    {
       pthread_join(g_pool[i], NULL);
    }
 
+   qosStop();
+   if (0 != g_pipeline)
+   {
+      joinPipeline();
+   }
+   if (0 != g_prefetch)
+   {
+      pthread_join(g_prefetcher, NULL);
+   }
+   /*the last batch:*/
+   durableStop();
    message("\n%u files converted\n", g_totalConverted);
+   if ( (NULL != g_metricsName) && (0 != metricsStop()) )
+   {
+      errorMsg("Can't write metrics '%s'\n", g_metricsName);
+   }
+   if ( (NULL != g_statsName) && (0 != statsWrite(g_statsName)) )
+   {
+      errorMsg("Can't write stats '%s'\n", g_statsName);
+   }
+   journalClose();
+   if (0 != traceClose())
+   {
+      errorMsg("Can't write the trace\n");
+   }
+   if (NULL != g_serverAddress)
+   {
+      serverClose();
+   }
+   stopLogger();
+   fileTabFree();
    /*TODO: cleanup*/
 
    /*Well, next step... in the next life!*/
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <inttypes.h>
+#endif
+
+#include "tools.h"
+#include "metrics.h"
+
+/*Threads with their own slots, the others share the last one:*/
+#define METRICS_SLOTS 256
+/*upper bounds (seconds) of the latency buckets, the last one is +Inf:*/
+#define METRICS_BOUNDS 10
+#define METRICS_BUCKETS (METRICS_BOUNDS + 1)
+/*a slot takes whole cache lines:*/
+#define METRICS_SLOT_BYTES 256
+
+int g_metricsOn = 0;
+
+typedef struct
+{
+   int64_t value[METRIC_NUMBER];
+   int64_t bucket[METRICS_BUCKETS];/*not cumulative*/
+   int64_t latencyUs;/*sum*/
+   int64_t busyUs;/*finished pieces of work*/
+   int64_t busySince;/*us, 0 while idle*/
+   int worker;/*id + 1, 0 if it is not a worker*/
+}counters_t;
+
+typedef union
+{
+   counters_t c;
+   char line[METRICS_SLOT_BYTES];
+}slot_t;
+
+static const double l_bounds[METRICS_BOUNDS] = {0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300};
+
+static slot_t l_slots[METRICS_SLOTS];
+static int l_nSlots = 0;
+static COM_THREAD_LOCAL counters_t *l_my = NULL;
+
+static pthread_mutex_t l_mMetrics = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t l_cMetrics = PTHREAD_COND_INITIALIZER;
+static int l_stop = 0;
+static pthread_t l_exporter;
+static char *l_fileName = NULL;
+static char *l_tmpName = NULL;
+static int l_interval = 0;/*s*/
+static int (*l_queueDepth)(void) = NULL;
+static time_t l_startTime = 0;
+/*Used by the exporter only, for the utilization since the last report:*/
+static int64_t l_lastBusy[METRICS_SLOTS];
+static int64_t l_lastReport = 0;
+
+static counters_t *mySlot(void)
+{
+   if (NULL == l_my)
+   {
+      int i = COM_ATOMIC_ADD(&l_nSlots, 1);
+      if (i >= METRICS_SLOTS)
+      {
+         /*shared, updates are atomic anyway:*/
+         i = METRICS_SLOTS - 1;
+      }
+      l_my = &l_slots[i].c;
+   }
+   return l_my;
+}/*mySlot*/
+
+void metricsWorker(int id)
+{
+   if (0 != g_metricsOn)
+   {
+      COM_ATOMIC_STORE(&mySlot()->worker, id + 1);
+   }
+}/*metricsWorker*/
+
+void metricsAdd(int counter, int64_t value)
+{
+   if (0 != g_metricsOn)
+   {
+      /*the line is owned by this thread, there is no contention:*/
+      COM_ATOMIC_ADD64(&mySlot()->value[counter], value);
+   }
+}/*metricsAdd*/
+
+void metricsBusy(int busy)
+{
+   counters_t *c;
+   int64_t since;
+   if (0 == g_metricsOn)
+   {
+      return;
+   }
+   c = mySlot();
+   if (0 != busy)
+   {
+      COM_ATOMIC_STORE(&c->busySince, getTimeUs());
+      return;
+   }
+   since = c->busySince;
+   if (0 != since)
+   {
+      /*in this order the exporter may miss a piece for a moment, but
+        never counts it twice, see busyOf():*/
+      COM_ATOMIC_STORE(&c->busySince, (int64_t)0);
+      COM_ATOMIC_ADD64(&c->busyUs, getTimeUs() - since);
+   }
+}/*metricsBusy*/
+
+void metricsLatency(int64_t us)
+{
+   counters_t *c;
+   double s = us / 1e6;
+   int i;
+   if (0 == g_metricsOn)
+   {
+      return;
+   }
+   c = mySlot();
+   for (i = 0; (i < METRICS_BOUNDS) && (s > l_bounds[i]); ++i)
+   {
+      ;
+   }
+   COM_ATOMIC_ADD64(&c->bucket[i], (int64_t)1);
+   COM_ATOMIC_ADD64(&c->latencyUs, us);
+}/*metricsLatency*/
+
+/*Finished pieces first, then the current one, see metricsBusy():*/
+static int64_t busyOf(counters_t *c, int64_t now)
+{
+   int64_t busy = COM_ATOMIC_LOAD(&c->busyUs);
+   int64_t since = COM_ATOMIC_LOAD(&c->busySince);
+   if ( (0 != since) && (now > since) )
+   {
+      busy += now - since;
+   }
+   return busy;
+}/*busyOf*/
+
+static int writeReport(void)
+{
+   int nSlots = COM_ATOMIC_LOAD(&l_nSlots);
+   int64_t value[METRIC_NUMBER] = {0};
+   int64_t bucket[METRICS_BUCKETS] = {0};
+   int64_t latencyUs = 0, count = 0;
+   int64_t now = getTimeUs();
+   int64_t elapsed = now - l_lastReport;
+   int depth = (NULL != l_queueDepth)? l_queueDepth(): 0;
+   FILE *f;
+   int i, j, ret;
+
+   if (nSlots > METRICS_SLOTS)
+   {
+      nSlots = METRICS_SLOTS;
+   }
+   for (i = 0; i < nSlots; ++i)
+   {
+      counters_t *c = &l_slots[i].c;
+      for (j = 0; j < METRIC_NUMBER; ++j)
+      {
+         value[j] += COM_ATOMIC_LOAD(&c->value[j]);
+      }
+      for (j = 0; j < METRICS_BUCKETS; ++j)
+      {
+         bucket[j] += COM_ATOMIC_LOAD(&c->bucket[j]);
+      }
+      latencyUs += COM_ATOMIC_LOAD(&c->latencyUs);
+   }
+
+   if (NULL == (f = fopen(l_tmpName, "w")))
+   {
+      return -1;
+   }
+   fprintf(f, "# HELP lamewav_start_time_seconds Start of the run, unix time.\n"
+              "# TYPE lamewav_start_time_seconds gauge\n"
+              "lamewav_start_time_seconds %ld\n", (long)l_startTime);
+   fprintf(f, "# HELP lamewav_files_queued_total Files queued for encoding.\n"
+              "# TYPE lamewav_files_queued_total counter\n"
+              "lamewav_files_queued_total %" PRId64 "\n", value[METRIC_QUEUED]);
+   fprintf(f, "# HELP lamewav_files_total Finished files by result.\n"
+              "# TYPE lamewav_files_total counter\n"
+              "lamewav_files_total{result=\"converted\"} %" PRId64 "\n"
+              "lamewav_files_total{result=\"ignored\"} %" PRId64 "\n"
+              "lamewav_files_total{result=\"failed\"} %" PRId64 "\n"
+              "lamewav_files_total{result=\"skipped\"} %" PRId64 "\n",
+           value[METRIC_CONVERTED], value[METRIC_IGNORED], value[METRIC_FAILED],
+           value[METRIC_SKIPPED]);
+   fprintf(f, "# HELP lamewav_input_bytes_total PCM bytes encoded.\n"
+              "# TYPE lamewav_input_bytes_total counter\n"
+              "lamewav_input_bytes_total %" PRId64 "\n", value[METRIC_BYTES_IN]);
+   fprintf(f, "# HELP lamewav_output_bytes_total MP3 bytes written.\n"
+              "# TYPE lamewav_output_bytes_total counter\n"
+              "lamewav_output_bytes_total %" PRId64 "\n", value[METRIC_BYTES_OUT]);
+   fprintf(f, "# HELP lamewav_encode_seconds_total Time spent in the encoder.\n"
+              "# TYPE lamewav_encode_seconds_total counter\n"
+              "lamewav_encode_seconds_total %.6f\n", value[METRIC_ENCODE_US] / 1e6);
+   fprintf(f, "# HELP lamewav_queue_depth Files waiting in the queues.\n"
+              "# TYPE lamewav_queue_depth gauge\n"
+              "lamewav_queue_depth %d\n", depth);
+
+   fprintf(f, "# HELP lamewav_worker_busy_seconds_total Time a worker had work.\n"
+              "# TYPE lamewav_worker_busy_seconds_total counter\n");
+   for (i = 0; i < nSlots; ++i)
+   {
+      counters_t *c = &l_slots[i].c;
+      int worker = COM_ATOMIC_LOAD(&c->worker);
+      if (0 != worker)
+      {
+         int64_t busy = busyOf(c, now);
+         /*a counter never goes back:*/
+         busy = (busy < l_lastBusy[i])? l_lastBusy[i]: busy;
+         fprintf(f, "lamewav_worker_busy_seconds_total{worker=\"%d\"} %.6f\n",
+                 worker - 1, busy / 1e6);
+      }
+   }
+   fprintf(f, "# HELP lamewav_worker_utilization Share of the last interval a worker had work.\n"
+              "# TYPE lamewav_worker_utilization gauge\n");
+   for (i = 0; i < nSlots; ++i)
+   {
+      counters_t *c = &l_slots[i].c;
+      int worker = COM_ATOMIC_LOAD(&c->worker);
+      if (0 != worker)
+      {
+         int64_t busy = busyOf(c, now);
+         double u;
+         busy = (busy < l_lastBusy[i])? l_lastBusy[i]: busy;
+         u = (elapsed > 0)? (double)(busy - l_lastBusy[i]) / elapsed: 0.0;
+         fprintf(f, "lamewav_worker_utilization{worker=\"%d\"} %.3f\n",
+                 worker - 1, (u > 1.0)? 1.0: u);
+         l_lastBusy[i] = busy;
+      }
+   }
+
+   fprintf(f, "# HELP lamewav_file_latency_seconds From taking a file to its completion.\n"
+              "# TYPE lamewav_file_latency_seconds histogram\n");
+   for (j = 0; j < METRICS_BUCKETS; ++j)
+   {
+      count += bucket[j];
+      if (j < METRICS_BOUNDS)
+      {
+         fprintf(f, "lamewav_file_latency_seconds_bucket{le=\"%g\"} %" PRId64 "\n",
+                 l_bounds[j], count);
+      }
+      else
+      {
+         fprintf(f, "lamewav_file_latency_seconds_bucket{le=\"+Inf\"} %" PRId64 "\n", count);
+      }
+   }
+   fprintf(f, "lamewav_file_latency_seconds_sum %.6f\n", latencyUs / 1e6);
+   fprintf(f, "lamewav_file_latency_seconds_count %" PRId64 "\n", count);
+   l_lastReport = now;
+
+   ret = ferror(f);
+   if (0 != fclose(f))
+   {
+      ret = -1;
+   }
+   if (0 != ret)
+   {
+      remove(l_tmpName);
+      return -1;
+   }
+#ifdef _WIN32
+   /*rename() does not replace there:*/
+   remove(l_fileName);
+#endif
+   return rename(l_tmpName, l_fileName);
+}/*writeReport*/
+
+static void *metricsExporter(void *unused)
+{
+   pthread_mutex_lock(&l_mMetrics);
+   while (0 == l_stop)
+   {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += l_interval;
+      while ( (0 == l_stop) &&
+              (0 == pthread_cond_timedwait(&l_cMetrics, &l_mMetrics, &ts)) )
+      {
+         ;
+      }
+      if (0 != l_stop)
+      {
+         break;
+      }
+      pthread_mutex_unlock(&l_mMetrics);
+      if (0 != writeReport())
+      {
+         logMsg(LOG_WARNING, "Can't write metrics '%s'\n", l_fileName);
+      }
+      pthread_mutex_lock(&l_mMetrics);
+   }
+   pthread_mutex_unlock(&l_mMetrics);
+   return NULL;
+}/*metricsExporter*/
+
+int metricsStart(char *fileName, int intervalSec, int (*queueDepth)(void))
+{
+   size_t l = strlen(fileName);
+   if (NULL == (l_tmpName = malloc(l + sizeof(".tmp"))))
+   {
+      return -1;
+   }
+   strcpy(l_tmpName, fileName);
+   strcpy(l_tmpName + l, ".tmp");
+   l_fileName = fileName;
+   l_interval = (intervalSec > 0)? intervalSec: 1;
+   l_queueDepth = queueDepth;
+   l_startTime = time(NULL);
+   l_lastReport = getTimeUs();
+   l_stop = 0;
+   /*before the exporter, so workers take their slots:*/
+   g_metricsOn = 1;
+   if (pthread_create(&l_exporter, NULL, metricsExporter, NULL))
+   {
+      g_metricsOn = 0;
+      free(l_tmpName);
+      l_tmpName = NULL;
+      return -1;
+   }
+   return 0;
+}/*metricsStart*/
+
+int metricsStop(void)
+{
+   int ret;
+   if (0 == g_metricsOn)
+   {
+      return 0;
+   }
+   pthread_mutex_lock(&l_mMetrics);
+   l_stop = 1;
+   pthread_cond_signal(&l_cMetrics);
+   pthread_mutex_unlock(&l_mMetrics);
+   pthread_join(l_exporter, NULL);
+   ret = writeReport();
+   g_metricsOn = 0;
+   free(l_tmpName);
+   l_tmpName = NULL;
+   return ret;
+}/*metricsStop*/
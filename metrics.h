@@ -0,0 +1,64 @@
+#ifndef METRICS_H
+#define METRICS_H 1
+
+/*
+  Live metrics of a long run (see --metrics): a file in the Prometheus
+  text format for the textfile collector of node_exporter, rewritten
+  every interval and at the end.
+
+  Counters live in per-thread slots: a thread takes a slot at its first
+  update and then is the only one writing it, so the hot path takes no
+  lock and shares no cache line. The exporter thread sums the slots. A
+  report is written into "FILE.tmp" and renamed over FILE, so the
+  collector never reads a half written file.
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!0 while the exporter runs:*/
+extern int g_metricsOn;
+
+enum
+{
+   METRIC_QUEUED,/*files*/
+   METRIC_CONVERTED,
+   METRIC_IGNORED,/*not a supported PCM*/
+   METRIC_FAILED,
+   METRIC_SKIPPED,/*already converted, see --resume*/
+   METRIC_BYTES_IN,/*PCM encoded*/
+   METRIC_BYTES_OUT,/*MP3 written*/
+   METRIC_ENCODE_US,/*in the encoder*/
+   METRIC_NUMBER
+};
+
+/*Starts the exporter. queueDepth is called by the exporter thread to
+  count queued files. Returns 0 on success:*/
+int metricsStart(char *fileName, int intervalSec, int (*queueDepth)(void));
+
+/*Writes the last report and stops the exporter. Returns 0 if the file
+  was written:*/
+int metricsStop(void);
+
+/*The calling thread is the worker id, see metricsBusy():*/
+void metricsWorker(int id);
+
+/*Adds value to counter (METRIC_x) of the calling thread:*/
+void metricsAdd(int counter, int64_t value);
+
+/*The worker starts (busy != 0) or ends a piece of work; the share of the
+  time between them is its utilization:*/
+void metricsBusy(int busy);
+
+/*Records the latency of a converted file, from taking it to its
+  completion:*/
+void metricsLatency(int64_t us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
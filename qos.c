@@ -0,0 +1,310 @@
+#ifdef __linux__
+/*SCHED_IDLE:*/
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "tools.h"
+#include "qos.h"
+
+int g_qosOn = 0;
+
+#ifdef __linux__
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/*ms between samples:*/
+#define QOS_PERIOD 500
+/*percents of "some avg10" of the CPU pressure when the batch backs off.
+  Our own workers stall each other as well, so the pressure counts only
+  while others use at least QOS_OTHERS CPUs:*/
+#define QOS_PSI_LIMIT 10.0
+#define QOS_OTHERS 0.5
+
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+static pthread_mutex_t l_mQos = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t l_cQos = PTHREAD_COND_INITIALIZER;
+/*all protected by l_mQos:*/
+static int l_allowed = 0;
+static int l_running = 0;/*workers neither paused nor finished*/
+static char *l_paused = NULL;/*by worker id*/
+static int l_stop = 0;
+static int l_nWorkers = 0;
+static double l_target = 0.0;
+static pthread_t l_monitor;
+
+/*Jiffies of the host: busy and total. Returns 0 on success:*/
+static int readProcStat(double *busy, double *total)
+{
+   unsigned long long v[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+   int i, n;
+   FILE *f = fopen("/proc/stat", "r");
+   if (NULL == f)
+   {
+      return -1;
+   }
+   /*user nice system idle iowait irq softirq steal:*/
+   n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+              v, v + 1, v + 2, v + 3, v + 4, v + 5, v + 6, v + 7);
+   fclose(f);
+   if (n < 4)
+   {
+      return -1;
+   }
+   *total = 0;
+   for (i = 0; i < 8; ++i)
+   {
+      *total += v[i];
+   }
+   *busy = *total - v[3] - v[4];
+   return 0;
+}/*readProcStat*/
+
+/*"some avg10" of /proc/pressure/cpu, 0 if not available:*/
+static double readCpuPressure(void)
+{
+   double avg10 = 0.0;
+   FILE *f = fopen("/proc/pressure/cpu", "r");
+   if (NULL != f)
+   {
+      if (1 != fscanf(f, "some avg10=%lf", &avg10))
+      {
+         avg10 = 0.0;
+      }
+      fclose(f);
+   }
+   return avg10;
+}/*readCpuPressure*/
+
+/*CPU seconds of this process:*/
+static double selfCpu(void)
+{
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+          (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}/*selfCpu*/
+
+static void *qosMonitor(void *unused)
+{
+   int nCpu = getCpuNumber();
+   double busy0, total0, self0 = selfCpu();
+   int64_t t0 = getTimeUs();
+
+   if (0 != readProcStat(&busy0, &total0))
+   {
+      return NULL;
+   }
+   for(;;)
+   {
+      double busy, total, self, host, others, pressure;
+      int64_t t;
+      int allowed;
+
+      msleep(QOS_PERIOD);
+      if ( (0 != readProcStat(&busy, &total)) || (total <= total0) )
+      {
+         continue;
+      }
+      self = selfCpu();
+      t = getTimeUs();
+      host = (busy - busy0) / (total - total0) * nCpu;
+      others = host - (self - self0) * 1e6 / (t - t0 + 1);
+      if (others < 0)
+      {
+         others = 0;
+      }
+      pressure = readCpuPressure();
+      busy0 = busy;
+      total0 = total;
+      self0 = self;
+      t0 = t;
+
+      pthread_mutex_lock(&l_mQos);
+      if (l_stop)
+      {
+         pthread_mutex_unlock(&l_mQos);
+         break;
+      }
+      allowed = (int)(l_target - others + 0.5);
+      /*grow slowly, shrink at once:*/
+      if (allowed > l_allowed)
+      {
+         allowed = l_allowed + 1;
+      }
+      if ( (pressure > QOS_PSI_LIMIT) && (others >= QOS_OTHERS) &&
+           (allowed >= l_allowed) )
+      {
+         allowed = l_allowed - 1;
+      }
+      if (allowed < 1)
+      {
+         allowed = 1;
+      }
+      if (allowed > l_nWorkers)
+      {
+         allowed = l_nWorkers;
+      }
+      if (allowed != l_allowed)
+      {
+         logMsg(LOG_DEBUG, "QoS: %d workers (others use %.1f CPU, pressure %.1f%%)\n",
+                allowed, others, pressure);
+         l_allowed = allowed;
+         pthread_cond_broadcast(&l_cQos);
+      }
+      pthread_mutex_unlock(&l_mQos);
+   }
+   return NULL;
+}/*qosMonitor*/
+
+int qosStart(double targetCpus, int nWorkers)
+{
+   double busy, total;
+   if (0 != readProcStat(&busy, &total))
+   {
+      return -1;
+   }
+   if ( NULL == (l_paused = calloc(nWorkers + 1, 1)) )
+   {
+      return -1;
+   }
+   l_target = targetCpus;
+   l_nWorkers = nWorkers;
+   l_running = nWorkers;
+   /*start low, the monitor lets the batch grow:*/
+   l_allowed = 1;
+   l_stop = 0;
+   if (pthread_create(&l_monitor, NULL, qosMonitor, NULL))
+   {
+      free(l_paused);
+      l_paused = NULL;
+      return -1;
+   }
+   g_qosOn = 1;
+   return 0;
+}/*qosStart*/
+
+void qosStop(void)
+{
+   if (0 == g_qosOn)
+   {
+      return;
+   }
+   pthread_mutex_lock(&l_mQos);
+   l_stop = 1;
+   /*release everybody:*/
+   l_allowed = l_nWorkers;
+   pthread_cond_broadcast(&l_cQos);
+   pthread_mutex_unlock(&l_mQos);
+   pthread_join(l_monitor, NULL);
+   g_qosOn = 0;
+   free(l_paused);
+   l_paused = NULL;
+}/*qosStop*/
+
+int qosWait(int workerId, int timeoutMs)
+{
+   struct timespec ts;
+   int ret;
+
+   pthread_mutex_lock(&l_mQos);
+   if ( (0 == l_paused[workerId]) && (l_running > l_allowed) )
+   {
+      l_paused[workerId] = 1;
+      --l_running;
+   }
+   if (0 != l_paused[workerId])
+   {
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += timeoutMs / 1000;
+      ts.tv_nsec += (timeoutMs % 1000) * 1000000L;
+      if (ts.tv_nsec >= 1000000000L)
+      {
+         ts.tv_nsec -= 1000000000L;
+         ++ts.tv_sec;
+      }
+      while ( (l_running >= l_allowed) &&
+              (0 == pthread_cond_timedwait(&l_cQos, &l_mQos, &ts)) )
+      {
+         ;
+      }
+      if (l_running < l_allowed)
+      {
+         l_paused[workerId] = 0;
+         ++l_running;
+      }
+   }
+   ret = l_paused[workerId];
+   pthread_mutex_unlock(&l_mQos);
+   return ret;
+}/*qosWait*/
+
+void qosDone(int workerId)
+{
+   if (0 == g_qosOn)
+   {
+      return;
+   }
+   pthread_mutex_lock(&l_mQos);
+   if (0 == l_paused[workerId])
+   {
+      --l_running;
+      /*a paused one may take the place:*/
+      pthread_cond_broadcast(&l_cQos);
+   }
+   l_paused[workerId] = 1;
+   pthread_mutex_unlock(&l_mQos);
+}/*qosDone*/
+
+int qosIdlePriority(void)
+{
+   struct sched_param sp;
+   int ret;
+
+   memset(&sp, 0, sizeof(sp));
+   ret = pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+   /*0 is the calling thread:*/
+   if (0 != syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                    IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT))
+   {
+      ret = -1;
+   }
+   return ret;
+}/*qosIdlePriority*/
+
+#else /*__linux__*/
+
+int qosStart(double targetCpus, int nWorkers)
+{
+   return -1;
+}/*qosStart*/
+
+void qosStop(void)
+{
+}/*qosStop*/
+
+int qosWait(int workerId, int timeoutMs)
+{
+   return 0;
+}/*qosWait*/
+
+void qosDone(int workerId)
+{
+}/*qosDone*/
+
+int qosIdlePriority(void)
+{
+   return -1;
+}/*qosIdlePriority*/
+
+#endif
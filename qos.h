@@ -0,0 +1,51 @@
+#ifndef QOS_H
+#define QOS_H 1
+
+/*
+  Load-aware throttling of workers (QoS), so that encoding may share a
+  host with latency sensitive services.
+
+  The monitor thread samples the CPU utilization of the host
+  (/proc/stat) and of this process, and the CPU pressure stall
+  information (/proc/pressure/cpu). The CPUs used by others are
+  subtracted from the target, what remains is the number of workers
+  allowed to run. So the batch grows into idle capacity (by one worker
+  per period) and shrinks at once when others need the CPU or tasks
+  begin to stall.
+
+  Workers check the gate between blocks: while more workers run than
+  allowed, the one checking pauses until there is a place. At least one
+  worker always runs.
+
+  Linux only.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!0 while the monitor runs:*/
+extern int g_qosOn;
+
+/*Starts the monitor. targetCpus is the load of the whole host (in CPUs)
+  the batch may fill up to. Returns 0 on success:*/
+int qosStart(double targetCpus, int nWorkers);
+
+void qosStop(void);
+
+/*Waits until the worker is allowed to run, but not longer than
+  timeoutMs. Returns 0 if it is allowed, otherwise !0:*/
+int qosWait(int workerId, int timeoutMs);
+
+/*The worker is finished, it gives its place to a paused one:*/
+void qosDone(int workerId);
+
+/*Moves the calling thread to SCHED_IDLE and the idle I/O class. Returns
+  0 on success:*/
+int qosIdlePriority(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
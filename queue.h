@@ -34,6 +34,8 @@
   qFLIsEmpty -- chech whether a queue is empty;
   qFLReset -- empty the queue without destroying it;
   qFLPop -- extract one element from the queue;
+  qFLLength -- number of elements in the queue;
+  qFLPeek -- get i-th element to be popped without extracting it;
   qFLPushFifo -- put a new element to the FIFO queue;
   qFLPushLifo -- put a new element to the LIFO queue.
 
@@ -296,6 +298,29 @@ QFL_TYPE DECLARE1(qFLPop)(DECLARE2(qFL,_t) *theFL)
    return ret;
 }/*qFLPop*/
 
+/*Returns the number of elements in the queue:*/
+static QFL_INLINE 
+FL_INT DECLARE1(qFLLength)(DECLARE2(qFL,_t) *theFL)
+{
+   FL_INT n = theFL->head - theFL->tail;
+   if(n < 0)
+      n += theFL->len;
+   return n;
+}/*qFLLength*/
+
+/*Returns the element which will be popped after i other ones (so i==0
+  is the next one) or QFL_NULL if the queue is shorter:*/
+static QFL_INLINE 
+QFL_TYPE DECLARE1(qFLPeek)(DECLARE2(qFL,_t) *theFL, FL_INT i)
+{
+   if( (i < 0) || (i >= DECLARE1(qFLLength)(theFL)) )
+      return QFL_NULL;
+   i += theFL->tail;
+   if(i >= theFL->len)
+      i -= theFL->len;
+   return theFL->scratch[i];
+}/*qFLPeek*/
+
 /*Initializes the queue theFL. If it is NULL, allocates it.
   If scratch==NULL, allocates the scratch, otherwise, use the given array.
   DO NOT CALL destroy, DO NOT USE isFixed == 0 for the external array!
@@ -0,0 +1,844 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <pthread.h>
+
+#include "remote.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define REMOTE_LINE (MAX_PATH_LENGTH + 64)
+#define REMOTE_MAX_CONN 1024
+/*ms, how often parked GETs are retried while the queues are empty:*/
+#define REMOTE_POLL 50
+
+typedef struct rjob_struct
+{
+   struct rjob_struct *next;
+   char *fileName;
+   unsigned id;
+   int retries;
+}rjob_t;
+
+typedef struct
+{
+   int fd;
+   char buf[REMOTE_LINE];
+   int len;
+   int waiting;/*GET is not answered yet*/
+   rjob_t *lease;
+   int64_t deadline;
+}rconn_t;
+
+/*"unix:PATH" or "HOST:PORT". Returns a listening (isServer) or
+  connected socket, or -1:*/
+static int openSocket(char *address, int isServer)
+{
+   int fd = -1;
+
+   if (0 == strncmp(address, "unix:", 5))
+   {
+      struct sockaddr_un sa;
+      memset(&sa, 0, sizeof(sa));
+      sa.sun_family = AF_UNIX;
+      if (strlen(address + 5) >= sizeof(sa.sun_path))
+      {
+         return -1;
+      }
+      strcpy(sa.sun_path, address + 5);
+      if (-1 == (fd = socket(AF_UNIX, SOCK_STREAM, 0)))
+      {
+         return -1;
+      }
+      if (isServer)
+      {
+         unlink(sa.sun_path);
+         if ( (0 != bind(fd, (struct sockaddr*)&sa, sizeof(sa))) || (0 != listen(fd, 128)) )
+         {
+            close(fd);
+            return -1;
+         }
+      }
+      else if (0 != connect(fd, (struct sockaddr*)&sa, sizeof(sa)))
+      {
+         close(fd);
+         return -1;
+      }
+      return fd;
+   }
+   else
+   {
+      char host[256];
+      char *port = strrchr(address, ':');
+      struct addrinfo hints, *res, *ai;
+      int one = 1;
+
+      if ( (NULL == port) || (port - address >= (int)sizeof(host)) )
+      {
+         return -1;
+      }
+      memcpy(host, address, port - address);
+      host[port - address] = '\0';
+      ++port;
+
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      if (isServer)
+      {
+         hints.ai_flags = AI_PASSIVE;
+      }
+      if (0 != getaddrinfo( (isServer && ( ('\0' == *host) || (0 == strcmp(host, "*")) ))? NULL: host,
+                            port, &hints, &res))
+      {
+         return -1;
+      }
+      for (ai = res; NULL != ai; ai = ai->ai_next)
+      {
+         if (-1 == (fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)))
+         {
+            continue;
+         }
+         if (isServer)
+         {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if ( (0 == bind(fd, ai->ai_addr, ai->ai_addrlen)) && (0 == listen(fd, 128)) )
+            {
+               break;
+            }
+         }
+         else if (0 == connect(fd, ai->ai_addr, ai->ai_addrlen))
+         {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+         }
+         close(fd);
+         fd = -1;
+      }
+      freeaddrinfo(res);
+      return fd;
+   }
+}/*openSocket*/
+
+static int sendLine(int fd, char *fmt, ...)
+{
+   char line[REMOTE_LINE];
+   int n, sent = 0;
+   va_list arg_ptr;
+
+   va_start (arg_ptr, fmt);
+   n = vsnprintf(line, sizeof(line), fmt, arg_ptr);
+   va_end (arg_ptr);
+   if ( (n < 0) || (n >= (int)sizeof(line)) )
+   {
+      return -1;
+   }
+   while (sent < n)
+   {
+      ssize_t k = send(fd, line + sent, n - sent, MSG_NOSIGNAL);
+      if (k < 0)
+      {
+         if (EINTR == errno)
+         {
+            continue;
+         }
+         return -1;
+      }
+      sent += k;
+   }
+   return 0;
+}/*sendLine*/
+
+/*Blocking read of one line without '\n'. Peeks first, so nothing after
+  the line is consumed. Returns 0 on success, -1 on error or EOF:*/
+static int readLine(int fd, char *line, int size)
+{
+   int len = 0;
+   for (;;)
+   {
+      char *nl;
+      ssize_t k = recv(fd, line + len, size - 1 - len, MSG_PEEK);
+      if (k <= 0)
+      {
+         if ( (k < 0) && (EINTR == errno) )
+         {
+            continue;
+         }
+         return -1;
+      }
+      line[len + k] = '\0';
+      nl = strchr(line + len, '\n');
+      if (NULL != nl)
+      {
+         k = nl - (line + len) + 1;
+      }
+      /*consume what we have looked at:*/
+      if (recv(fd, line + len, k, 0) != k)
+      {
+         return -1;
+      }
+      len += k;
+      if (NULL != nl)
+      {
+         line[len - 1] = '\0';
+         return 0;
+      }
+      if (len >= size - 1)
+      {
+         return -1;/*too long*/
+      }
+   }
+}/*readLine*/
+
+/*Puts the job back or gives up:*/
+static void requeueJob(coordinator_t *c, rjob_t *job, rjob_t **first, rjob_t **last)
+{
+   if (++job->retries > c->maxRetries)
+   {
+      errorMsg("File '%s': failed on %d workers, give up\n", job->fileName, job->retries);
+      c->jobDone(job->fileName, REMOTE_FAILED);
+      free(job->fileName);
+      free(job);
+      return;
+   }
+   message("File '%s': the worker is lost, retry\n", job->fileName);
+   job->next = NULL;
+   if (NULL == *last)
+   {
+      *first = job;
+   }
+   else
+   {
+      (*last)->next = job;
+   }
+   *last = job;
+}/*requeueJob*/
+
+/*Drops the connection, its job (if any) goes back to the queue:*/
+static void dropConn(coordinator_t *c, rconn_t *conn, rjob_t **first, rjob_t **last, int *nLeases)
+{
+   close(conn->fd);
+   conn->fd = -1;
+   conn->waiting = 0;
+   if (NULL != conn->lease)
+   {
+      requeueJob(c, conn->lease, first, last);
+      conn->lease = NULL;
+      --(*nLeases);
+   }
+}/*dropConn*/
+
+/*Handles one line from a worker. Returns -1 if the connection must be dropped:*/
+static int handleLine(coordinator_t *c, rconn_t *conn, char *line, int *nLeases)
+{
+   unsigned id;
+   int status;
+
+   if (0 == strcmp(line, "GET"))
+   {
+      conn->waiting = 1;
+   }
+   else if (0 == strcmp(line, "HB"))
+   {
+      if (NULL != conn->lease)
+      {
+         conn->deadline = getTimeUs() + (int64_t)c->leaseTimeout * 1000000;
+      }
+   }
+   else if (2 == sscanf(line, "DONE %u %d", &id, &status))
+   {
+      if ( (NULL == conn->lease) || (id != conn->lease->id) )
+      {
+         return 0;/*the lease has expired, the job is given to another one*/
+      }
+      c->jobDone(conn->lease->fileName, status);
+      free(conn->lease->fileName);
+      free(conn->lease);
+      conn->lease = NULL;
+      --(*nLeases);
+   }
+   else
+   {
+      errorMsg("Coordinator: wrong request '%s'\n", line);
+      return -1;
+   }
+   return 0;
+}/*handleLine*/
+
+int runCoordinator(char *address, coordinator_t *c)
+{
+   static rconn_t *conns[REMOTE_MAX_CONN];
+   static struct pollfd pfd[REMOTE_MAX_CONN + 1];
+   int nConns = 0, nLeases = 0, isOver = 0;
+   unsigned nextId = 0;
+   rjob_t *retryFirst = NULL, *retryLast = NULL;
+   int i, lfd = openSocket(address, 1);
+
+   if (lfd < 0)
+   {
+      errorMsg("Coordinator: can't listen on '%s'\n", address);
+      return -1;
+   }
+   signal(SIGPIPE, SIG_IGN);
+   message("Coordinator: listening on '%s'\n", address);
+
+   for(;;)
+   {
+      int nWaiting = 0, nPoll;
+      int64_t now;
+
+      /*Answer parked GETs:*/
+      for (i = 0; i < nConns; ++i)
+      {
+         rconn_t *conn = conns[i];
+         rjob_t *job = NULL;
+         if (!conn->waiting)
+         {
+            continue;
+         }
+         if (NULL != retryFirst)
+         {
+            job = retryFirst;
+            if (NULL == (retryFirst = job->next))
+            {
+               retryLast = NULL;
+            }
+         }
+         else if (!isOver)
+         {
+            char *fileName = c->nextJob(&isOver);
+            if (NULL != fileName)
+            {
+               if (NULL == (job = calloc(1, sizeof(rjob_t))))
+               {
+                  halt(15, "malloc fails\n");
+               }
+               job->fileName = fileName;
+               job->id = nextId++;
+            }
+         }
+         if (NULL != job)
+         {
+            conn->waiting = 0;
+            conn->lease = job;
+            conn->deadline = getTimeUs() + (int64_t)c->leaseTimeout * 1000000;
+            ++nLeases;
+            if (0 != sendLine(conn->fd, "JOB %u %d %s\n", job->id, c->sync, job->fileName))
+            {
+               dropConn(c, conn, &retryFirst, &retryLast, &nLeases);
+            }
+         }
+         else
+         {
+            /*Keep it even if the queues are over: a lease may expire:*/
+            ++nWaiting;
+         }
+      }
+
+      if ( isOver && (NULL == retryFirst) && (0 == nLeases) )
+      {
+         break;
+      }
+
+      /*Remove dropped connections:*/
+      for (i = 0; i < nConns; )
+      {
+         if (conns[i]->fd < 0)
+         {
+            free(conns[i]);
+            conns[i] = conns[--nConns];
+         }
+         else
+         {
+            ++i;
+         }
+      }
+
+      pfd[0].fd = lfd;
+      pfd[0].events = POLLIN;
+      for (i = 0; i < nConns; ++i)
+      {
+         pfd[i + 1].fd = conns[i]->fd;
+         pfd[i + 1].events = POLLIN;
+      }
+      nPoll = poll(pfd, nConns + 1, (0 != nWaiting)? REMOTE_POLL: 1000);
+      if ( (nPoll < 0) && (EINTR != errno) )
+      {
+         errorMsg("Coordinator: poll fails\n");
+         break;
+      }
+
+      for (i = 0; (nPoll > 0) && (i < nConns); ++i)
+      {
+         rconn_t *conn = conns[i];
+         ssize_t k;
+         char *nl;
+         if (0 == pfd[i + 1].revents)
+         {
+            continue;
+         }
+         k = recv(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - 1 - conn->len, 0);
+         if (k <= 0)
+         {
+            dropConn(c, conn, &retryFirst, &retryLast, &nLeases);
+            continue;
+         }
+         conn->len += k;
+         conn->buf[conn->len] = '\0';
+         while (NULL != (nl = strchr(conn->buf, '\n')))
+         {
+            *nl = '\0';
+            if (0 != handleLine(c, conn, conn->buf, &nLeases))
+            {
+               dropConn(c, conn, &retryFirst, &retryLast, &nLeases);
+               break;
+            }
+            conn->len -= nl + 1 - conn->buf;
+            memmove(conn->buf, nl + 1, conn->len + 1);
+         }
+         if ( (conn->fd >= 0) && (conn->len >= (int)sizeof(conn->buf) - 1) )
+         {
+            dropConn(c, conn, &retryFirst, &retryLast, &nLeases);
+         }
+      }
+
+      if ( (nPoll > 0) && (0 != (pfd[0].revents & POLLIN)) )
+      {
+         int fd = accept(lfd, NULL, NULL);
+         if (fd >= 0)
+         {
+            rconn_t *conn;
+            if ( (nConns >= REMOTE_MAX_CONN) || (NULL == (conn = calloc(1, sizeof(rconn_t)))) )
+            {
+               close(fd);
+            }
+            else
+            {
+               conn->fd = fd;
+               conns[nConns++] = conn;
+            }
+         }
+      }
+
+      /*Expired leases, the worker is considered dead:*/
+      now = getTimeUs();
+      for (i = 0; i < nConns; ++i)
+      {
+         if ( (conns[i]->fd >= 0) && (NULL != conns[i]->lease) && (now > conns[i]->deadline) )
+         {
+            dropConn(c, conns[i], &retryFirst, &retryLast, &nLeases);
+         }
+      }
+   }/*for(;;)*/
+
+   for (i = 0; i < nConns; ++i)
+   {
+      if (conns[i]->fd >= 0)
+      {
+         /*No leases, so it has sent or is about to send a GET:*/
+         sendLine(conns[i]->fd, "BYE\n");
+         close(conns[i]->fd);
+      }
+      free(conns[i]);
+   }
+   close(lfd);
+   if (0 == strncmp(address, "unix:", 5))
+   {
+      unlink(address + 5);
+   }
+   return 0;
+}/*runCoordinator*/
+
+int remoteConnect(char *address)
+{
+   signal(SIGPIPE, SIG_IGN);
+   return openSocket(address, 0);
+}/*remoteConnect*/
+
+void remoteClose(int conn)
+{
+   close(conn);
+}/*remoteClose*/
+
+int remoteGetJob(int conn, char *fileName, unsigned *id, int *sync)
+{
+   char line[REMOTE_LINE];
+   int n = 0;
+
+   if ( (0 != sendLine(conn, "GET\n")) || (0 != readLine(conn, line, sizeof(line))) )
+   {
+      return -1;
+   }
+   if (0 == strcmp(line, "BYE"))
+   {
+      return 0;
+   }
+   if ( (2 != sscanf(line, "JOB %u %d %n", id, sync, &n)) || (0 == n) ||
+        (strlen(line + n) >= MAX_PATH_LENGTH) )
+   {
+      return -1;
+   }
+   strcpy(fileName, line + n);
+   return 1;
+}/*remoteGetJob*/
+
+int remoteJobDone(int conn, unsigned id, int status)
+{
+   return sendLine(conn, "DONE %u %d\n", id, status);
+}/*remoteJobDone*/
+
+int remoteHeartbeat(int conn)
+{
+   return sendLine(conn, "HB\n");
+}/*remoteHeartbeat*/
+
+int remoteRequest(int conn, char *reply, int size, char *fmt, ...)
+{
+   char line[REMOTE_LINE];
+   int n;
+   va_list arg_ptr;
+
+   *reply = '\0';
+   va_start (arg_ptr, fmt);
+   n = vsnprintf(line, sizeof(line) - 1, fmt, arg_ptr);
+   va_end (arg_ptr);
+   if ( (n < 0) || (n >= (int)sizeof(line) - 1) )
+   {
+      return -1;
+   }
+   strcpy(line + n, "\n");
+   if ( (0 != sendLine(conn, "%s", line)) || (0 != readLine(conn, reply, size)) )
+   {
+      return -1;
+   }
+   return 0;
+}/*remoteRequest*/
+
+/*Job server. Jobs are kept in a list; finished ones are kept for late
+  WAITs, only the last SERVER_DONE_JOBS of them:*/
+#define SERVER_DONE_JOBS 1024
+/*ms, serverClose() waits for answers to WAITs:*/
+#define SERVER_CLOSE_WAIT 1000
+
+typedef struct sjob_struct
+{
+   struct sjob_struct *next;
+   unsigned id;
+   int submitted;/*submit() has returned*/
+   int left;/*files not finished yet*/
+   int counts[3];/*converted, ignored and failed*/
+}sjob_t;
+
+static pthread_mutex_t l_mServer = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t l_cServer = PTHREAD_COND_INITIALIZER;
+/*all protected by l_mServer:*/
+static sjob_t *l_jobs = NULL;/*the newest first*/
+static unsigned l_lastJob = 0;
+static int l_nDone = 0;
+static int l_nWaiting = 0;/*clients in WAIT*/
+static int l_nSubmitting = 0;/*submit() calls in progress*/
+static int l_shutdown = 0;
+static server_t *l_server = NULL;
+static int l_listenFd = -1;
+
+static sjob_t *findJob(unsigned id)
+{
+   sjob_t *job;
+   for (job = l_jobs; (NULL != job) && (job->id != id); job = job->next)
+   {
+      ;
+   }
+   return job;
+}/*findJob*/
+
+static int jobIsDone(sjob_t *job)
+{
+   return job->submitted && (0 == job->left);
+}/*jobIsDone*/
+
+/*Must be called with l_mServer locked when the job becomes done:*/
+static void jobDone(void)
+{
+   sjob_t **pp, **oldest = NULL;
+
+   pthread_cond_broadcast(&l_cServer);
+   if (++l_nDone <= SERVER_DONE_JOBS)
+   {
+      return;
+   }
+   /*forget the oldest finished one, the list is the newest first:*/
+   for (pp = &l_jobs; NULL != *pp; pp = &(*pp)->next)
+   {
+      if (jobIsDone(*pp))
+      {
+         oldest = pp;
+      }
+   }
+   if (NULL != oldest)
+   {
+      sjob_t *job = *oldest;
+      *oldest = job->next;
+      free(job);
+      --l_nDone;
+   }
+}/*jobDone*/
+
+void serverFileDone(unsigned jobId, int status)
+{
+   sjob_t *job;
+   pthread_mutex_lock(&l_mServer);
+   if (NULL != (job = findJob(jobId)))
+   {
+      job->counts[ (REMOTE_OK == status)? 0: (REMOTE_IGNORED == status)? 1: 2 ] += 1;
+      if ( (0 == --job->left) && job->submitted )
+      {
+         jobDone();
+      }
+   }
+   pthread_mutex_unlock(&l_mServer);
+}/*serverFileDone*/
+
+/*Handles one request. Returns -1 if the connection must be closed:*/
+static int serverRequest(int fd, char *line)
+{
+   char lane[16];
+   unsigned id;
+   int n = 0;
+
+   if ( (1 == sscanf(line, "SUBMIT %15s %n", lane, &n)) && (0 != n) )
+   {
+      sjob_t *job;
+      char *path = line + n;
+      int files;
+      int l = (0 == strcmp(lane, "high"))? SERVER_LANE_HIGH:
+              (0 == strcmp(lane, "bulk"))? SERVER_LANE_BULK: -1;
+      if (l < 0)
+      {
+         return sendLine(fd, "ERR unknown lane\n");
+      }
+      if (NULL == (job = calloc(1, sizeof(sjob_t))))
+      {
+         return sendLine(fd, "ERR no memory\n");
+      }
+      pthread_mutex_lock(&l_mServer);
+      if (0 != l_shutdown)
+      {
+         pthread_mutex_unlock(&l_mServer);
+         free(job);
+         return sendLine(fd, "ERR shutting down\n");
+      }
+      id = job->id = ++l_lastJob;
+      job->next = l_jobs;
+      l_jobs = job;
+      ++l_nSubmitting;
+      pthread_mutex_unlock(&l_mServer);
+
+      files = l_server->submit(path, l, id);
+
+      pthread_mutex_lock(&l_mServer);
+      if (0 == --l_nSubmitting)
+      {
+         pthread_cond_broadcast(&l_cServer);
+      }
+      job->submitted = 1;
+      /*some files may be done already:*/
+      job->left += (files > 0)? files: 0;
+      if (0 == job->left)
+      {
+         jobDone();
+      }
+      pthread_mutex_unlock(&l_mServer);
+      if (files < 0)
+      {
+         return sendLine(fd, "ERR can't read '%s'\n", path);
+      }
+      return sendLine(fd, "OK %u %d\n", id, files);
+   }
+   if (1 == sscanf(line, "WAIT %u", &id))
+   {
+      sjob_t *job;
+      int counts[3];
+      pthread_mutex_lock(&l_mServer);
+      ++l_nWaiting;
+      while ( (NULL != (job = findJob(id))) && !jobIsDone(job) )
+      {
+         pthread_cond_wait(&l_cServer, &l_mServer);
+      }
+      if (NULL != job)
+      {
+         memcpy(counts, job->counts, sizeof(counts));
+      }
+      pthread_mutex_unlock(&l_mServer);
+      n = (NULL == job)? sendLine(fd, "ERR unknown job\n"):
+          sendLine(fd, "DONE %u %d %d %d\n", id, counts[0], counts[1], counts[2]);
+      pthread_mutex_lock(&l_mServer);
+      --l_nWaiting;
+      pthread_cond_broadcast(&l_cServer);
+      pthread_mutex_unlock(&l_mServer);
+      return n;
+   }
+   if (0 == strcmp(line, "SHUTDOWN"))
+   {
+      pthread_mutex_lock(&l_mServer);
+      l_shutdown = 1;
+      /*wake up accept():*/
+      shutdown(l_listenFd, SHUT_RDWR);
+      pthread_mutex_unlock(&l_mServer);
+      return sendLine(fd, "OK\n");
+   }
+   return sendLine(fd, "ERR unknown request\n");
+}/*serverRequest*/
+
+static void *serverClient(void *arg)
+{
+   int fd = (int)(intptr_t)arg;
+   char line[REMOTE_LINE];
+
+   while ( (0 == readLine(fd, line, sizeof(line))) && (0 == serverRequest(fd, line)) )
+   {
+      ;
+   }
+   close(fd);
+   return NULL;
+}/*serverClient*/
+
+int runServer(char *address, server_t *s)
+{
+   pthread_attr_t attr;
+
+   signal(SIGPIPE, SIG_IGN);
+   if (-1 == (l_listenFd = openSocket(address, 1)))
+   {
+      errorMsg("Can't listen on '%s'\n", address);
+      return -1;
+   }
+   l_server = s;
+   message("Serving jobs on '%s'\n", address);
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+   for(;;)
+   {
+      pthread_t thread;
+      int fd = accept(l_listenFd, NULL, NULL);
+      int over;
+
+      pthread_mutex_lock(&l_mServer);
+      over = l_shutdown;
+      pthread_mutex_unlock(&l_mServer);
+      if (0 != over)
+      {
+         if (fd >= 0)
+         {
+            close(fd);
+         }
+         break;
+      }
+      if (fd < 0)
+      {
+         if ( (EINTR == errno) || (ECONNABORTED == errno) )
+         {
+            continue;
+         }
+         errorMsg("The server can't accept connections\n");
+         break;
+      }
+      if (pthread_create(&thread, &attr, serverClient, (void*)(intptr_t)fd))
+      {
+         close(fd);
+      }
+   }
+   pthread_attr_destroy(&attr);
+   /*the caller stops workers when the queues are empty, so jobs being
+     queued must be in:*/
+   pthread_mutex_lock(&l_mServer);
+   while (0 != l_nSubmitting)
+   {
+      pthread_cond_wait(&l_cServer, &l_mServer);
+   }
+   pthread_mutex_unlock(&l_mServer);
+   close(l_listenFd);
+   if (0 == strncmp(address, "unix:", 5))
+   {
+      unlink(address + 5);
+   }
+   return 0;
+}/*runServer*/
+
+void serverClose(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts);
+   ts.tv_sec += SERVER_CLOSE_WAIT / 1000;
+   pthread_mutex_lock(&l_mServer);
+   while ( (0 != l_nWaiting) &&
+           (0 == pthread_cond_timedwait(&l_cServer, &l_mServer, &ts)) )
+   {
+      ;
+   }
+   pthread_mutex_unlock(&l_mServer);
+}/*serverClose*/
+
+#else /*_WIN32*/
+
+int runCoordinator(char *address, coordinator_t *c)
+{
+   errorMsg("The coordinator mode is not supported on Windows\n");
+   return -1;
+}/*runCoordinator*/
+
+int remoteConnect(char *address)
+{
+   errorMsg("The worker mode is not supported on Windows\n");
+   return -1;
+}/*remoteConnect*/
+
+void remoteClose(int conn)
+{
+}/*remoteClose*/
+
+int remoteGetJob(int conn, char *fileName, unsigned *id, int *sync)
+{
+   return -1;
+}/*remoteGetJob*/
+
+int remoteJobDone(int conn, unsigned id, int status)
+{
+   return -1;
+}/*remoteJobDone*/
+
+int remoteHeartbeat(int conn)
+{
+   return -1;
+}/*remoteHeartbeat*/
+
+int remoteRequest(int conn, char *reply, int size, char *fmt, ...)
+{
+   return -1;
+}/*remoteRequest*/
+
+int runServer(char *address, server_t *s)
+{
+   errorMsg("The server mode is not supported on Windows\n");
+   return -1;
+}/*runServer*/
+
+void serverFileDone(unsigned jobId, int status)
+{
+}/*serverFileDone*/
+
+void serverClose(void)
+{
+}/*serverClose*/
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef REMOTE_H
+#define REMOTE_H 1
+
+/*
+  Coordinator/worker mode: one coordinator process scans directories and
+  owns the queues, worker processes (possibly on other nodes sharing the
+  filesystem) request files over a socket and encode them.
+
+  Address is either "unix:PATH" or "HOST:PORT" ("*:PORT" to listen on
+  all interfaces).
+
+  The protocol is line based, one connection per worker thread:
+    worker -> coordinator:
+      GET                  -- request a job;
+      HB                   -- heartbeat, extends the lease of the job;
+      DONE <id> <status>   -- the job is finished, status is 0 if
+                              converted, 1 if the file was ignored,
+                              -1 on failure.
+    coordinator -> worker:
+      JOB <id> <sync> <path> -- encode the file; if <sync> is 1, the output
+                              must be durable before DONE is sent;
+      BYE                  -- no more jobs.
+  A GET is answered as soon as a job is available. A job is leased to the
+  worker: if the lease is not extended in time or the connection is lost,
+  the job is given to another worker, up to maxRetries times.
+*/
+
+#include "tools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REMOTE_OK 0
+#define REMOTE_IGNORED 1
+#define REMOTE_FAILED (-1)
+
+/*Coordinator callbacks:*/
+typedef struct
+{
+   /*Returns the malloc'ed full name of the next file or NULL if there
+     is nothing now. Sets *isOver to !0 if nothing will ever come:*/
+   char *(*nextJob)(int *isOver);
+   /*Called once per job, the coordinator frees fileName afterwards:*/
+   void (*jobDone)(char *fileName, int status);
+   int sync;/*sent to workers with each job*/
+   int leaseTimeout;/*seconds*/
+   int maxRetries;
+}coordinator_t;
+
+/*Serves workers until all jobs are done. Returns 0 on success:*/
+int runCoordinator(char *address, coordinator_t *c);
+
+/*Worker side. Returns the connection or -1:*/
+int remoteConnect(char *address);
+void remoteClose(int conn);
+
+/*Requests the next job. Returns 1 and fills fileName (of the size
+  MAX_PATH_LENGTH), *id and *sync; returns 0 if there are no more jobs,
+  -1 on error:*/
+int remoteGetJob(int conn, char *fileName, unsigned *id, int *sync);
+int remoteJobDone(int conn, unsigned id, int status);
+int remoteHeartbeat(int conn);
+
+/*Seconds between heartbeats sent by remote workers:*/
+#define REMOTE_HEARTBEAT 5
+
+/*
+  Job server mode: a persistent process takes jobs from clients over a
+  socket (normally unix:PATH) into priority lanes; workers take the high
+  lane first, at the next file boundary.
+
+  The protocol is line based, one request at a time per connection:
+    client -> server:
+      SUBMIT <lane> <path> -- queue the .wav file or the .wav files of the
+                              directory, lane is "high" or "bulk";
+      WAIT <id>            -- wait until all files of the job are finished;
+      SHUTDOWN             -- accept no more jobs, finish queued ones and exit.
+    server -> client:
+      OK <id> <files>      -- the job is queued;
+      DONE <id> <converted> <ignored> <failed>
+      OK                   -- the answer to SHUTDOWN;
+      ERR <reason>
+*/
+
+#define SERVER_LANE_HIGH 0
+#define SERVER_LANE_BULK 1
+#define SERVER_LANES 2
+
+/*Server callbacks:*/
+typedef struct
+{
+   /*Queues the job into the lane. Returns the number of queued files or
+     -1 if the path is wrong. The server must know the job before its
+     files are done, so it calls serverFileDone() only after submit
+     returns:*/
+   int (*submit)(char *path, int lane, unsigned jobId);
+}server_t;
+
+/*Serves clients until SHUTDOWN. Returns 0 on success:*/
+int runServer(char *address, server_t *s);
+
+/*A file of the job is finished, status is REMOTE_*:*/
+void serverFileDone(unsigned jobId, int status);
+
+/*Waits a bit for clients waiting for finished jobs to be answered:*/
+void serverClose(void);
+
+/*Client side: sends the request line (without '\n') and reads the
+  answer into reply of the size. Returns 0 on success:*/
+int remoteRequest(int conn, char *reply, int size, char *fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
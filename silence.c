@@ -0,0 +1,111 @@
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SILENCE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "silence.h"
+
+void silenceInit(silence_t *s, double dB)
+{
+   double level = 32768.0 * pow(10.0, dB / 20.0);
+   double peak = level * pow(10.0, SILENCE_PEAK_DB / 20.0);
+   s->maxPeak = (peak > 32768.0)? 32768: (int)peak;
+   s->maxPower = level * level;
+}/*silenceInit*/
+
+#ifdef SILENCE_SSE2
+
+void silenceLevels(const int16_t *pcm, size_t samples, int *peak, uint64_t *sumSq)
+{
+   __m128i vMax = _mm_set1_epi16(0);
+   __m128i vMin = _mm_set1_epi16(0);
+   __m128i vSum = _mm_setzero_si128();
+   __m128i zero = _mm_setzero_si128();
+   int16_t lanes[8];
+   int max = 0, min = 0, i;
+   uint64_t sum = 0;
+   uint64_t sums[2];
+   size_t n;
+
+   for (n = 0; n + 8 <= samples; n += 8)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i*)(pcm + n));
+      /*each pair is at most 2 * 32768^2 = 2^31, unsigned 32 bit:*/
+      __m128i sq = _mm_madd_epi16(v, v);
+      vMax = _mm_max_epi16(vMax, v);
+      vMin = _mm_min_epi16(vMin, v);
+      vSum = _mm_add_epi64(vSum, _mm_unpacklo_epi32(sq, zero));
+      vSum = _mm_add_epi64(vSum, _mm_unpackhi_epi32(sq, zero));
+   }
+   _mm_storeu_si128((__m128i*)lanes, vMax);
+   for (i = 0; i < 8; ++i)
+   {
+      max = (lanes[i] > max)? lanes[i]: max;
+   }
+   _mm_storeu_si128((__m128i*)lanes, vMin);
+   for (i = 0; i < 8; ++i)
+   {
+      min = (lanes[i] < min)? lanes[i]: min;
+   }
+   _mm_storeu_si128((__m128i*)sums, vSum);
+   sum = sums[0] + sums[1];
+   for (; n < samples; ++n)
+   {
+      int v = pcm[n];
+      max = (v > max)? v: max;
+      min = (v < min)? v: min;
+      sum += (uint64_t)(v * v);
+   }
+   *peak = (-min > max)? -min: max;
+   *sumSq = sum;
+}/*silenceLevels*/
+
+#else /*SILENCE_SSE2*/
+
+void silenceLevels(const int16_t *pcm, size_t samples, int *peak, uint64_t *sumSq)
+{
+   int max = 0, min = 0;
+   uint64_t sum = 0;
+   size_t n;
+
+   for (n = 0; n < samples; ++n)
+   {
+      int v = pcm[n];
+      max = (v > max)? v: max;
+      min = (v < min)? v: min;
+      sum += (uint64_t)(v * v);
+   }
+   *peak = (-min > max)? -min: max;
+   *sumSq = sum;
+}/*silenceLevels*/
+
+#endif /*SILENCE_SSE2*/
+
+int silenceIsSilent(const silence_t *s, const int16_t *pcm, size_t samples)
+{
+   int peak;
+   uint64_t sumSq;
+   if (0 == samples)
+   {
+      return 1;
+   }
+   silenceLevels(pcm, samples, &peak, &sumSq);
+   return (peak <= s->maxPeak) && ((double)sumSq <= s->maxPower * (double)samples);
+}/*silenceIsSilent*/
+
+size_t silenceFind(const silence_t *s, const int16_t *pcm, size_t frames, size_t window,
+                   int silent)
+{
+   size_t at;
+   for (at = 0; at < frames; at += window)
+   {
+      size_t n = (frames - at < window)? frames - at: window;
+      if ( silenceIsSilent(s, pcm + 2 * at, 2 * n) == (0 != silent) )
+      {
+         return at;
+      }
+   }
+   return frames;
+}/*silenceFind*/
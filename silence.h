@@ -0,0 +1,46 @@
+#ifndef SILENCE_H
+#define SILENCE_H 1
+
+/*
+  Silence detection of 16 bit PCM, see --trim-silence and --max-gap.
+
+  PCM is cut into windows, a window is silent when its RMS is below the
+  threshold and its peak is below the threshold + SILENCE_PEAK_DB, so a
+  click in a quiet window is not lost. The kernels use SSE2 where the
+  compiler targets it, otherwise plain C; both give the same answers.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SILENCE_PEAK_DB 12.0
+
+typedef struct
+{
+   int maxPeak;/*absolute sample value*/
+   double maxPower;/*mean square*/
+}silence_t;
+
+/*dB is relative to the full scale, e.g. -50:*/
+void silenceInit(silence_t *s, double dB);
+
+/*The peak (absolute value) and the sum of squares of samples:*/
+void silenceLevels(const int16_t *pcm, size_t samples, int *peak, uint64_t *sumSq);
+
+int silenceIsSilent(const silence_t *s, const int16_t *pcm, size_t samples);
+
+/*Returns the offset (in frames of 2 samples) of the first window of
+  window frames which is silent (silent != 0) or is not, frames if there
+  is no such window. The last window may be shorter:*/
+size_t silenceFind(const silence_t *s, const int16_t *pcm, size_t frames, size_t window,
+                   int silent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <inttypes.h>
+#include <sys/resource.h>
+#endif
+
+#include "tools.h"
+#include "stats.h"
+
+#define STATS_INI_LENGTH 1024
+
+static pthread_mutex_t l_mStats = PTHREAD_MUTEX_INITIALIZER;
+static int64_t *l_latency = NULL;/*us*/
+static size_t l_nFiles = 0;
+static size_t l_length = 0;
+static int64_t l_bytes = 0;
+static int64_t l_start = 0;
+
+void statsStart(void)
+{
+   l_start = getTimeUs();
+}/*statsStart*/
+
+void statsFile(int64_t latencyUs, int64_t bytes)
+{
+   pthread_mutex_lock(&l_mStats);
+   if (l_nFiles == l_length)
+   {
+      size_t length = (0 == l_length)? STATS_INI_LENGTH: 2 * l_length;
+      int64_t *tmp = realloc(l_latency, length * sizeof(int64_t));
+      if (NULL == tmp)
+      {
+         pthread_mutex_unlock(&l_mStats);
+         return;
+      }
+      l_latency = tmp;
+      l_length = length;
+   }
+   l_latency[l_nFiles++] = latencyUs;
+   l_bytes += bytes;
+   pthread_mutex_unlock(&l_mStats);
+}/*statsFile*/
+
+static int cmpInt64(const void *a, const void *b)
+{
+   int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+   return (x > y) - (x < y);
+}/*cmpInt64*/
+
+/*ms, the nearest rank percentile of the sorted latencies:*/
+static double percentile(int p)
+{
+   size_t i;
+   if (0 == l_nFiles)
+   {
+      return 0.0;
+   }
+   i = (l_nFiles * p + 99) / 100;
+   if (i > 0)
+   {
+      --i;
+   }
+   return l_latency[i] / 1000.0;
+}/*percentile*/
+
+static long peakRssKb(void)
+{
+#ifdef _WIN32
+   return 0;
+#else
+   struct rusage ru;
+   if (0 != getrusage(RUSAGE_SELF, &ru))
+   {
+      return 0;
+   }
+   return ru.ru_maxrss;/*kilobytes on Linux*/
+#endif
+}/*peakRssKb*/
+
+int statsWrite(char *fileName)
+{
+   double seconds = (getTimeUs() - l_start) / 1e6;
+   FILE *f = fopen(fileName, "w");
+   int ret;
+
+   if (NULL == f)
+   {
+      return -1;
+   }
+   pthread_mutex_lock(&l_mStats);
+   qsort(l_latency, l_nFiles, sizeof(int64_t), cmpInt64);
+   fprintf(f, "files %lu\n", (unsigned long)l_nFiles);
+   fprintf(f, "bytes %" PRId64 "\n", l_bytes);
+   fprintf(f, "seconds %.3f\n", seconds);
+   fprintf(f, "throughput_mb_s %.3f\n", (seconds > 0)? l_bytes / 1048576.0 / seconds: 0.0);
+   fprintf(f, "files_s %.3f\n", (seconds > 0)? l_nFiles / seconds: 0.0);
+   fprintf(f, "peak_rss_kb %ld\n", peakRssKb());
+   fprintf(f, "latency_p50_ms %.3f\n", percentile(50));
+   fprintf(f, "latency_p90_ms %.3f\n", percentile(90));
+   fprintf(f, "latency_p99_ms %.3f\n", percentile(99));
+   fprintf(f, "latency_max_ms %.3f\n", percentile(100));
+   pthread_mutex_unlock(&l_mStats);
+   ret = ferror(f);
+   if (0 != fclose(f))
+   {
+      ret = -1;
+   }
+   return ret;
+}/*statsWrite*/
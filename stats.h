@@ -0,0 +1,34 @@
+#ifndef STATS_H
+#define STATS_H 1
+
+/*
+  Run statistics for regression tests (see --stats and test/perftest.sh):
+  the number of files and bytes, the wall time and throughput, the peak
+  resident memory and percentiles of the per-file latency (from taking a
+  file to its completion).
+
+  The report is written as "key value" lines, one value per line, so
+  that it is easy to read from a script.
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*Starts the wall clock:*/
+void statsStart(void);
+
+/*Records a converted file: latency in microseconds and input bytes.
+  Thread safe:*/
+void statsFile(int64_t latencyUs, int64_t bytes);
+
+/*Writes the report into fileName. Returns 0 on success:*/
+int statsWrite(char *fileName);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+/*
+  Generator of PCM WAV files for the performance tests, see perftest.sh.
+
+  usage: mkwav DIR PREFIX COUNT SECONDS [CHANNELS [RATE [CONTAINER]]]
+
+  Writes COUNT files DIR/PREFIXnnnnn.wav of SECONDS seconds each (may be
+  fractional), 16 bit, CHANNELS (2) channels at RATE (44100) Hz. The
+  CONTAINER is "wav" (default), "rf64" or "w64" (Wave64). The
+  content is a deterministic mix of a tone and noise, so the same
+  arguments always give the same files (and the same .mp3 checksums).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*Little endian regardless of the host:*/
+static void put16(FILE *f, unsigned v)
+{
+   fputc(v & 0xff, f);
+   fputc((v >> 8) & 0xff, f);
+}/*put16*/
+
+static void put32(FILE *f, uint32_t v)
+{
+   put16(f, v & 0xffff);
+   put16(f, v >> 16);
+}/*put32*/
+
+static void put64(FILE *f, uint64_t v)
+{
+   put32(f, (uint32_t)v);
+   put32(f, (uint32_t)(v >> 32));
+}/*put64*/
+
+/*A Wave64 GUID of the id, see lameWav2mp3.c:*/
+static void putGuid(FILE *f, const char *id)
+{
+   static const unsigned char riff[12] =
+      {0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+   static const unsigned char other[12] =
+      {0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+   fwrite(id, 1, 4, f);
+   fwrite(0 == strcmp(id, "riff")? riff: other, 1, 12, f);
+}/*putGuid*/
+
+/*Writes the header up to the data, see main() for the container:*/
+static void putHeader(FILE *f, char *container, uint64_t dataSize, int channels, uint32_t rate)
+{
+   uint64_t pad = (8 - dataSize % 8) % 8;
+   if (0 == strcmp(container, "w64"))
+   {
+      putGuid(f, "riff");
+      put64(f, 104 + dataSize + pad);
+      putGuid(f, "wave");
+      putGuid(f, "fmt ");
+      put64(f, 24 + 16);
+   }
+   else if (0 == strcmp(container, "rf64"))
+   {
+      fwrite("RF64", 1, 4, f);
+      put32(f, 0xFFFFFFFFu);
+      fwrite("WAVEds64", 1, 8, f);
+      put32(f, 28);
+      put64(f, 72 + dataSize);
+      put64(f, dataSize);
+      put64(f, dataSize / (channels * 2));
+      put32(f, 0);/*no table*/
+      fwrite("fmt ", 1, 4, f);
+      put32(f, 16);
+   }
+   else
+   {
+      fwrite("RIFF", 1, 4, f);
+      put32(f, (uint32_t)(36 + dataSize));
+      fwrite("WAVEfmt ", 1, 8, f);
+      put32(f, 16);
+   }
+   put16(f, 1);/*PCM*/
+   put16(f, channels);
+   put32(f, rate);
+   put32(f, rate * channels * 2);
+   put16(f, channels * 2);
+   put16(f, 16);
+   if (0 == strcmp(container, "w64"))
+   {
+      putGuid(f, "data");
+      put64(f, 24 + dataSize);
+   }
+   else
+   {
+      fwrite("data", 1, 4, f);
+      put32(f, (0 == strcmp(container, "rf64"))? 0xFFFFFFFFu: (uint32_t)dataSize);
+   }
+}/*putHeader*/
+
+static int writeWav(char *name, char *container, uint64_t nFrames, int channels,
+                    uint32_t rate, uint32_t seed)
+{
+   uint64_t dataSize = nFrames * channels * 2, i;
+   double freq = 110.0 * (1 + seed % 16);
+   FILE *f = fopen(name, "wb");
+   if (NULL == f)
+   {
+      return -1;
+   }
+   putHeader(f, container, dataSize, channels, rate);
+   for (i = 0; i < nFrames; ++i)
+   {
+      int c;
+      double tone = 8000.0 * sin(2 * M_PI * freq * i / rate);
+      for (c = 0; c < channels; ++c)
+      {
+         /*LCG noise:*/
+         seed = seed * 1664525u + 1013904223u;
+         put16(f, (unsigned)(int16_t)(tone + (int)(seed >> 22) - 512));
+      }
+   }
+   /*Wave64 chunks are aligned to 8 bytes:*/
+   for (i = 0; (0 == strcmp(container, "w64")) && (i < (8 - dataSize % 8) % 8); ++i)
+   {
+      fputc(0, f);
+   }
+   return fclose(f);
+}/*writeWav*/
+
+int main(int argc, char *argv[])
+{
+   int i, count, channels = 2;
+   uint32_t rate = 44100;
+   uint64_t nFrames;
+   char *container = "wav";
+
+   if (argc < 5)
+   {
+      fprintf(stderr, "usage: %s DIR PREFIX COUNT SECONDS [CHANNELS [RATE [CONTAINER]]]\n", argv[0]);
+      return 1;
+   }
+   count = atoi(argv[3]);
+   if (argc > 5)
+   {
+      channels = atoi(argv[5]);
+   }
+   if (argc > 6)
+   {
+      rate = (uint32_t)atol(argv[6]);
+   }
+   if (argc > 7)
+   {
+      container = argv[7];
+   }
+   if ( (channels < 1) || (channels > 2) || (0 == rate) ||
+        ( (0 != strcmp(container, "wav")) && (0 != strcmp(container, "rf64")) &&
+          (0 != strcmp(container, "w64")) ) )
+   {
+      fprintf(stderr, "Wrong format\n");
+      return 1;
+   }
+   nFrames = (uint64_t)(atof(argv[4]) * rate);
+   for (i = 0; i < count; ++i)
+   {
+      char name[4096];
+      snprintf(name, sizeof(name), "%s/%s%05d.wav", argv[1], argv[2], i);
+      if (0 != writeWav(name, container, nFrames, channels, rate, (uint32_t)i))
+      {
+         fprintf(stderr, "Can't write '%s'\n", name);
+         return 2;
+      }
+   }
+   return 0;
+}/*main*/
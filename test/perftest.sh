@@ -0,0 +1,109 @@
+#!/bin/sh
+# Performance regression suite, run it by "make perftest".
+#
+# Encodes the bundled fixtures (test/*.wav) and two generated corpora,
+# "large" (a few long files) and "tiny" (many short ones), with a fixed
+# number of workers, each corpus by its own runs with --stats (the best
+# of $PERF_RUNS runs counts). Then
+#  - checks the .mp3 checksums against $PERF_GOLDEN; if it does not
+#    exist, records it (the checksums depend on the LAME version, so
+#    commit it for the reference build);
+#  - compares the throughput of generated corpora with $PERF_BASELINE and
+#    fails if it is more than $PERF_THRESHOLD percent lower. If there is
+#    no baseline or PERF_UPDATE is set, records the current run instead.
+# The results of the run are in $PERF_DIR/results.txt, "corpus.key value"
+# lines (see stats.h).
+
+PRG=${PRG:-./lameWav2mp3}
+MKWAV=${MKWAV:-test/mkwav}
+WORKERS=${PERF_WORKERS:-4}
+THRESHOLD=${PERF_THRESHOLD:-10}
+RUNS=${PERF_RUNS:-3}
+DIR=${PERF_DIR:-test/perf.tmp}
+BASELINE=${PERF_BASELINE:-test/perf-baseline.txt}
+GOLDEN=${PERF_GOLDEN:-test/golden.md5}
+CORPORA="fixtures large tiny"
+#the fixtures take milliseconds, too noisy to compare:
+TIMED="large tiny"
+
+fail=0
+
+rm -rf "$DIR"
+mkdir -p "$DIR/fixtures" "$DIR/large" "$DIR/tiny" || exit 2
+cp test/*.wav "$DIR/fixtures/" || exit 2
+"$MKWAV" "$DIR/large" large 8 60 || exit 2
+"$MKWAV" "$DIR/tiny" tiny 2000 0.05 1 22050 || exit 2
+
+results="$DIR/results.txt"
+: > "$results"
+for corpus in $CORPORA
+do
+   echo "Encoding $corpus with $WORKERS workers"
+   best=0
+   run=0
+   while [ $run -lt "$RUNS" ]
+   do
+      "$PRG" --workers="$WORKERS" --log-level=0 --stats="$DIR/$corpus.run" "$DIR/$corpus" > /dev/null
+      if [ $? -ne 0 ] || [ ! -f "$DIR/$corpus.run" ]
+      then
+         echo "FAIL: $PRG fails on $corpus"
+         exit 1
+      fi
+      cur=`awk '$1 == "throughput_mb_s" { print $2 }' "$DIR/$corpus.run"`
+      if awk -v b="$best" -v c="$cur" 'BEGIN { exit !(c > b) }'
+      then
+         best=$cur
+         mv "$DIR/$corpus.run" "$DIR/$corpus.stats"
+      fi
+      run=`expr $run + 1`
+   done
+   sed "s/^/$corpus./" "$DIR/$corpus.stats" >> "$results"
+done
+
+(cd "$DIR" && md5sum */*.mp3) | sort -k2 > "$DIR/outputs.md5"
+if [ -f "$GOLDEN" ]
+then
+   if ! cmp -s "$GOLDEN" "$DIR/outputs.md5"
+   then
+      echo "FAIL: outputs differ from $GOLDEN:"
+      diff "$GOLDEN" "$DIR/outputs.md5" | head -20
+      fail=1
+   fi
+else
+   cp "$DIR/outputs.md5" "$GOLDEN"
+   echo "Golden checksums recorded into $GOLDEN"
+fi
+
+if [ -f "$BASELINE" ] && [ -z "$PERF_UPDATE" ]
+then
+   for corpus in $TIMED
+   do
+      key="$corpus.throughput_mb_s"
+      base=`awk -v k="$key" '$1 == k { print $2 }' "$BASELINE"`
+      cur=`awk -v k="$key" '$1 == k { print $2 }' "$results"`
+      if [ -z "$base" ]
+      then
+         echo "No $key in $BASELINE"
+         continue
+      fi
+      if awk -v b="$base" -v c="$cur" -v t="$THRESHOLD" 'BEGIN { exit !(c < b * (1 - t / 100)) }'
+      then
+         echo "FAIL: $corpus: $cur MB/s, baseline $base MB/s (threshold $THRESHOLD%)"
+         fail=1
+      else
+         echo "$corpus: $cur MB/s, baseline $base MB/s"
+      fi
+   done
+else
+   cp "$results" "$BASELINE"
+   echo "Baseline recorded into $BASELINE"
+fi
+
+cat "$results"
+if [ $fail -ne 0 ]
+then
+   echo "perftest FAILED"
+   exit 1
+fi
+echo "perftest passed"
+exit 0
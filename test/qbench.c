@@ -0,0 +1,675 @@
+/*
+  Benchmark and stress checker of queue.h, see "make qbench" and
+  "make qstress".
+
+  usage: qbench [-n ITEMS] [-r SEED]        benchmark
+         qbench -s ROUNDS [-n ITEMS] [-r SEED]   stress check
+
+  The benchmark moves ITEMS (1000000) elements from P producers to C
+  consumers (1, 2 and 4 each) through a queue shared under a mutex, as
+  the encoder does, for each element type and each isFixed mode:
+
+    realloc    QFL_REALLOC_IF_FULL, starting from 16 cells, so the
+               qFLRealloc path is taken while the queue grows;
+    fail       QFL_FAIL_IF_FULL of 1024 cells, a producer waits while
+               the push fails;
+    overwrite  QFL_OVERWRITE_IF_FULL of 1024 cells, the oldest elements
+               are lost (counted as dropped).
+
+  It prints the throughput (pushed elements per second) and percentiles
+  of the latency from push to pop (every 16th element is timed).
+
+  The stress check runs ROUNDS rounds of two kinds:
+  - random operations (both pushes, pop, peek, length, reset) of several
+    threads on one queue of 2..8 cells, each compared under the lock
+    with a plain reference model, so every wraparound and reallocation
+    is checked;
+  - producers and consumers through the interface of the benchmark with
+    random counts and lengths; consumers check that elements of each
+    producer come in order, and at the end that none is lost (except
+    overwritten ones) or duplicated.
+
+  A queue is an impl_t, so another implementation is added to l_impls
+  and compared with the same benchmark and checks.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "comdef.h"
+
+#include "queue.h"
+
+#define QFL_TYPE int32_t
+#define QFL_PREFIX i32_
+#define QFL_NULL (-1)
+#include "queue.h"
+
+#define QFL_TYPE int64_t
+#define QFL_PREFIX i64_
+#define QFL_NULL (-1)
+#include "queue.h"
+
+/*an element is the producer and its sequence number from 1:*/
+#define SEQ_BITS 24
+#define SEQ_MASK ((1 << SEQ_BITS) - 1)
+#define MAX_THREADS 8
+/*every LAT_SAMPLE-th element is timed:*/
+#define LAT_SAMPLE 16
+#define FIXED_LENGTH 1024
+#define GROWING_LENGTH 16
+
+enum {MODE_REALLOC, MODE_FAIL, MODE_OVERWRITE, MODE_NUMBER};
+
+static const char *l_modeNames[MODE_NUMBER] = {"realloc", "fail", "overwrite"};
+static const int l_isFixed[MODE_NUMBER] =
+   {QFL_REALLOC_IF_FULL, QFL_FAIL_IF_FULL, QFL_OVERWRITE_IF_FULL};
+
+/*A blocking queue of int64_t elements, whatever it stores inside:*/
+typedef struct
+{
+   const char *name;
+   void *(*create)(int mode, int iniLength);
+   /*Waits while the queue is full (fail mode). Sets *dropped to !0 if
+     the oldest element was overwritten:*/
+   void (*push)(void *q, int64_t v, int *dropped);
+   /*Waits for an element. Returns 0, or !0 if the queue is closed and
+     empty:*/
+   int (*pop)(void *q, int64_t *v);
+   /*No more pushes:*/
+   void (*close)(void *q);
+   void (*destroy)(void *q);
+}impl_t;
+
+static void fail(const char *what, int64_t a, int64_t b)
+{
+   fprintf(stderr, "FAILED: %s (%lld, %lld)\n", what, (long long)a, (long long)b);
+   exit(1);
+}/*fail*/
+
+static int64_t nowNs(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}/*nowNs*/
+
+/*xorshift64*, a generator per thread:*/
+static uint64_t rnd(uint64_t *s)
+{
+   *s ^= *s >> 12;
+   *s ^= *s << 25;
+   *s ^= *s >> 27;
+   return *s * 2685821657736338717ULL;
+}/*rnd*/
+
+/*The queue of queue.h under a mutex, as lameWav2mp3.c uses it. PFX is
+  the prefix of the instance, TO and FROM convert int64_t elements:*/
+#define MUTEX_QUEUE(PFX, TO, FROM) \
+typedef struct \
+{ \
+   pthread_mutex_t m; \
+   pthread_cond_t cNotEmpty, cNotFull; \
+   int closed; \
+   PFX##qFL_t q; \
+}PFX##mq_t; \
+\
+static void *PFX##mqCreate(int mode, int iniLength) \
+{ \
+   PFX##mq_t *q = malloc(sizeof(PFX##mq_t)); \
+   if ( (NULL == q) || (NULL == PFX##qFLInit(NULL, iniLength, &q->q, l_isFixed[mode])) ) \
+   { \
+      fail("can't allocate a queue", iniLength, 0); \
+   } \
+   pthread_mutex_init(&q->m, NULL); \
+   pthread_cond_init(&q->cNotEmpty, NULL); \
+   pthread_cond_init(&q->cNotFull, NULL); \
+   q->closed = 0; \
+   return q; \
+} \
+\
+static void PFX##mqPush(void *ptr, int64_t v, int *dropped) \
+{ \
+   PFX##mq_t *q = ptr; \
+   FL_INT rc; \
+   pthread_mutex_lock(&q->m); \
+   *dropped = (q->q.isFixed > 0) && PFX##qFLIsFull(&q->q); \
+   while ( -2 == (rc = PFX##qFLPushFifo(&q->q, TO(v))) ) \
+   { \
+      pthread_cond_wait(&q->cNotFull, &q->m); \
+   } \
+   if (rc < 0) \
+   { \
+      fail("push fails", rc, v); \
+   } \
+   pthread_cond_signal(&q->cNotEmpty); \
+   pthread_mutex_unlock(&q->m); \
+} \
+\
+static int PFX##mqPop(void *ptr, int64_t *v) \
+{ \
+   PFX##mq_t *q = ptr; \
+   pthread_mutex_lock(&q->m); \
+   while ( PFX##qFLIsEmpty(&q->q) && (0 == q->closed) ) \
+   { \
+      pthread_cond_wait(&q->cNotEmpty, &q->m); \
+   } \
+   if (PFX##qFLIsEmpty(&q->q)) \
+   { \
+      pthread_mutex_unlock(&q->m); \
+      return 1; \
+   } \
+   *v = FROM(PFX##qFLPop(&q->q)); \
+   pthread_cond_signal(&q->cNotFull); \
+   pthread_mutex_unlock(&q->m); \
+   return 0; \
+} \
+\
+static void PFX##mqClose(void *ptr) \
+{ \
+   PFX##mq_t *q = ptr; \
+   pthread_mutex_lock(&q->m); \
+   q->closed = 1; \
+   pthread_cond_broadcast(&q->cNotEmpty); \
+   pthread_mutex_unlock(&q->m); \
+} \
+\
+static void PFX##mqDestroy(void *ptr) \
+{ \
+   PFX##mq_t *q = ptr; \
+   PFX##qFLDestroy(&q->q); \
+   pthread_mutex_destroy(&q->m); \
+   pthread_cond_destroy(&q->cNotEmpty); \
+   pthread_cond_destroy(&q->cNotFull); \
+   free(q); \
+}
+
+#define PTR_TO(v) ((void*)(intptr_t)(v))
+#define PTR_FROM(p) ((int64_t)(intptr_t)(p))
+#define I32_TO(v) ((int32_t)(v))
+#define I64_TO(v) (v)
+#define AS_IS(v) ((int64_t)(v))
+
+MUTEX_QUEUE(voidptr_, PTR_TO, PTR_FROM)
+MUTEX_QUEUE(i32_, I32_TO, AS_IS)
+MUTEX_QUEUE(i64_, I64_TO, AS_IS)
+
+static const impl_t l_impls[] =
+{
+   {"mutex void*", voidptr_mqCreate, voidptr_mqPush, voidptr_mqPop, voidptr_mqClose, voidptr_mqDestroy},
+   {"mutex int32", i32_mqCreate, i32_mqPush, i32_mqPop, i32_mqClose, i32_mqDestroy},
+   {"mutex int64", i64_mqCreate, i64_mqPush, i64_mqPop, i64_mqClose, i64_mqDestroy},
+};
+#define N_IMPLS ((int)(sizeof(l_impls) / sizeof(l_impls[0])))
+
+/*One run of producers and consumers:*/
+typedef struct
+{
+   const impl_t *impl;
+   void *q;
+   int mode;
+   int nProducers, nConsumers;
+   int perProducer;/*elements*/
+   int check;/*!0 for the stress check*/
+   int64_t *pushed[MAX_THREADS];/*ns of timed elements, by producer*/
+   unsigned char *seen[MAX_THREADS];/*by producer and sequence, see check*/
+   int64_t dropped[MAX_THREADS];/*by producer*/
+}run_t;
+
+typedef struct
+{
+   run_t *run;
+   int id;
+   int64_t popped;
+   int64_t *latency;/*ns, of timed elements*/
+   int64_t nLatency;
+}thread_t;
+
+static void *producer(void *arg)
+{
+   thread_t *t = arg;
+   run_t *r = t->run;
+   int seq, dropped;
+   for (seq = 1; seq <= r->perProducer; ++seq)
+   {
+      if (0 == seq % LAT_SAMPLE)
+      {
+         r->pushed[t->id][seq / LAT_SAMPLE] = nowNs();
+      }
+      r->impl->push(r->q, ((int64_t)t->id << SEQ_BITS) | seq, &dropped);
+      r->dropped[t->id] += dropped;
+   }
+   return NULL;
+}/*producer*/
+
+static void *consumer(void *arg)
+{
+   thread_t *t = arg;
+   run_t *r = t->run;
+   int last[MAX_THREADS] = {0};
+   int64_t v;
+
+   while (0 == r->impl->pop(r->q, &v))
+   {
+      int p = (int)(v >> SEQ_BITS), seq = (int)(v & SEQ_MASK);
+      if ( (p < 0) || (p >= r->nProducers) || (seq < 1) || (seq > r->perProducer) )
+      {
+         fail("a foreign element", v, 0);
+      }
+      if (0 == seq % LAT_SAMPLE)
+      {
+         t->latency[t->nLatency++] = nowNs() - r->pushed[p][seq / LAT_SAMPLE];
+      }
+      if (0 != r->check)
+      {
+         /*a FIFO under one lock keeps the order of each producer:*/
+         if (seq <= last[p])
+         {
+            fail("elements of a producer out of order", last[p], seq);
+         }
+         last[p] = seq;
+         if (0 != r->seen[p][seq]++)
+         {
+            fail("an element is popped twice", p, seq);
+         }
+      }
+      ++t->popped;
+   }
+   return NULL;
+}/*consumer*/
+
+static int cmpInt64(const void *a, const void *b)
+{
+   int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+   return (x > y) - (x < y);
+}/*cmpInt64*/
+
+/*Runs r and prints a line of the table unless r->check. Returns ns:*/
+static int64_t runOnce(run_t *r, int iniLength)
+{
+   pthread_t th[2 * MAX_THREADS];
+   thread_t t[2 * MAX_THREADS];
+   int64_t started, ns, popped = 0, dropped = 0, nLatency = 0;
+   int64_t *latency;
+   int i, n = r->nProducers + r->nConsumers;
+
+   r->q = r->impl->create(r->mode, iniLength);
+   for (i = 0; i < r->nProducers; ++i)
+   {
+      r->pushed[i] = calloc(r->perProducer / LAT_SAMPLE + 1, sizeof(int64_t));
+      r->seen[i] = (0 != r->check)? calloc(r->perProducer + 1, 1): NULL;
+      r->dropped[i] = 0;
+   }
+   for (i = 0; i < n; ++i)
+   {
+      t[i].run = r;
+      t[i].id = (i < r->nProducers)? i: i - r->nProducers;
+      t[i].popped = 0;
+      t[i].nLatency = 0;
+      t[i].latency = (i < r->nProducers)? NULL:
+                     malloc((r->nProducers * (r->perProducer / LAT_SAMPLE) + 1) * sizeof(int64_t));
+   }
+
+   started = nowNs();
+   for (i = 0; i < n; ++i)
+   {
+      if (pthread_create(th + i, NULL, (i < r->nProducers)? producer: consumer, t + i))
+      {
+         fail("can't start a thread", i, 0);
+      }
+   }
+   for (i = 0; i < r->nProducers; ++i)
+   {
+      pthread_join(th[i], NULL);
+   }
+   r->impl->close(r->q);
+   for (; i < n; ++i)
+   {
+      pthread_join(th[i], NULL);
+   }
+   ns = nowNs() - started;
+
+   for (i = 0; i < r->nProducers; ++i)
+   {
+      dropped += r->dropped[i];
+   }
+   for (i = r->nProducers; i < n; ++i)
+   {
+      popped += t[i].popped;
+      nLatency += t[i].nLatency;
+   }
+   if (popped + dropped != (int64_t)r->nProducers * r->perProducer)
+   {
+      fail("popped + dropped != pushed", popped + dropped, (int64_t)r->nProducers * r->perProducer);
+   }
+   if ( (MODE_OVERWRITE != r->mode) && (0 != dropped) )
+   {
+      fail("elements are dropped", dropped, r->mode);
+   }
+   for (i = 0; (0 != r->check) && (MODE_OVERWRITE != r->mode) && (i < r->nProducers); ++i)
+   {
+      int seq;
+      for (seq = 1; seq <= r->perProducer; ++seq)
+      {
+         if (1 != r->seen[i][seq])
+         {
+            fail("an element is lost", i, seq);
+         }
+      }
+   }
+
+   latency = malloc((nLatency + 1) * sizeof(int64_t));
+   nLatency = 0;
+   for (i = r->nProducers; i < n; ++i)
+   {
+      memcpy(latency + nLatency, t[i].latency, t[i].nLatency * sizeof(int64_t));
+      nLatency += t[i].nLatency;
+      free(t[i].latency);
+   }
+   if (0 == r->check)
+   {
+      qsort(latency, nLatency, sizeof(int64_t), cmpInt64);
+      printf("%-12s %-9s %2d %2d %10.3f %10.2f %10.2f %10lld\n",
+             r->impl->name, l_modeNames[r->mode], r->nProducers, r->nConsumers,
+             (popped + dropped) / (ns / 1e9) / 1e6,
+             (nLatency > 0)? latency[nLatency / 2] / 1e3: 0.0,
+             (nLatency > 0)? latency[(nLatency * 99) / 100] / 1e3: 0.0,
+             (long long)dropped);
+   }
+   free(latency);
+   for (i = 0; i < r->nProducers; ++i)
+   {
+      free(r->pushed[i]);
+      free(r->seen[i]);
+   }
+   r->impl->destroy(r->q);
+   return ns;
+}/*runOnce*/
+
+static void bench(int items)
+{
+   static const int counts[] = {1, 2, 4};
+   int impl, mode, p, c;
+
+   printf("%-12s %-9s %2s %2s %10s %10s %10s %10s\n",
+          "queue", "mode", "P", "C", "Mops/s", "p50_us", "p99_us", "dropped");
+   for (impl = 0; impl < N_IMPLS; ++impl)
+   {
+      for (mode = 0; mode < MODE_NUMBER; ++mode)
+      {
+         for (p = 0; p < 3; ++p)
+         {
+            for (c = 0; c < 3; ++c)
+            {
+               run_t r;
+               r.impl = l_impls + impl;
+               r.mode = mode;
+               r.nProducers = counts[p];
+               r.nConsumers = counts[c];
+               r.perProducer = items / counts[p];
+               r.check = 0;
+               runOnce(&r, (MODE_REALLOC == mode)? GROWING_LENGTH: FIXED_LENGTH);
+            }
+         }
+      }
+   }
+}/*bench*/
+
+/*The reference model: a deque in a plain array, elements from
+  m->first to m->last - 1, the next one to pop is m->first:*/
+#define MODEL_LENGTH 65536
+#define MODEL_MAX 4096/*elements, the random walk is kept below*/
+
+typedef struct
+{
+   pthread_mutex_t m;
+   i32_qFL_t q;
+   int32_t cells[MODEL_LENGTH];
+   int first, last;
+   int32_t next;/*the next value*/
+   int ops;
+}model_t;
+
+static void modelCheck(model_t *s, uint64_t *seed)
+{
+   /*both ends, beyond them and a random one:*/
+   int at[5];
+   int i, n = s->last - s->first;
+   if (i32_qFLLength(&s->q) != n)
+   {
+      fail("length", i32_qFLLength(&s->q), n);
+   }
+   if (i32_qFLIsEmpty(&s->q) != (0 == n))
+   {
+      fail("qFLIsEmpty", i32_qFLIsEmpty(&s->q), n);
+   }
+   at[0] = -1;
+   at[1] = 0;
+   at[2] = n - 1;
+   at[3] = n;
+   at[4] = (int)(rnd(seed) % (n + 1));
+   for (i = 0; i < 5; ++i)
+   {
+      int32_t want = ( (at[i] < 0) || (at[i] >= n) )? -1: s->cells[s->first + at[i]];
+      if (i32_qFLPeek(&s->q, at[i]) != want)
+      {
+         fail("peek", i32_qFLPeek(&s->q, at[i]), want);
+      }
+   }
+   /*recenter, so both ends have a room:*/
+   if ( (s->first < MODEL_MAX) || (s->last > MODEL_LENGTH - MODEL_MAX) )
+   {
+      int first = (MODEL_LENGTH - n) / 2;
+      memmove(s->cells + first, s->cells + s->first, n * sizeof(int32_t));
+      s->first = first;
+      s->last = first + n;
+   }
+}/*modelCheck*/
+
+/*One random operation, under the lock:*/
+static void modelStep(model_t *s, uint64_t *seed)
+{
+   int n = s->last - s->first;
+   int capacity = s->q.len - 1;
+   unsigned op = (unsigned)(rnd(seed) % 100);
+   int32_t v;
+   FL_INT rc;
+
+   if ( (n >= MODEL_MAX) && (op < 50) )
+   {
+      op = 50;/*pop*/
+   }
+   if (op < 30)
+   {
+      v = s->next++;
+      rc = i32_qFLPushFifo(&s->q, v);
+      if ( (n == capacity) && (s->q.isFixed < 0) )
+      {
+         if (-2 != rc)
+         {
+            fail("FIFO push to a full fixed queue", rc, n);
+         }
+      }
+      else
+      {
+         if (rc < 0)
+         {
+            fail("FIFO push", rc, n);
+         }
+         s->cells[s->last++] = v;
+         if ( (n == capacity) && (s->q.isFixed > 0) )
+         {
+            ++s->first;/*the oldest is overwritten*/
+         }
+      }
+   }
+   else if (op < 50)
+   {
+      v = s->next++;
+      rc = i32_qFLPushLifo(&s->q, v);
+      if ( (n == capacity) && (s->q.isFixed < 0) )
+      {
+         if (-2 != rc)
+         {
+            fail("LIFO push to a full fixed queue", rc, n);
+         }
+      }
+      else
+      {
+         if (rc < 0)
+         {
+            fail("LIFO push", rc, n);
+         }
+         if ( (n == capacity) && (s->q.isFixed > 0) )
+         {
+            --s->last;/*the newest is overwritten*/
+         }
+         s->cells[--s->first] = v;
+      }
+   }
+   else if (op < 99)
+   {
+      int32_t want = (0 == n)? -1: s->cells[s->first++];
+      if ( (v = i32_qFLPop(&s->q)) != want )
+      {
+         fail("pop", v, want);
+      }
+   }
+   else
+   {
+      i32_qFLReset(&s->q);
+      s->first = s->last = MODEL_LENGTH / 2;
+   }
+   if ( (0 == s->q.isFixed) && (s->q.len - 1 < s->last - s->first) )
+   {
+      fail("the queue did not grow", s->q.len, s->last - s->first);
+   }
+   modelCheck(s, seed);
+}/*modelStep*/
+
+typedef struct
+{
+   model_t *s;
+   uint64_t seed;
+   int steps;
+}modelThread_t;
+
+static void *modelThread(void *arg)
+{
+   modelThread_t *t = arg;
+   int i;
+   for (i = 0; i < t->steps; ++i)
+   {
+      pthread_mutex_lock(&t->s->m);
+      modelStep(t->s, &t->seed);
+      pthread_mutex_unlock(&t->s->m);
+   }
+   return NULL;
+}/*modelThread*/
+
+static void stressModel(int mode, int nThreads, int steps, uint64_t *seed)
+{
+   static model_t s;
+   pthread_t th[MAX_THREADS];
+   modelThread_t t[MAX_THREADS];
+   int i;
+
+   pthread_mutex_init(&s.m, NULL);
+   if (NULL == i32_qFLInit(NULL, 2 + (int)(rnd(seed) % 7), &s.q, l_isFixed[mode]))
+   {
+      fail("can't allocate a queue", 0, 0);
+   }
+   s.first = s.last = MODEL_LENGTH / 2;
+   s.next = 1;
+   for (i = 0; i < nThreads; ++i)
+   {
+      t[i].s = &s;
+      t[i].seed = rnd(seed) | 1;
+      t[i].steps = steps;
+      if (pthread_create(th + i, NULL, modelThread, t + i))
+      {
+         fail("can't start a thread", i, 0);
+      }
+   }
+   for (i = 0; i < nThreads; ++i)
+   {
+      pthread_join(th[i], NULL);
+   }
+   i32_qFLDestroy(&s.q);
+   pthread_mutex_destroy(&s.m);
+}/*stressModel*/
+
+static void stress(int rounds, int items, uint64_t seed)
+{
+   int round;
+   for (round = 1; round <= rounds; ++round)
+   {
+      run_t r;
+      int mode = (int)(rnd(&seed) % MODE_NUMBER);
+      int nThreads = 1 + (int)(rnd(&seed) % 4);
+
+      stressModel(mode, nThreads, 2000 + (int)(rnd(&seed) % 8000), &seed);
+
+      r.impl = l_impls + rnd(&seed) % N_IMPLS;
+      r.mode = (int)(rnd(&seed) % MODE_NUMBER);
+      r.nProducers = 1 + (int)(rnd(&seed) % 4);
+      r.nConsumers = 1 + (int)(rnd(&seed) % 4);
+      r.perProducer = 1 + (int)(rnd(&seed) % (items / 10 + 1));
+      r.check = 1;
+      runOnce(&r, 2 + (int)(rnd(&seed) % 63));
+      if (0 == round % 10)
+      {
+         printf("%d rounds passed\n", round);
+         fflush(stdout);
+      }
+   }
+   printf("OK, %d rounds\n", rounds);
+}/*stress*/
+
+int main(int argc, char *argv[])
+{
+   int items = 1000000, rounds = 0, i;
+   uint64_t seed = (uint64_t)time(NULL);
+
+   for (i = 1; i < argc; ++i)
+   {
+      if ( (0 == strcmp(argv[i], "-n")) && (i + 1 < argc) )
+      {
+         items = atoi(argv[++i]);
+      }
+      else if ( (0 == strcmp(argv[i], "-s")) && (i + 1 < argc) )
+      {
+         rounds = atoi(argv[++i]);
+      }
+      else if ( (0 == strcmp(argv[i], "-r")) && (i + 1 < argc) )
+      {
+         seed = strtoull(argv[++i], NULL, 10);
+      }
+      else
+      {
+         fprintf(stderr, "usage: qbench [-n ITEMS] [-s ROUNDS] [-r SEED]\n");
+         return 2;
+      }
+   }
+   if ( (items < 4 * LAT_SAMPLE) || (items > SEQ_MASK) )
+   {
+      fprintf(stderr, "ITEMS must be from %d to %d\n", 4 * LAT_SAMPLE, SEQ_MASK);
+      return 2;
+   }
+   if (rounds > 0)
+   {
+      printf("seed %llu\n", (unsigned long long)seed);
+      fflush(stdout);
+      stress(rounds, items, seed | 1);
+   }
+   else
+   {
+      bench(items);
+   }
+   return 0;
+}/*main*/
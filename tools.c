@@ -1,14 +1,68 @@
+#ifdef __linux__
+/*sync_file_range():*/
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 
 #include <pthread.h>
 
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#endif
+
 #include "tools.h"
 
 static pthread_mutex_t g_mIO = PTHREAD_MUTEX_INITIALIZER;
 static FILE *l_logFile = NULL;
 
+int g_logLevel = LOG_INFO;
+
+/*Per-thread log rings:*/
+#define LOG_RING_LENGTH 64
+#define LOG_RECORD_SIZE 1024
+#define LOG_MAX_RINGS 1024
+/*ms, the drainer sleeps when there is nothing to write:*/
+#define LOG_IDLE_SLEEP 5
+
+typedef struct
+{
+   unsigned seq;/*global order of records, the drainer merges rings by it*/
+   int level;
+   char text[LOG_RECORD_SIZE];
+}logRecord_t;
+
+/*Single producer (the owner thread), single consumer (the drainer).
+  head and tail are free running counters, head - tail records are ready:*/
+typedef struct
+{
+   unsigned head;/*modified only by the owner*/
+   unsigned tail;/*modified only by the drainer*/
+   logRecord_t records[LOG_RING_LENGTH];
+}logRing_t;
+
+/*Rings are never freed: a thread may keep its ring pointer after the
+  drainer is stopped:*/
+static logRing_t *l_rings[LOG_MAX_RINGS];
+static int l_nRings = 0;
+static COM_THREAD_LOCAL logRing_t *l_myRing = NULL;
+static COM_THREAD_LOCAL int l_noRing = 0;
+
+static int l_loggerRunning = 0;
+static unsigned l_seq = 0;
+static unsigned l_dropped = 0;
+static pthread_t l_drainer;
+/*Serializes readers of the rings (the drainer, halt() and stopLogger()):*/
+static pthread_mutex_t l_mDrain = PTHREAD_MUTEX_INITIALIZER;
+
 int isLogOpen(void)
 {
    return (NULL != l_logFile);
@@ -35,18 +89,88 @@ int openLog (char *logFileName)
    return (NULL == l_logFile);
 }/*openLog*/
 
+/*Must be called with g_mIO locked:*/
+static void writeOut(int level, char *text)
+{
+   fputs(text, (LOG_ERROR == level)? stderr: stdout);
+   if (NULL != l_logFile)
+   {
+      fputs(text, l_logFile);
+   }
+}/*writeOut*/
+
+/*Registers the ring of the calling thread on the first use.
+  Returns NULL if there is no ring, the caller must write synchronously:*/
+static logRing_t *myRing(void)
+{
+   if ( (NULL == l_myRing) && (0 == l_noRing) )
+   {
+      int n = COM_ATOMIC_ADD(&l_nRings, 1);
+      if ( (n >= LOG_MAX_RINGS) || (NULL == (l_myRing = calloc(1, sizeof(logRing_t)))) )
+      {
+         l_noRing = 1;
+         return NULL;
+      }
+      COM_ATOMIC_STORE(&l_rings[n], l_myRing);
+   }
+   return l_myRing;
+}/*myRing*/
+
+static void vlogMessage(int level, char *fmt, va_list arg_ptr)
+{
+   logRing_t *ring;
+
+   if (level > g_logLevel)
+   {
+      return;
+   }
+
+   if ( COM_ATOMIC_LOAD(&l_loggerRunning) && (NULL != (ring = myRing())) )
+   {
+      unsigned head = ring->head;
+      logRecord_t *rec;
+      if (head - COM_ATOMIC_LOAD(&ring->tail) < LOG_RING_LENGTH)
+      {
+         rec = ring->records + head % LOG_RING_LENGTH;
+         rec->seq = COM_ATOMIC_ADD(&l_seq, 1);
+         rec->level = level;
+         vsnprintf(rec->text, LOG_RECORD_SIZE, fmt, arg_ptr);
+         rec->text[LOG_RECORD_SIZE - 1] = '\0';
+         COM_ATOMIC_STORE(&ring->head, head + 1);
+         return;
+      }
+      /*Full, never wait for the drainer. An error is not lost, it is
+        written synchronously (ahead of the queued records):*/
+      if (LOG_ERROR != level)
+      {
+         COM_ATOMIC_ADD(&l_dropped, 1);
+         return;
+      }
+   }
+
+   {/*No drainer (or an error into a full ring), synchronous output:*/
+      char text[LOG_RECORD_SIZE];
+      vsnprintf(text, LOG_RECORD_SIZE, fmt, arg_ptr);
+      text[LOG_RECORD_SIZE - 1] = '\0';
+      pthread_mutex_lock( &g_mIO);
+      writeOut(level, text);
+      pthread_mutex_unlock( &g_mIO);
+   }
+}/*vlogMessage*/
+
+void logMessage(int level, char *fmt, ...)
+{
+  va_list arg_ptr;
+  va_start (arg_ptr, fmt);
+  vlogMessage(level, fmt, arg_ptr);
+  va_end (arg_ptr);
+}/*logMessage*/
+
 void errorMsg(char *fmt, ...)
 {
   va_list arg_ptr;
   va_start (arg_ptr, fmt);
-  pthread_mutex_lock( &g_mIO);
-  vfprintf(stderr,fmt,arg_ptr);
-  if (NULL != l_logFile)
-  {
-     va_start (arg_ptr, fmt);
-     vfprintf(l_logFile,fmt,arg_ptr);
-  }
-  pthread_mutex_unlock( &g_mIO);
+  vlogMessage(LOG_ERROR, fmt, arg_ptr);
   va_end (arg_ptr);
 }/*errorMsg*/
 
@@ -70,16 +194,7 @@ void message(char *fmt, ...)
 {
   va_list arg_ptr;
   va_start (arg_ptr, fmt);
-  pthread_mutex_lock( &g_mIO);
-  vfprintf(stdout,fmt,arg_ptr);
-
-  if (NULL != l_logFile)
-  {
-     va_start (arg_ptr, fmt);
-     vfprintf(l_logFile,fmt,arg_ptr);
-  }
-
-  pthread_mutex_unlock( &g_mIO);
+  vlogMessage(LOG_INFO, fmt, arg_ptr);
   va_end (arg_ptr);
 }/*message*/
 
@@ -93,10 +208,156 @@ void unblockMessage(void)
   pthread_mutex_unlock (&g_mIO);
 }/*unblockMessage*/
 
+/*Must be called with l_mDrain locked. Writes records from all rings
+  roughly in the order they were created: seq is taken before a record
+  is published, so a record published later may precede one with a
+  smaller seq. Returns the number of written records:*/
+static int drainRings(void)
+{
+   int i, written = 0;
+   int n = COM_ATOMIC_LOAD(&l_nRings);
+   unsigned heads[LOG_MAX_RINGS];
+
+   if (n > LOG_MAX_RINGS)
+   {
+      n = LOG_MAX_RINGS;
+   }
+
+   /*Drain only what is ready now, so producers can't keep us here:*/
+   for (i = 0; i < n; ++i)
+   {
+      logRing_t *ring = COM_ATOMIC_LOAD(&l_rings[i]);
+      /*NULL if is being registered right now:*/
+      heads[i] = (NULL == ring)? 0: COM_ATOMIC_LOAD(&ring->head);
+   }
+
+   pthread_mutex_lock( &g_mIO);
+   for (;;)
+   {
+      logRing_t *next = NULL;
+      for (i = 0; i < n; ++i)
+      {
+         logRing_t *ring = l_rings[i];
+         if ( (NULL != ring) && (ring->tail != heads[i]) &&
+              ( (NULL == next) ||
+                ( (int)(ring->records[ring->tail % LOG_RING_LENGTH].seq -
+                        next->records[next->tail % LOG_RING_LENGTH].seq) < 0 )
+              )
+            )
+         {
+            next = ring;
+         }
+      }
+      if (NULL == next)
+      {
+         break;
+      }
+      {
+         logRecord_t *rec = next->records + next->tail % LOG_RING_LENGTH;
+         writeOut(rec->level, rec->text);
+         ++written;
+         COM_ATOMIC_STORE(&next->tail, next->tail + 1);
+      }
+   }
+   if (0 != written)
+   {
+      fflush(stdout);
+   }
+   pthread_mutex_unlock( &g_mIO);
+   return written;
+}/*drainRings*/
+
+static void *drainer(void *unused)
+{
+   while ( COM_ATOMIC_LOAD(&l_loggerRunning) )
+   {
+      int n;
+      pthread_mutex_lock(&l_mDrain);
+      n = drainRings();
+      pthread_mutex_unlock(&l_mDrain);
+      if (0 == n)
+      {
+         msleep(LOG_IDLE_SLEEP);
+      }
+   }
+   return NULL;
+}/*drainer*/
+
+#ifndef _WIN32
+/*A child of fork() must not inherit g_mIO (and the stdio locks under it)
+  held by another thread. It has no drainer, so its output is synchronous:*/
+static void atforkPrepare(void)
+{
+   pthread_mutex_lock(&l_mDrain);
+   pthread_mutex_lock(&g_mIO);
+}/*atforkPrepare*/
+
+static void atforkParent(void)
+{
+   pthread_mutex_unlock(&g_mIO);
+   pthread_mutex_unlock(&l_mDrain);
+}/*atforkParent*/
+
+static void atforkChild(void)
+{
+   pthread_mutex_unlock(&g_mIO);
+   pthread_mutex_unlock(&l_mDrain);
+   COM_ATOMIC_STORE(&l_loggerRunning, 0);
+}/*atforkChild*/
+#endif
+
+int startLogger(void)
+{
+#ifndef _WIN32
+   static int atforkDone = 0;
+   if (0 == atforkDone)
+   {
+      pthread_atfork(atforkPrepare, atforkParent, atforkChild);
+      atforkDone = 1;
+   }
+#endif
+   if ( COM_ATOMIC_LOAD(&l_loggerRunning) )
+   {
+      return 0;
+   }
+   COM_ATOMIC_STORE(&l_loggerRunning, 1);
+   if ( pthread_create(&l_drainer, NULL, drainer, NULL) )
+   {
+      COM_ATOMIC_STORE(&l_loggerRunning, 0);
+      return -1;
+   }
+   return 0;
+}/*startLogger*/
+
+void stopLogger(void)
+{
+   unsigned dropped;
+   if ( !COM_ATOMIC_LOAD(&l_loggerRunning) )
+   {
+      return;
+   }
+   COM_ATOMIC_STORE(&l_loggerRunning, 0);
+   pthread_join(l_drainer, NULL);
+   pthread_mutex_lock(&l_mDrain);
+   drainRings();
+   pthread_mutex_unlock(&l_mDrain);
+   dropped = COM_ATOMIC_LOAD(&l_dropped);
+   if (0 != dropped)
+   {
+      logMessage(LOG_WARNING, "%u log messages dropped\n", dropped);
+   }
+}/*stopLogger*/
+
 void halt(int retval,char *fmt, ...)
 {
   va_list arg_ptr;
   va_start (arg_ptr, fmt);
+  /*Write what is queued first, the drainer will not get a chance:*/
+  pthread_mutex_lock(&l_mDrain);
+  if ( COM_ATOMIC_LOAD(&l_loggerRunning) )
+  {
+     drainRings();
+  }
   pthread_mutex_lock( &g_mIO);
   vfprintf(stderr,fmt,arg_ptr);
  if (NULL != l_logFile)
@@ -109,6 +370,38 @@ void halt(int retval,char *fmt, ...)
   exit(retval);
 }/*halt*/
 
+int64_t parseSize(char *str)
+{
+   char *end;
+   double val = strtod(str, &end);
+
+   if ( (end == str) || (val < 0) )
+   {
+      return -1;
+   }
+   switch (myToupper(*end))
+   {
+      case '\0':
+         return (int64_t)val;
+      case 'K':
+         val *= 1024.0;
+         break;
+      case 'M':
+         val *= 1024.0 * 1024.0;
+         break;
+      case 'G':
+         val *= 1024.0 * 1024.0 * 1024.0;
+         break;
+      default:
+         return -1;
+   }
+   if ( ('\0' != end[1]) && ( ('B' != myToupper(end[1])) || ('\0' != end[2]) ) )
+   {
+      return -1;
+   }
+   return (int64_t)val;
+}/*parseSize*/
+
 /*Calls 'theCallback' for each entry of a directory 'providedPath'.
  'data' is the external data for the callback 'theCallback'. Returns
  the number of processed enties, or <0 on error. If the callback 
@@ -222,3 +515,101 @@ int listDir(char *providedPath, listDirCallback_t theCallback, void *data)
 #endif
    return i;
 }/*listDir*/
+
+int prefetchFile(char *fileName)
+{
+#ifdef _WIN32
+   return 0;
+#else
+   int ret, fd = open(fileName, O_RDONLY);
+   if (fd < 0)
+   {
+      return -1;
+   }
+   /*Linux starts reading the whole range right away:*/
+   ret = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+   close(fd);
+   return ret;
+#endif
+}/*prefetchFile*/
+
+void startWriteback(FILE *f, int64_t offset, int64_t len)
+{
+#ifdef __linux__
+   sync_file_range(fileno(f), offset, len, SYNC_FILE_RANGE_WRITE);
+#endif
+}/*startWriteback*/
+
+void dropFileCache(FILE *f, int64_t offset, int64_t len, int written)
+{
+#ifndef _WIN32
+   if (written)
+   {
+#ifdef __linux__
+      /*dirty pages and pages under writeback can't be dropped:*/
+      sync_file_range(fileno(f), offset, len,
+         SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+      fdatasync(fileno(f));
+#endif
+   }
+   posix_fadvise(fileno(f), offset, len, POSIX_FADV_DONTNEED);
+#endif
+}/*dropFileCache*/
+
+int makeDirs(char *path)
+{
+   char dir[MAX_PATH_LENGTH];
+   size_t i, l = strlen(path);
+
+   if (l >= MAX_PATH_LENGTH)
+   {
+      return -1;
+   }
+   strcpy(dir, path);
+   /*from 1: the root directory exists:*/
+   for (i = 1; i < l; ++i)
+   {
+      if ( (SYSTEM_DIR_DELIMITER != dir[i]) || (SYSTEM_DIR_DELIMITER == dir[i - 1]) )
+      {
+         continue;
+      }
+      dir[i] = '\0';
+#ifdef _WIN32
+      /*"C:":*/
+      if ( (':' != dir[i - 1]) && (0 != _mkdir(dir)) && (EEXIST != errno) )
+#else
+      if ( (0 != mkdir(dir, 0777)) && (EEXIST != errno) )
+#endif
+      {
+         return -1;
+      }
+      dir[i] = SYSTEM_DIR_DELIMITER;
+   }
+   return 0;
+}/*makeDirs*/
+
+int64_t deviceId(char *path)
+{
+   struct stat st;
+   if (0 != stat(path, &st))
+   {
+      return -1;
+   }
+   return (int64_t)st.st_dev;
+}/*deviceId*/
+
+int64_t getPathSize(char *path)
+{
+#ifdef _WIN32
+   struct _stati64 st;
+   if (0 != _stati64(path, &st))
+#else
+   struct stat st;
+   if (0 != stat(path, &st))
+#endif
+   {
+      return -1;
+   }
+   return (int64_t)st.st_size;
+}/*getPathSize*/
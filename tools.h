@@ -7,9 +7,12 @@
 #ifdef _WIN32
 #define SYSTEM_DIR_DELIMITER '\\'
 #include <windows.h>
+#include <io.h>
 #else
 #define SYSTEM_DIR_DELIMITER '/'
 #include <unistd.h>
+#include <stdint.h>
+#include <time.h>
 #include <sys/types.h>
 #include <dirent.h>
 #endif
@@ -30,6 +33,15 @@ extern "C" {
 
   typedef int (*listDirCallback_t)(int i, char *dirEntry, int isDirectory, void *data);
 
+/*Log levels. LOG_ERROR goes to stderr, others to stdout:*/
+#define LOG_ERROR 0
+#define LOG_WARNING 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+/*Messages above this level are discarded, see logMsg():*/
+extern int g_logLevel;
+
 int isLogOpen(void);
 
 /* NULL or "" to close log:*/
@@ -38,6 +50,23 @@ void errorMsg(char *fmt, ...);
 void message(char *fmt, ...);
 void halt(int retval,char *fmt, ...);
 
+/*The level is checked before the arguments are even evaluated, so a
+  filtered out message costs nothing:*/
+#define logMsg(level, ...) \
+   do{ if ((level) <= g_logLevel) logMessage((level), __VA_ARGS__); }while(0)
+void logMessage(int level, char *fmt, ...);
+
+/*Starts/stops the background thread draining per-thread log rings.
+  While it runs, message(), errorMsg() and logMessage() never block:
+  each thread formats into its own ring, the drainer writes to
+  stdout/stderr and the log file. If a ring is full, the message is
+  dropped and counted, but an error is written synchronously. Without
+  the drainer the output is synchronous.
+  stopLogger() writes everything remained. In a child of fork() the
+  output is synchronous, messages queued by the parent are not repeated:*/
+int startLogger(void);
+void stopLogger(void);
+
 void blockMessage(void);
 void unblockMessage(void);
 void unblockedMessage(char *fmt, ...);
@@ -56,16 +85,82 @@ int myToupper (int ch)
 
 int listDir(char *providedPath, listDirCallback_t theCallback, void *data);
 
+/*Parses "123", "64k", "100M", "2G" (powers of 1024). Returns -1 on error:*/
+int64_t parseSize(char *str);
+
 static TOOLS_INLINE
-int getFileSize(FILE *f)
+int64_t getFileSize(FILE *f)
 {
-   long int fSize = 0;
-   fseek(f,0,SEEK_END);
-   fSize=ftell(f);
-   fseek(f,0,SEEK_SET);
+   int64_t fSize = 0;
+   COM_FSEEK(f,0,SEEK_END);
+   fSize=COM_FTELL(f);
+   COM_FSEEK(f,0,SEEK_SET);
    return fSize;
 }/*getFileSize*/
 
+/*Flushes the stream and makes the file durable. Returns 0 on success:*/
+static TOOLS_INLINE
+int syncFile(FILE *f)
+{
+   if (0 != fflush(f))
+   {
+      return -1;
+   }
+#ifdef _WIN32
+   return _commit(_fileno(f));
+#else
+   return fsync(fileno(f));
+#endif
+}/*syncFile*/
+
+/*Page cache hints, no-ops on Windows.
+  prefetchFile() asks the kernel to read the file in the background,
+  returns 0 on success.
+  startWriteback() starts writing the range of a flushed file to the disk
+  without waiting.
+  dropFileCache() evicts the range from the page cache, len 0 means up to
+  the end of the file. If the file was written (it must be flushed), waits
+  until the range is on the disk, since dirty pages can't be dropped:*/
+int prefetchFile(char *fileName);
+void startWriteback(FILE *f, int64_t offset, int64_t len);
+void dropFileCache(FILE *f, int64_t offset, int64_t len, int written);
+
+/*Creates the directories of the path up to its last delimiter, like
+  "mkdir -p". Returns 0 on success:*/
+int makeDirs(char *path);
+
+/*The id of the device the path is on, -1 on error:*/
+int64_t deviceId(char *path);
+
+/*The size of the file, -1 on error:*/
+int64_t getPathSize(char *path);
+
+static TOOLS_INLINE
+void msleep(int milliseconds)
+{
+#ifdef _WIN32
+   Sleep(milliseconds);
+#else
+   usleep(milliseconds * 1000);
+#endif
+}/*msleep*/
+
+/*Monotonic time in microseconds:*/
+static TOOLS_INLINE
+int64_t getTimeUs(void)
+{
+#ifdef _WIN32
+   LARGE_INTEGER freq, count;
+   QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&count);
+   return (int64_t)( (double)count.QuadPart / (double)freq.QuadPart * 1e6 );
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}/*getTimeUs*/
+
 static TOOLS_INLINE
 int getCpuNumber(void)
 {
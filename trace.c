@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <inttypes.h>
+#endif
+
+#include <pthread.h>
+
+#include "trace.h"
+
+#define TRACE_CHUNK 4096
+#define TRACE_NAME_LENGTH 64
+
+typedef struct
+{
+   const char *name;
+   int64_t ts;
+   int64_t dur;
+   char *arg;
+}traceEvent_t;
+
+typedef struct traceChunk_struct
+{
+   struct traceChunk_struct *next;
+   int n;
+   traceEvent_t events[TRACE_CHUNK];
+}traceChunk_t;
+
+/*Per-thread buffer:*/
+typedef struct traceBuf_struct
+{
+   struct traceBuf_struct *next;
+   int tid;
+   char name[TRACE_NAME_LENGTH];
+   traceChunk_t *first;
+   traceChunk_t *last;
+}traceBuf_t;
+
+int g_traceEnabled = 0;
+
+static char *l_traceFileName = NULL;
+static int64_t l_traceT0 = 0;
+
+/*The mutex protects only the list of buffers, taken once per thread:*/
+static pthread_mutex_t l_mTraceBufs = PTHREAD_MUTEX_INITIALIZER;
+static traceBuf_t *l_traceBufs = NULL;
+static int l_nTraceBufs = 0;
+static COM_THREAD_LOCAL traceBuf_t *l_myTraceBuf = NULL;
+
+int traceOpen(char *fileName)
+{
+   FILE *f = fopen(fileName, "w");
+   if (NULL == f)
+   {
+      return -1;
+   }
+   fclose(f);
+   l_traceFileName = strcpy(malloc(strlen(fileName) + 1), fileName);
+   l_traceT0 = getTimeUs();
+   g_traceEnabled = 1;
+   return 0;
+}/*traceOpen*/
+
+static traceBuf_t *myTraceBuf(void)
+{
+   if (NULL == l_myTraceBuf)
+   {
+      traceBuf_t *b = calloc(1, sizeof(traceBuf_t));
+      if (NULL == b)
+      {
+         return NULL;
+      }
+      pthread_mutex_lock(&l_mTraceBufs);
+      b->tid = ++l_nTraceBufs;
+      b->next = l_traceBufs;
+      l_traceBufs = b;
+      pthread_mutex_unlock(&l_mTraceBufs);
+      l_myTraceBuf = b;
+   }
+   return l_myTraceBuf;
+}/*myTraceBuf*/
+
+void traceThreadName(char *name)
+{
+   traceBuf_t *b;
+   if ( (0 == g_traceEnabled) || (NULL == (b = myTraceBuf())) )
+   {
+      return;
+   }
+   strncpy(b->name, name, TRACE_NAME_LENGTH - 1);
+}/*traceThreadName*/
+
+void traceSpan(const char *name, int64_t startUs, const char *arg)
+{
+   traceBuf_t *b = myTraceBuf();
+   traceEvent_t *e;
+
+   if (NULL == b)
+   {
+      return;
+   }
+   if ( (NULL == b->last) || (TRACE_CHUNK == b->last->n) )
+   {
+      traceChunk_t *c = malloc(sizeof(traceChunk_t));
+      if (NULL == c)
+      {
+         return;
+      }
+      c->next = NULL;
+      c->n = 0;
+      if (NULL == b->last)
+      {
+         b->first = c;
+      }
+      else
+      {
+         b->last->next = c;
+      }
+      b->last = c;
+   }
+   e = b->last->events + b->last->n++;
+   e->name = name;
+   e->ts = startUs - l_traceT0;
+   e->dur = getTimeUs() - startUs;
+   e->arg = (NULL == arg)? NULL: strcpy(malloc(strlen(arg) + 1), arg);
+}/*traceSpan*/
+
+/*Writes a JSON string literal:*/
+static void jsonString(FILE *f, const char *str)
+{
+   fputc('"', f);
+   for (; '\0' != *str; ++str)
+   {
+      unsigned char ch = (unsigned char)*str;
+      if ( ('"' == ch) || ('\\' == ch) )
+      {
+         fputc('\\', f);
+         fputc(ch, f);
+      }
+      else if (ch < 0x20)
+      {
+         fprintf(f, "\\u%04x", ch);
+      }
+      else
+      {
+         fputc(ch, f);
+      }
+   }
+   fputc('"', f);
+}/*jsonString*/
+
+int traceClose(void)
+{
+   FILE *f;
+   traceBuf_t *b;
+   int first = 1;
+
+   if (0 == g_traceEnabled)
+   {
+      return 0;
+   }
+   g_traceEnabled = 0;
+
+   f = fopen(l_traceFileName, "w");
+   if (NULL == f)
+   {
+      return -1;
+   }
+   fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+   for (b = l_traceBufs; NULL != b; b = b->next)
+   {
+      traceChunk_t *c;
+      if ('\0' != b->name[0])
+      {
+         fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                 "\"args\":{\"name\":", first? "": ",\n", b->tid);
+         jsonString(f, b->name);
+         fprintf(f, "}}");
+         first = 0;
+      }
+      for (c = b->first; NULL != c; c = c->next)
+      {
+         int i;
+         for (i = 0; i < c->n; ++i)
+         {
+            traceEvent_t *e = c->events + i;
+            fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"lameWav2mp3\",\"ph\":\"X\","
+                    "\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"pid\":1,\"tid\":%d",
+                    first? "": ",\n", e->name, e->ts, e->dur, b->tid);
+            if (NULL != e->arg)
+            {
+               fprintf(f, ",\"args\":{\"file\":");
+               jsonString(f, e->arg);
+               fputc('}', f);
+               free(e->arg);
+            }
+            fputc('}', f);
+            first = 0;
+         }
+      }
+   }
+   fprintf(f, "\n]}\n");
+   return (0 != fclose(f))? -1: 0;
+}/*traceClose*/
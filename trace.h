@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H 1
+
+/*
+  Timeline of threads activity in the Chrome trace-event format, may be
+  opened by chrome://tracing or https://ui.perfetto.dev
+
+  Each thread collects complete ("X") events in its own buffer, nothing
+  is shared on the hot path. All buffers are written by traceClose(),
+  which must be called when traced threads are finished.
+
+  Usage:
+     int64_t t0 = traceStart();
+     ...
+     traceEnd("encode", t0, NULL);
+
+  If the tracing is not enabled by traceOpen(), both macros cost one
+  test of a global variable.
+*/
+
+#include "tools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int g_traceEnabled;
+
+/*Enables tracing, events will be written into fileName by traceClose():*/
+int traceOpen(char *fileName);
+/*Writes all events and disables tracing. Returns 0 on success:*/
+int traceClose(void);
+
+/*Name of the calling thread in the timeline:*/
+void traceThreadName(char *name);
+
+/*name must be a static string; arg (may be NULL) is copied:*/
+void traceSpan(const char *name, int64_t startUs, const char *arg);
+
+#define traceStart() (g_traceEnabled? getTimeUs(): 0)
+#define traceEnd(name, start, arg) \
+   do{ if (g_traceEnabled) traceSpan((name), (start), (arg)); }while(0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
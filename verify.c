@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <lame.h>
+#else
+#include <lame/lame.h>
+#endif
+
+#include "tools.h"
+#include "verify.h"
+
+/*bytes of the .mp3 fed to the decoder at once:*/
+#define VERIFY_CHUNK 65536
+/*samples of a decoded frame, per channel (1152 for MPEG-1 layer III):*/
+#define VERIFY_PCM 8192
+/*16 bit values of the source read at once:*/
+#define VERIFY_SOURCE 32768
+
+typedef struct
+{
+   hip_t hip;
+   FILE *f;
+   unsigned char *in;
+   short *l, *r;
+   int n, at;/*decoded samples in l/r and the next one*/
+   int64_t decoded;
+   int errors;
+   int eof;
+   verifyJob_t *job;
+}decoder_t;
+
+typedef struct
+{
+   FILE *f;
+   int16_t *buf;
+   int n, at;
+   int64_t left;/*values not read yet*/
+   int channels;
+   verifyJob_t *job;
+}source_t;
+
+verifyJob_t *verifyNewJob(char *source, char *output)
+{
+   size_t ls = strlen(source) + 1, lo = strlen(output) + 1;
+   verifyJob_t *job = malloc(sizeof(verifyJob_t) + ls + lo);
+   if (NULL == job)
+   {
+      return NULL;
+   }
+   memset(job, 0, sizeof(verifyJob_t));
+   job->source = (char*)(job + 1);
+   job->output = job->source + ls;
+   memcpy(job->source, source, ls);
+   memcpy(job->output, output, lo);
+   return job;
+}/*verifyNewJob*/
+
+void verifyFreeJob(verifyJob_t *job)
+{
+   free(job);
+}/*verifyFreeJob*/
+
+static void tick(verifyJob_t *job)
+{
+   if (NULL != job->tick)
+   {
+      job->tick(job->tickArg);
+   }
+}/*tick*/
+
+static void decoderClose(decoder_t *d)
+{
+   if (NULL != d->hip)
+   {
+      hip_decode_exit(d->hip);
+      d->hip = NULL;
+   }
+   if (NULL != d->f)
+   {
+      fclose(d->f);
+      d->f = NULL;
+   }
+   free(d->in);
+   d->in = NULL;
+}/*decoderClose*/
+
+static int decoderOpen(decoder_t *d, verifyJob_t *job)
+{
+   memset(d, 0, sizeof(decoder_t));
+   d->job = job;
+   d->f = fopen(job->output, "rb");
+   d->hip = hip_decode_init();
+   /*one block for the input and both channels:*/
+   d->in = malloc(VERIFY_CHUNK + 2 * VERIFY_PCM * sizeof(short));
+   if ( (NULL == d->f) || (NULL == d->hip) || (NULL == d->in) )
+   {
+      decoderClose(d);
+      return -1;
+   }
+   d->l = (short*)(d->in + VERIFY_CHUNK);
+   d->r = d->l + VERIFY_PCM;
+   return 0;
+}/*decoderOpen*/
+
+/*Decodes the next frame. Returns the number of samples, 0 at the end
+  or after an error (which is counted, the rest is not decoded):*/
+static int decodeMore(decoder_t *d)
+{
+   mp3data_struct md;
+   int k;
+   if (0 != d->errors)
+   {
+      return 0;
+   }
+   for(;;)
+   {
+      /*frames which are already buffered:*/
+      k = hip_decode1_headers(d->hip, d->in, 0, d->l, d->r, &md);
+      if ( (0 == k) && (0 == d->eof) )
+      {
+         size_t len = fread(d->in, 1, VERIFY_CHUNK, d->f);
+         tick(d->job);
+         if (0 == len)
+         {
+            d->eof = 1;
+            continue;
+         }
+         k = hip_decode1_headers(d->hip, d->in, len, d->l, d->r, &md);
+         if (0 == k)
+         {
+            continue;
+         }
+      }
+      break;
+   }
+   if (k < 0)
+   {
+      ++d->errors;
+      d->eof = 1;
+      k = 0;
+   }
+   d->n = k;
+   d->at = 0;
+   d->decoded += k;
+   return k;
+}/*decodeMore*/
+
+static int nextDecoded(decoder_t *d, int *left, int *right)
+{
+   if ( (d->at == d->n) && (0 == decodeMore(d)) )
+   {
+      return 0;
+   }
+   *left = d->l[d->at];
+   *right = d->r[d->at];
+   ++d->at;
+   return 1;
+}/*nextDecoded*/
+
+static int sourceOpen(source_t *s, verifyJob_t *job)
+{
+   memset(s, 0, sizeof(source_t));
+   s->f = fopen(job->source, "rb");
+   s->buf = malloc(VERIFY_SOURCE * sizeof(int16_t));
+   s->left = job->frames * 2;
+   s->channels = job->channels;
+   s->job = job;
+   if ( (NULL == s->f) || (NULL == s->buf) || (0 != COM_FSEEK(s->f, job->dataStart, SEEK_SET)) )
+   {
+      if (NULL != s->f)
+      {
+         fclose(s->f);
+      }
+      free(s->buf);
+      return -1;
+   }
+   return 0;
+}/*sourceOpen*/
+
+static void sourceClose(source_t *s)
+{
+   fclose(s->f);
+   free(s->buf);
+}/*sourceClose*/
+
+static int nextValue(source_t *s, int *v)
+{
+   if (s->at == s->n)
+   {
+      size_t n = VERIFY_SOURCE;
+      if (s->left < (int64_t)n)
+      {
+         n = (size_t)s->left;
+      }
+      if ( (0 == n) || (0 == (n = fread(s->buf, sizeof(int16_t), n, s->f))) )
+      {
+         return 0;
+      }
+      tick(s->job);
+      s->n = (int)n;
+      s->at = 0;
+      s->left -= n;
+   }
+   *v = s->buf[s->at++];
+   return 1;
+}/*nextValue*/
+
+/*The next sample of each channel, a mono one is in both:*/
+static int nextSource(source_t *s, int *left, int *right)
+{
+   if (0 == nextValue(s, left))
+   {
+      return 0;
+   }
+   if (2 != s->channels)
+   {
+      *right = *left;
+      return 1;
+   }
+   return nextValue(s, right);
+}/*nextSource*/
+
+/*The delay of the decoded samples: the least error over the first
+  VERIFY_WINDOW source samples. Returns -1 on error:*/
+static int findLag(verifyJob_t *job, int64_t samples)
+{
+   int *buf = malloc(2 * (VERIFY_WINDOW + VERIFY_MAX_LAG + VERIFY_WINDOW) * sizeof(int));
+   int *dl = buf, *dr = dl + VERIFY_WINDOW + VERIFY_MAX_LAG;
+   int *sl = dr + VERIFY_WINDOW + VERIFY_MAX_LAG, *sr = sl + VERIFY_WINDOW;
+   int nd = 0, ns = 0, lag, best = -1;
+   uint64_t bestErr = UINT64_MAX;
+   decoder_t d;
+   source_t s;
+
+   if (NULL == buf)
+   {
+      return -1;
+   }
+   if (0 != decoderOpen(&d, job))
+   {
+      free(buf);
+      return -1;
+   }
+   while ( (nd < VERIFY_WINDOW + VERIFY_MAX_LAG) && nextDecoded(&d, dl + nd, dr + nd) )
+   {
+      ++nd;
+   }
+   decoderClose(&d);
+   if (0 != sourceOpen(&s, job))
+   {
+      free(buf);
+      return -1;
+   }
+   while ( (ns < VERIFY_WINDOW) && (ns < samples) && nextSource(&s, sl + ns, sr + ns) )
+   {
+      ++ns;
+   }
+   sourceClose(&s);
+
+   for (lag = 0; lag + ns <= nd; ++lag)
+   {
+      uint64_t err = 0;
+      int i;
+      for (i = 0; (i < ns) && (err < bestErr); ++i)
+      {
+         int64_t el = sl[i] - dl[lag + i], er = sr[i] - dr[lag + i];
+         err += (uint64_t)(el * el);
+         if (2 == job->channels)
+         {
+            err += (uint64_t)(er * er);
+         }
+      }
+      if (err < bestErr)
+      {
+         bestErr = err;
+         best = lag;
+         if (0 == err)
+         {
+            break;
+         }
+      }
+   }
+   free(buf);
+   return (best < 0)? 0: best;
+}/*findLag*/
+
+int verifyFile(verifyJob_t *job, double minSnr, verifyResult_t *r)
+{
+   int64_t i;
+   uint64_t sig = 0, err = 0;
+   int l, rt, dl, dr;
+   decoder_t d;
+   source_t s;
+
+   memset(r, 0, sizeof(verifyResult_t));
+   /*per channel:*/
+   r->samples = (2 == job->channels)? job->frames: 2 * job->frames;
+   if ( (0 != job->compare) && (r->samples > 0) && ( (r->lag = findLag(job, r->samples)) < 0 ) )
+   {
+      r->problem = "can't read the files";
+      return -1;
+   }
+   if (0 != decoderOpen(&d, job))
+   {
+      r->problem = "can't open the output";
+      return -1;
+   }
+   if ( (0 != job->compare) && (r->samples > 0) )
+   {
+      if (0 != sourceOpen(&s, job))
+      {
+         decoderClose(&d);
+         r->problem = "can't read the source";
+         return -1;
+      }
+      for (i = 0; (i < r->lag) && nextDecoded(&d, &dl, &dr); ++i)
+      {
+         ;
+      }
+      for (i = 0; i < r->samples; ++i)
+      {
+         int64_t e;
+         if (0 == nextSource(&s, &l, &rt))
+         {
+            r->problem = "can't read the source";
+            break;
+         }
+         if (0 == nextDecoded(&d, &dl, &dr))
+         {
+            break;
+         }
+         e = l - dl;
+         err += (uint64_t)(e * e);
+         sig += (uint64_t)((int64_t)l * l);
+         if (2 == job->channels)
+         {
+            e = rt - dr;
+            err += (uint64_t)(e * e);
+            sig += (uint64_t)((int64_t)rt * rt);
+         }
+      }
+      sourceClose(&s);
+   }
+   /*the rest, for the duration:*/
+   while (0 != decodeMore(&d))
+   {
+      ;
+   }
+   r->decoded = d.decoded;
+   r->errors = d.errors;
+   decoderClose(&d);
+
+   r->exact = (0 != job->compare) && (0 == err);
+   r->snr = ( (0 == err) || (0 == sig) )? 0.0: 10.0 * log10((double)sig / (double)err);
+   if (NULL != r->problem)
+   {
+      return -1;
+   }
+   if (0 != r->errors)
+   {
+      r->problem = "a frame can't be decoded";
+   }
+   else if (r->decoded - r->lag < r->samples)
+   {
+      r->problem = "the output is shorter than the source";
+   }
+   else if (r->decoded - r->lag - r->samples >
+            ( (0 != job->compare)? VERIFY_SLACK: VERIFY_MAX_LAG + VERIFY_SLACK ))
+   {
+      r->problem = "the output is longer than the source";
+   }
+   else if ( (0 != job->compare) && (0 != err) && (0 != sig) && (r->snr < minSnr) )
+   {
+      r->problem = "the SNR is too low";
+   }
+   return (NULL == r->problem)? 0: -1;
+}/*verifyFile*/
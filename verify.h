@@ -0,0 +1,68 @@
+#ifndef VERIFY_H
+#define VERIFY_H 1
+
+/*
+  Verification of a freshly written .mp3 (see --verify): the file is
+  decoded in-process by the hip decoder of LAME, while it and its source
+  are still in the page cache.
+
+  Checks:
+  - every frame decodes;
+  - the duration: all the samples given to the encoder are there, plus
+    at most the encoder/decoder delay and VERIFY_SLACK of padding;
+  - if the source was encoded as is (no trimming), the decoded samples
+    are compared with the source: the delay is found by the least error
+    over the first VERIFY_WINDOW samples, then the SNR is computed over
+    the whole file (or the output is reported bit-exact).
+*/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*samples per channel:*/
+#define VERIFY_MAX_LAG 2304
+#define VERIFY_WINDOW 4096
+#define VERIFY_SLACK (3 * 1152)
+
+typedef struct
+{
+   char *source;/*the .wav*/
+   char *output;/*the .mp3*/
+   int64_t dataStart;/*offset of the PCM in the source*/
+   int64_t frames;/*given to the encoder, of 2 samples (so a mono frame is 2 samples)*/
+   int channels;
+   int compare;/*!0 if the source was encoded as is*/
+   int status;/*of the encoding, kept for the caller*/
+   /*if not NULL, called with tickArg after each chunk read from a file
+     (so a long verification can report progress):*/
+   void (*tick)(void *tickArg);
+   void *tickArg;
+}verifyJob_t;
+
+typedef struct
+{
+   int64_t samples;/*expected, per channel*/
+   int64_t decoded;/*per channel, including the delay*/
+   int lag;/*the delay, samples*/
+   int errors;/*frames which failed to decode*/
+   int exact;/*!0 if the samples are the same as the source*/
+   double snr;/*dB, if compared and not exact*/
+   const char *problem;/*NULL if verified*/
+}verifyResult_t;
+
+/*A malloc'ed job with copies of the names, NULL if there is no memory:*/
+verifyJob_t *verifyNewJob(char *source, char *output);
+void verifyFreeJob(verifyJob_t *job);
+
+/*Decodes job->output and checks it. A comparison with SNR below minSnr
+  fails. Returns 0 if it is verified, otherwise r->problem tells why:*/
+int verifyFile(verifyJob_t *job, double minSnr, verifyResult_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif